@@ -4,8 +4,7 @@
 #define UIP_UDP_BUF          ((struct uip_udp_hdr *)&uip_buf[UIP_LLIPH_LEN])
 #define UIP_ICMP_BUF            ((struct uip_icmp_hdr *)&uip_buf[uip_l2_l3_hdr_len])
 
-#define MAPPER_CLIENT_PORT 4713
-#define MAPPER_SERVER_PORT 4714
+#include "ids-ports.h"
 
 #include "net/uip.h"
 
@@ -0,0 +1,9 @@
+#ifndef __IDS_PORTS_H__
+#define __IDS_PORTS_H__
+
+/* The UDP ports of the network mapper. Kept apart from ids-common.h so
+   that project configurations can include them as well. */
+#define MAPPER_CLIENT_PORT 4713
+#define MAPPER_SERVER_PORT 4714
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Shell command that shows the timing statistics of the MAC layer
+ */
+
+#include "contiki.h"
+#include "shell-macstats.h"
+#include "net/mac/macstats.h"
+
+#include <string.h>
+
+/*---------------------------------------------------------------------------*/
+PROCESS(shell_macstats_process, "macstats");
+SHELL_COMMAND(macstats_command,
+	      "macstats",
+	      "macstats [reset]: show or clear the MAC timing statistics of each neighbor",
+	      &shell_macstats_process);
+/*---------------------------------------------------------------------------*/
+static void
+output_line(const char *line)
+{
+  shell_output_str(&macstats_command, "", line);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(shell_macstats_process, ev, data)
+{
+  const char *args;
+
+  PROCESS_BEGIN();
+
+  args = data;
+  if(args != NULL && strncmp(args, "reset", 5) == 0) {
+    macstats_reset();
+  } else {
+    macstats_print(output_line);
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+void
+shell_macstats_init(void)
+{
+  shell_register_command(&macstats_command);
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Trickle timer library implementation
+ */
+
+#include <string.h>
+
+#include "lib/trickle-timer.h"
+#include "lib/random.h"
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+static void handle_timer(void *ptr);
+
+/*---------------------------------------------------------------------------*/
+/* Keep the parameters within TRICKLE_TIMER_MAX_INTERVAL, since they
+   may come from the network. */
+static void
+set_params(struct trickle_timer *t, uint8_t i_min, uint8_t i_doublings,
+           uint8_t k)
+{
+  if(i_min > TRICKLE_TIMER_MAX_INTERVAL) {
+    i_min = TRICKLE_TIMER_MAX_INTERVAL;
+  }
+  if(i_doublings > TRICKLE_TIMER_MAX_INTERVAL - i_min) {
+    i_doublings = TRICKLE_TIMER_MAX_INTERVAL - i_min;
+  }
+  t->i_min = i_min;
+  t->i_doublings = i_doublings;
+  t->k = k;
+}
+
+/*---------------------------------------------------------------------------*/
+static void
+new_interval(struct trickle_timer *t)
+{
+  uint32_t time;
+
+  time = 1UL << t->i_current;
+
+  /* Convert from milliseconds to CLOCK_TICKS. */
+  time = (time * CLOCK_SECOND) / 1000;
+
+  t->next_delay = time;
+
+  /* random number between I/2 and I */
+  time = time >> 1;
+  time += (time * random_rand()) / RANDOM_RAND_MAX;
+
+  /*
+   * The intervals must be equally long among the nodes for Trickle to
+   * operate efficiently. Therefore we need to calculate the delay between
+   * the randomized time and the start time of the next interval.
+   */
+  t->next_delay -= time;
+  t->in_first_half = 1;
+  t->c = 0;
+  t->stats.intervals++;
+
+  PRINTF("trickle: scheduling timer %lu ticks in future (interval)\n",
+         (unsigned long)time);
+  ctimer_set(&t->ct, time, handle_timer, t);
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_timer(void *ptr)
+{
+  struct trickle_timer *t;
+
+  t = ptr;
+
+  if(t->in_first_half) {
+    /* send if the counter is less than the desired redundancy */
+    if(t->k == TRICKLE_TIMER_INFINITE_REDUNDANCY || t->c < t->k) {
+      if(!t->transmit(t->ptr)) {
+        PRINTF("trickle: postponing transmission\n");
+        ctimer_set(&t->ct, CLOCK_SECOND, handle_timer, t);
+        return;
+      }
+      t->stats.transmitted++;
+    } else {
+      PRINTF("trickle: suppressing transmission (%d >= %d)\n", t->c, t->k);
+      t->stats.suppressed++;
+    }
+    t->in_first_half = 0;
+    PRINTF("trickle: scheduling timer %lu ticks in future (sent)\n",
+           (unsigned long)t->next_delay);
+    ctimer_set(&t->ct, t->next_delay, handle_timer, t);
+  } else {
+    /* check if we need to double interval */
+    if(t->i_current < t->i_min + t->i_doublings) {
+      t->i_current++;
+      t->stats.doublings++;
+      PRINTF("trickle: interval doubled %d\n", t->i_current);
+    }
+    new_interval(t);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+trickle_timer_init(struct trickle_timer *t, uint8_t i_min,
+                   uint8_t i_doublings, uint8_t k,
+                   int (* transmit)(void *ptr), void *ptr)
+{
+  ctimer_stop(&t->ct);
+  t->transmit = transmit;
+  t->ptr = ptr;
+  set_params(t, i_min, i_doublings, k);
+  t->i_current = t->i_min + t->i_doublings;
+  t->c = 0;
+  t->in_first_half = 0;
+  memset(&t->stats, 0, sizeof(t->stats));
+}
+/*---------------------------------------------------------------------------*/
+void
+trickle_timer_config(struct trickle_timer *t, uint8_t i_min,
+                     uint8_t i_doublings, uint8_t k)
+{
+  set_params(t, i_min, i_doublings, k);
+  if(t->i_current < t->i_min) {
+    t->i_current = t->i_min;
+  } else if(t->i_current > t->i_min + t->i_doublings) {
+    t->i_current = t->i_min + t->i_doublings;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+trickle_timer_reset(struct trickle_timer *t)
+{
+  /* Do not reset if we are already on the minimum interval. */
+  if(t->i_current > t->i_min) {
+    t->i_current = t->i_min;
+    t->stats.resets++;
+    new_interval(t);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+trickle_timer_consistent(struct trickle_timer *t)
+{
+  t->c++;
+  t->stats.consistent++;
+}
+/*---------------------------------------------------------------------------*/
+void
+trickle_timer_stop(struct trickle_timer *t)
+{
+  ctimer_stop(&t->ct);
+}
+/*---------------------------------------------------------------------------*/
+void
+trickle_timer_reset_stats(struct trickle_timer *t)
+{
+  memset(&t->stats, 0, sizeof(t->stats));
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,162 @@
+/** \addtogroup lib
+ * @{ */
+
+/**
+ * \defgroup trickle-timer Trickle timer library
+ * @{
+ *
+ * The trickle timer library implements the Trickle algorithm (RFC
+ * 6206). A trickle timer calls a transmit function once per interval,
+ * unless enough consistent messages have been heard from neighbors in
+ * that interval. The interval doubles up to a maximum as long as the
+ * network is consistent, and goes back to the minimum when an
+ * inconsistency is detected.
+ *
+ */
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Header file for the trickle timer library
+ */
+
+#ifndef __TRICKLE_TIMER_H__
+#define __TRICKLE_TIMER_H__
+
+#include "contiki-conf.h"
+#include "sys/ctimer.h"
+
+/**
+ * The longest interval, as a power of two milliseconds. Longer
+ * intervals overflow the 32-bit computation of their length in clock
+ * ticks, so i_min + i_doublings is limited to this.
+ */
+#define TRICKLE_TIMER_MAX_INTERVAL 21
+
+/**
+ * The redundancy constant that stands for an infinite one, as in
+ * RFC 6206: a timer with it never suppresses a transmission.
+ */
+#define TRICKLE_TIMER_INFINITE_REDUNDANCY 0
+
+/**
+ * \brief      Counters of a trickle timer
+ */
+struct trickle_timer_stats {
+  uint16_t intervals;   /**< Intervals started */
+  uint16_t transmitted; /**< Intervals in which a message was sent */
+  uint16_t suppressed;  /**< Intervals in which sending was suppressed */
+  uint16_t consistent;  /**< Consistent messages heard */
+  uint16_t resets;      /**< Resets to the minimum interval */
+  uint16_t doublings;   /**< Interval doublings */
+};
+
+/**
+ * \brief      Structure that holds the state of a trickle timer.
+ *
+ *             The interval lengths are expressed as in RPL: the
+ *             minimum interval is 2^i_min milliseconds and the
+ *             interval can be doubled i_doublings times.
+ */
+struct trickle_timer {
+  struct ctimer ct;
+  int (* transmit)(void *ptr);
+  void *ptr;
+  uint32_t next_delay;  /* Time from the transmission point to the end
+                           of the interval */
+  uint8_t i_min;
+  uint8_t i_doublings;
+  uint8_t k;
+  uint8_t i_current;
+  uint8_t c;
+  uint8_t in_first_half;
+  struct trickle_timer_stats stats;
+};
+
+/**
+ * \brief      Set up a trickle timer
+ * \param t    The trickle timer
+ * \param i_min The minimum interval, 2^i_min ms
+ * \param i_doublings The number of times the interval can be doubled
+ * \param k    The redundancy constant, or
+ *             TRICKLE_TIMER_INFINITE_REDUNDANCY
+ * \param transmit The function that sends a message
+ * \param ptr  An opaque pointer passed to the transmit function
+ *
+ *             The timer starts at its maximum interval but is not
+ *             running until trickle_timer_reset() is called.
+ *
+ *             The transmit function returns zero if it cannot send
+ *             yet, in which case it is called again a second later.
+ */
+void trickle_timer_init(struct trickle_timer *t, uint8_t i_min,
+                        uint8_t i_doublings, uint8_t k,
+                        int (* transmit)(void *ptr), void *ptr);
+
+/**
+ * \brief      Change the parameters of a trickle timer
+ *
+ *             The new parameters apply from the next interval on.
+ *             The statistics of the timer are kept. Like in
+ *             trickle_timer_init(), intervals beyond
+ *             TRICKLE_TIMER_MAX_INTERVAL are cut down to it.
+ */
+void trickle_timer_config(struct trickle_timer *t, uint8_t i_min,
+                          uint8_t i_doublings, uint8_t k);
+
+/**
+ * \brief      Restart a trickle timer at its minimum interval
+ *
+ *             Called when an inconsistency is detected. Does nothing
+ *             if the timer already runs at its minimum interval.
+ */
+void trickle_timer_reset(struct trickle_timer *t);
+
+/**
+ * \brief      Count a consistent message heard in this interval
+ */
+void trickle_timer_consistent(struct trickle_timer *t);
+
+/**
+ * \brief      Stop a trickle timer
+ */
+void trickle_timer_stop(struct trickle_timer *t);
+
+/**
+ * \brief      Reset the counters of a trickle timer
+ */
+void trickle_timer_reset_stats(struct trickle_timer *t);
+
+#endif /* __TRICKLE_TIMER_H__ */
+
+/** @} */
+/** @} */
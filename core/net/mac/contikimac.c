@@ -45,6 +45,7 @@
 #include "dev/watchdog.h"
 #include "lib/random.h"
 #include "net/mac/contikimac.h"
+#include "net/mac/macstats.h"
 #include "net/netstack.h"
 #include "net/rime.h"
 #include "sys/compower.h"
@@ -788,6 +789,10 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr, struct rdc_buf_
 
   off();
 
+  /* The strobe that got acked leaves the loop before it is counted */
+  MACSTATS_TRANSMISSION(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
+                        strobes + got_strobe_ack, RTIMER_NOW() - t0);
+
   PRINTF("contikimac: send (strobes=%u, len=%u, %s, %s), done\n", strobes,
          packetbuf_totlen(),
          got_strobe_ack ? "ack" : "no ack",
@@ -832,7 +837,7 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr, struct rdc_buf_
   if(!is_broadcast) {
     if(collisions == 0 && is_receiver_awake == 0) {
       phase_update(&phase_list, packetbuf_addr(PACKETBUF_ADDR_RECEIVER), encounter_time,
-                   ret);
+                   CYCLE_TIME, ret);
     }
   }
 #endif /* WITH_PHASE_OPTIMIZATION */
@@ -873,8 +878,15 @@ qsend_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
 
     /* Prepare the packetbuf */
     queuebuf_to_packetbuf(curr->buf);
-    if(next != NULL) {
-      packetbuf_set_attr(PACKETBUF_ATTR_PENDING, 1);
+    /* The MAC layer sets the pending bit on the packets that it wants
+       to send in the same burst as the next one. A broadcast can not
+       be acknowledged, so it always ends the burst. */
+    if(next == NULL ||
+       rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER), &rimeaddr_null)) {
+      packetbuf_set_attr(PACKETBUF_ATTR_PENDING, 0);
+    }
+    if(!packetbuf_attr(PACKETBUF_ATTR_PENDING)) {
+      next = NULL;
     }
 
     /* Send the current packet */
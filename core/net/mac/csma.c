@@ -39,6 +39,7 @@
  */
 
 #include "net/mac/csma.h"
+#include "net/mac/macstats.h"
 #include "net/packetbuf.h"
 #include "net/queuebuf.h"
 
@@ -77,20 +78,64 @@
 #error Change CSMA_CONF_MAX_MAC_TRANSMISSIONS in contiki-conf.h or in your Makefile.
 #endif /* CSMA_CONF_MAX_MAC_TRANSMISSIONS < 1 */
 
+#define CSMA_NUM_CLASSES PACKETBUF_NUM_TRAFFIC_CLASSES
+
+/* Queue slots that are kept for control and for IDS packets. Packets
+   of other classes cannot take them, so that routing and IDS traffic
+   still gets queued when the network is saturated with data. */
+#ifdef CSMA_CONF_RESERVED_CONTROL
+#define CSMA_RESERVED_CONTROL CSMA_CONF_RESERVED_CONTROL
+#else
+#define CSMA_RESERVED_CONTROL 1
+#endif /* CSMA_CONF_RESERVED_CONTROL */
+
+#ifdef CSMA_CONF_RESERVED_IDS
+#define CSMA_RESERVED_IDS CSMA_CONF_RESERVED_IDS
+#else
+#define CSMA_RESERVED_IDS 0
+#endif /* CSMA_CONF_RESERVED_IDS */
+
+/* The packets queued for a neighbor are sent in strict priority order
+   of their traffic class by default. CSMA_CONF_CLASS_WEIGHTS gives the
+   number of packets that each class, from bulk to control, may send in
+   a round before the less urgent classes get their turn, e.g.
+   { 1, 2, 4 }. */
+#ifdef CSMA_CONF_CLASS_WEIGHTS
+#define CSMA_CLASS_WEIGHTS CSMA_CONF_CLASS_WEIGHTS
+#endif /* CSMA_CONF_CLASS_WEIGHTS */
+
 /* Packet metadata */
 struct qbuf_metadata {
   mac_callback_t sent;
   void *cptr;
   uint8_t max_transmissions;
+  uint8_t traffic_class;
+#if MACSTATS_ENABLED
+  /* When the packet was queued and first transmitted */
+  clock_time_t queued;
+  clock_time_t first_tx;
+  uint8_t transmitted;
+#endif /* MACSTATS_ENABLED */
 };
 
 /* Every neighbor has its own packet queue */
 struct neighbor_queue {
   struct neighbor_queue *next;
+  struct neighbor_queue *hash_next;
   rimeaddr_t addr;
   struct ctimer transmit_timer;
+  /* Bytes that the neighbor may still send in the round robin */
+  uint16_t deficit;
+  /* The head packet waits for its turn in the round robin */
+  uint8_t ready;
+  /* Packets of the current attempt that the RDC has not reported yet */
+  uint8_t in_flight;
   uint8_t transmissions;
   uint8_t collisions, deferrals;
+#ifdef CSMA_CLASS_WEIGHTS
+  /* Packets that each class may still send in the current round */
+  uint8_t credits[CSMA_NUM_CLASSES];
+#endif /* CSMA_CLASS_WEIGHTS */
   LIST_STRUCT(queued_packet_list);
 };
 
@@ -101,28 +146,246 @@ struct neighbor_queue {
 #define CSMA_MAX_NEIGHBOR_QUEUES 2
 #endif /* CSMA_CONF_MAX_NEIGHBOR_QUEUES */
 
+/* Number of buckets in the hash that indexes the neighbor queues */
+#ifdef CSMA_CONF_NEIGHBOR_HASH_SIZE
+#define CSMA_NEIGHBOR_HASH_SIZE CSMA_CONF_NEIGHBOR_HASH_SIZE
+#else
+#define CSMA_NEIGHBOR_HASH_SIZE 4
+#endif /* CSMA_CONF_NEIGHBOR_HASH_SIZE */
+
+/* Bytes that a neighbor earns on each turn in the round robin between
+   the neighbors that have a packet ready to send */
+#ifdef CSMA_CONF_DRR_QUANTUM
+#define CSMA_DRR_QUANTUM CSMA_CONF_DRR_QUANTUM
+#else
+#define CSMA_DRR_QUANTUM 64
+#endif /* CSMA_CONF_DRR_QUANTUM */
+
+#if CSMA_DRR_QUANTUM < 1
+#error CSMA_CONF_DRR_QUANTUM must be at least 1.
+#error Change CSMA_CONF_DRR_QUANTUM in contiki-conf.h or in your Makefile.
+#endif /* CSMA_DRR_QUANTUM < 1 */
+
+/* Maximum number of packets sent back to back to a neighbor in one
+   rendezvous. All but the last packet of a burst have the frame
+   pending bit set, which keeps the receiver awake for the next one. */
+#ifdef CSMA_CONF_MAX_BURST
+#define CSMA_MAX_BURST CSMA_CONF_MAX_BURST
+#else
+#define CSMA_MAX_BURST 4
+#endif /* CSMA_CONF_MAX_BURST */
+
+/* Scale the retransmission backoff with how busy the channel has been
+   found, per neighbor and overall. Without it the backoff window only
+   grows with the number of transmissions. */
+#ifdef CSMA_CONF_ADAPTIVE_BACKOFF
+#define CSMA_ADAPTIVE_BACKOFF CSMA_CONF_ADAPTIVE_BACKOFF
+#else
+#define CSMA_ADAPTIVE_BACKOFF 1
+#endif /* CSMA_CONF_ADAPTIVE_BACKOFF */
+
+/* Number of neighbors whose busy estimate is kept. The estimates
+   outlive the queues, which are freed whenever they drain. */
+#ifdef CSMA_CONF_BUSY_TABLE_SIZE
+#define CSMA_BUSY_TABLE_SIZE CSMA_CONF_BUSY_TABLE_SIZE
+#else
+#define CSMA_BUSY_TABLE_SIZE 4
+#endif /* CSMA_CONF_BUSY_TABLE_SIZE */
+
+/* Largest backoff window, in units of the timebase */
+#ifdef CSMA_CONF_MAX_BACKOFF_WINDOW
+#define CSMA_MAX_BACKOFF_WINDOW CSMA_CONF_MAX_BACKOFF_WINDOW
+#else
+#define CSMA_MAX_BACKOFF_WINDOW 8
+#endif /* CSMA_CONF_MAX_BACKOFF_WINDOW */
+
+/* Time after which a transmission that the RDC has not reported back
+   is given up, so that a lost callback cannot stall the neighbor */
+#ifdef CSMA_CONF_SEND_TIMEOUT
+#define CSMA_SEND_TIMEOUT CSMA_CONF_SEND_TIMEOUT
+#else
+#define CSMA_SEND_TIMEOUT (2 * CLOCK_SECOND)
+#endif /* CSMA_CONF_SEND_TIMEOUT */
+
 #define MAX_QUEUED_PACKETS QUEUEBUF_NUM
+
+/* Maximum number of packets queued for one neighbor, so that a neighbor
+   that does not answer cannot take all the queue slots */
+#ifdef CSMA_CONF_MAX_PACKETS_PER_NEIGHBOR
+#define CSMA_MAX_PACKETS_PER_NEIGHBOR CSMA_CONF_MAX_PACKETS_PER_NEIGHBOR
+#else
+#define CSMA_MAX_PACKETS_PER_NEIGHBOR MAX_QUEUED_PACKETS
+#endif /* CSMA_CONF_MAX_PACKETS_PER_NEIGHBOR */
+
 MEMB(neighbor_memb, struct neighbor_queue, CSMA_MAX_NEIGHBOR_QUEUES);
 MEMB(packet_memb, struct rdc_buf_list, MAX_QUEUED_PACKETS);
 MEMB(metadata_memb, struct qbuf_metadata, MAX_QUEUED_PACKETS);
 LIST(neighbor_list);
 
+static struct neighbor_queue *neighbor_hash[CSMA_NEIGHBOR_HASH_SIZE];
+
+/* The neighbor where the round robin goes on */
+static struct neighbor_queue *rr_next;
+static struct ctimer schedule_timer;
+
+#if CSMA_RESERVED_CONTROL + CSMA_RESERVED_IDS >= MAX_QUEUED_PACKETS
+#error CSMA_CONF_RESERVED_CONTROL and CSMA_CONF_RESERVED_IDS leave no queue slot for bulk traffic
+#endif
+
+static const uint8_t reserved[CSMA_NUM_CLASSES] = {
+  0, CSMA_RESERVED_IDS, CSMA_RESERVED_CONTROL
+};
+#ifdef CSMA_CLASS_WEIGHTS
+static const uint8_t weights[CSMA_NUM_CLASSES] = CSMA_CLASS_WEIGHTS;
+#endif /* CSMA_CLASS_WEIGHTS */
+
+/* Number of queued packets of each traffic class */
+static uint8_t queued[CSMA_NUM_CLASSES];
+
+/* Share of attempts that found the channel busy, over all neighbors */
+static uint8_t channel_busy;
+
+/* Moving average of the share of attempts to a neighbor that found
+   the channel busy, from 0 to 255. Unused entries have a null
+   address, which is never the receiver of a queued packet. */
+struct busy_entry {
+  rimeaddr_t addr;
+  uint8_t busy;
+};
+static struct busy_entry busy_table[CSMA_BUSY_TABLE_SIZE];
+static uint8_t busy_next;
+
 static void packet_sent(void *ptr, int status, int num_transmissions);
-static void transmit_packet_list(void *ptr);
+static void neighbor_ready(void *ptr);
+static void schedule(void *ptr);
+static void send_timeout(void *ptr);
 
+/*---------------------------------------------------------------------------*/
+static unsigned
+neighbor_hash_index(const rimeaddr_t *addr)
+{
+  return (addr->u8[RIMEADDR_SIZE - 2] ^ addr->u8[RIMEADDR_SIZE - 1]) %
+    CSMA_NEIGHBOR_HASH_SIZE;
+}
 /*---------------------------------------------------------------------------*/
 static struct
 neighbor_queue *neighbor_queue_from_addr(const rimeaddr_t *addr) {
-  struct neighbor_queue *n = list_head(neighbor_list);
+  struct neighbor_queue *n = neighbor_hash[neighbor_hash_index(addr)];
   while(n != NULL) {
     if(rimeaddr_cmp(&n->addr, addr)) {
       return n;
     }
-    n = list_item_next(n);
+    n = n->hash_next;
   }
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
+/* Whether a neighbor queue is still in use. The RDC may report a
+   transmission after the queue has drained and been freed. */
+static int
+neighbor_is_queued(struct neighbor_queue *n)
+{
+  struct neighbor_queue *m;
+
+  for(m = list_head(neighbor_list); m != NULL; m = list_item_next(m)) {
+    if(m == n) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_neighbor(struct neighbor_queue *n)
+{
+  struct neighbor_queue **np;
+
+  for(np = &neighbor_hash[neighbor_hash_index(&n->addr)];
+      *np != NULL; np = &(*np)->hash_next) {
+    if(*np == n) {
+      *np = n->hash_next;
+      break;
+    }
+  }
+  if(rr_next == n) {
+    rr_next = list_item_next(n);
+  }
+  ctimer_stop(&n->transmit_timer);
+  list_remove(neighbor_list, n);
+  memb_free(&neighbor_memb, n);
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+packet_class(struct rdc_buf_list *q)
+{
+  return ((struct qbuf_metadata *)q->ptr)->traffic_class;
+}
+/*---------------------------------------------------------------------------*/
+/* Check whether a packet of a class may take a queue slot without
+   taking one that is reserved for another class. */
+static int
+class_has_room(uint8_t class)
+{
+  int free;
+  int c;
+
+  free = MAX_QUEUED_PACKETS;
+  for(c = 0; c < CSMA_NUM_CLASSES; c++) {
+    free -= queued[c];
+    if(c != class && queued[c] < reserved[c]) {
+      free -= reserved[c] - queued[c];
+    }
+  }
+  return free > 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Find the queued packet of the most urgent class that may send,
+   starting the search at packet q. */
+static struct rdc_buf_list *
+find_next_packet(struct neighbor_queue *n, struct rdc_buf_list *q)
+{
+  struct rdc_buf_list *best;
+
+  best = NULL;
+  for(; q != NULL; q = list_item_next(q)) {
+#ifdef CSMA_CLASS_WEIGHTS
+    if(n->credits[packet_class(q)] == 0) {
+      continue;
+    }
+#endif /* CSMA_CLASS_WEIGHTS */
+    if(best == NULL || packet_class(q) > packet_class(best)) {
+      best = q;
+    }
+  }
+  return best;
+}
+/*---------------------------------------------------------------------------*/
+/* Move the packet that is to be sent next to the head of the queue of
+   a neighbor. */
+static void
+select_next_packet(struct neighbor_queue *n)
+{
+  struct rdc_buf_list *q;
+
+  q = find_next_packet(n, list_head(n->queued_packet_list));
+#ifdef CSMA_CLASS_WEIGHTS
+  if(q == NULL) {
+    /* The classes with queued packets have used up their credits. */
+    memcpy(n->credits, weights, sizeof(n->credits));
+    q = find_next_packet(n, list_head(n->queued_packet_list));
+  }
+  if(q == NULL) {
+    return;
+  }
+  n->credits[packet_class(q)]--;
+#endif /* CSMA_CLASS_WEIGHTS */
+
+  if(q != list_head(n->queued_packet_list)) {
+    list_remove(n->queued_packet_list, q);
+    list_push(n->queued_packet_list, q);
+  }
+}
+/*---------------------------------------------------------------------------*/
 static clock_time_t
 default_timebase(void)
 {
@@ -140,45 +403,289 @@ default_timebase(void)
   return time;
 }
 /*---------------------------------------------------------------------------*/
+/* Share of the attempts for the head packet of a neighbor that met a
+   collision or were deferred, from 0 to 255 */
+static uint8_t
+busy_ratio(struct neighbor_queue *n)
+{
+  unsigned attempts;
+
+  attempts = n->transmissions + n->collisions + n->deferrals;
+  if(attempts == 0) {
+    return 0;
+  }
+  return (255 * (unsigned)(n->collisions + n->deferrals)) / attempts;
+}
+/*---------------------------------------------------------------------------*/
+static struct busy_entry *
+busy_lookup(const rimeaddr_t *addr)
+{
+  int i;
+
+  for(i = 0; i < CSMA_BUSY_TABLE_SIZE; i++) {
+    if(rimeaddr_cmp(&busy_table[i].addr, addr)) {
+      return &busy_table[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Busy estimate of a neighbor. A neighbor without one gets the
+   estimate of the channel. */
+static uint8_t
+neighbor_busy(const rimeaddr_t *addr)
+{
+  struct busy_entry *e = busy_lookup(addr);
+
+  return e != NULL ? e->busy : channel_busy;
+}
+/*---------------------------------------------------------------------------*/
+/* Fold the attempts of the head packet into the busy estimates */
+static void
+update_busy(struct neighbor_queue *n)
+{
+  struct busy_entry *e;
+  uint8_t ratio;
+
+  if(n->transmissions + n->collisions + n->deferrals == 0) {
+    return;
+  }
+  ratio = busy_ratio(n);
+
+  e = busy_lookup(&n->addr);
+  if(e == NULL) {
+    /* Take the entries over in turn */
+    e = &busy_table[busy_next];
+    busy_next = (busy_next + 1) % CSMA_BUSY_TABLE_SIZE;
+    rimeaddr_copy(&e->addr, &n->addr);
+    e->busy = channel_busy;
+  }
+  e->busy = (3 * (unsigned)e->busy + ratio) / 4;
+  channel_busy = (7 * (unsigned)channel_busy + ratio) / 8;
+}
+/*---------------------------------------------------------------------------*/
+/* The backoff window of the next retransmission to a neighbor, in
+   units of the timebase */
+static unsigned
+backoff_window(struct neighbor_queue *n)
+{
+  unsigned window;
+#if CSMA_ADAPTIVE_BACKOFF
+  unsigned linear;
+  unsigned busy;
+#endif /* CSMA_ADAPTIVE_BACKOFF */
+
+  /* The window grows linearly with each retransmit. It is clamped so
+     that we don't get a too long timeout here, since that will delay
+     all packets in the queue. */
+  window = n->transmissions + 1;
+  if(window > 3) {
+    window = 3;
+  }
+
+#if CSMA_ADAPTIVE_BACKOFF
+  /* The busier the channel, the wider the window, up to four times
+     as wide on a saturated one. It never gets narrower than the
+     linear window. The attempts of the current packet count as soon
+     as they are made. */
+  busy = ((unsigned)neighbor_busy(&n->addr) + channel_busy) / 2;
+  if(busy_ratio(n) > busy) {
+    busy = busy_ratio(n);
+  }
+  linear = window;
+  window += (window * 3 * busy) / 256;
+  if(window > CSMA_MAX_BACKOFF_WINDOW) {
+    window = CSMA_MAX_BACKOFF_WINDOW;
+  }
+  if(window < linear) {
+    window = linear;
+  }
+#endif /* CSMA_ADAPTIVE_BACKOFF */
+
+  return window;
+}
+/*---------------------------------------------------------------------------*/
+#if MACSTATS_ENABLED
+static void
+mark_first_tx(struct rdc_buf_list *q)
+{
+  struct qbuf_metadata *metadata = (struct qbuf_metadata *)q->ptr;
+
+  if(!metadata->transmitted) {
+    metadata->first_tx = clock_time();
+    metadata->transmitted = 1;
+  }
+}
+#endif /* MACSTATS_ENABLED */
+/*---------------------------------------------------------------------------*/
+/* Select the next packet of a neighbor and set a timer for its
+   transmission. */
+static void
+next_packet(struct neighbor_queue *n)
+{
+  select_next_packet(n);
+  n->transmissions = 0;
+  n->collisions = 0;
+  n->deferrals = 0;
+  ctimer_set(&n->transmit_timer, default_timebase(), neighbor_ready, n);
+}
+/*---------------------------------------------------------------------------*/
+/* Line up the packets that follow the head packet of a neighbor in
+   the order they are to be sent, and mark those that go out in the
+   same burst as the head packet. Returns the length of the burst. */
+static uint8_t
+prepare_burst(struct neighbor_queue *n)
+{
+  struct rdc_buf_list *prev, *q;
+  uint8_t len, i;
+
+  prev = list_head(n->queued_packet_list);
+  len = 1;
+  /* Bursts only save wake-ups when the RDC duty cycles the radio */
+  if(NETSTACK_RDC.channel_check_interval() != 0) {
+    while(len < CSMA_MAX_BURST &&
+          (q = find_next_packet(n, list_item_next(prev))) != NULL) {
+      if(q != list_item_next(prev)) {
+        list_remove(n->queued_packet_list, q);
+        list_insert(n->queued_packet_list, prev, q);
+      }
+#ifdef CSMA_CLASS_WEIGHTS
+      n->credits[packet_class(q)]--;
+#endif /* CSMA_CLASS_WEIGHTS */
+      prev = q;
+      len++;
+    }
+  }
+
+  for(q = list_head(n->queued_packet_list), i = 0; i < len;
+      q = list_item_next(q), i++) {
+    queuebuf_set_attr(q->buf, PACKETBUF_ATTR_PENDING, i + 1 < len);
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+transmit_packet_list(struct neighbor_queue *n)
+{
+  struct rdc_buf_list *q = list_head(n->queued_packet_list);
+  uint8_t len;
+  if(q != NULL) {
+    PRINTF("csma: preparing number %d %p, queue len %d\n", n->transmissions, q,
+        list_length(n->queued_packet_list));
+    len = prepare_burst(n);
+#if MACSTATS_ENABLED
+    mark_first_tx(q);
+#endif /* MACSTATS_ENABLED */
+    n->in_flight = len;
+    /* While the packets are in flight, the transmit timer watches for
+       a report that does not come */
+    ctimer_set(&n->transmit_timer, CSMA_SEND_TIMEOUT, send_timeout, n);
+    /* Send packets in the neighbor's list */
+    NETSTACK_RDC.send_list(packet_sent, n, q);
+    if(neighbor_is_queued(n) && n->in_flight > 0 && n->in_flight < len) {
+      /* The RDC sent only the start of the burst, the remaining
+         packets are sent one by one. */
+      n->in_flight = 0;
+      next_packet(n);
+      ctimer_set(&schedule_timer, 0, schedule, NULL);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The RDC did not report the transmission in time. Count it as a
+   deferral and retry the packet later. */
 static void
-transmit_packet_list(void *ptr)
+send_timeout(void *ptr)
 {
   struct neighbor_queue *n = ptr;
-  if(n) {
-    struct rdc_buf_list *q = list_head(n->queued_packet_list);
-    if(q != NULL) {
-      PRINTF("csma: preparing number %d %p, queue len %d\n", n->transmissions, q,
-          list_length(n->queued_packet_list));
-      /* Send packets in the neighbor's list */
-      NETSTACK_RDC.send_list(packet_sent, n, q);
+
+  PRINTF("csma: no report of the transmission, giving it up\n");
+  n->in_flight = 0;
+  n->deferrals++;
+  ctimer_set(&n->transmit_timer, default_timebase(), neighbor_ready, n);
+}
+/*---------------------------------------------------------------------------*/
+/* Pick the next neighbor to transmit to. The neighbors whose head
+   packet is ready take turns in a deficit round robin: on each turn a
+   neighbor earns CSMA_DRR_QUANTUM bytes, and it sends once it has
+   earned the length of its packet. Neighbors that need many attempts
+   or send long packets thus cannot hold up the others. Each neighbor
+   has one attempt in flight at most, while the attempts to different
+   neighbors may overlap when the RDC reports them later on. */
+static void
+schedule(void *ptr)
+{
+  struct neighbor_queue *n;
+  struct rdc_buf_list *q;
+  int len;
+  int ready;
+
+  ready = 0;
+  for(n = list_head(neighbor_list); n != NULL; n = list_item_next(n)) {
+    ready += n->ready;
+  }
+
+  while(ready > 0) {
+    n = rr_next != NULL ? rr_next : list_head(neighbor_list);
+    rr_next = list_item_next(n);
+    if(!n->ready) {
+      continue;
     }
+    q = list_head(n->queued_packet_list);
+    len = queuebuf_datalen(q->buf);
+    if(n->deficit < len) {
+      n->deficit += CSMA_DRR_QUANTUM;
+      if(n->deficit < len) {
+        continue;
+      }
+    }
+    n->deficit -= len;
+    n->ready = 0;
+    ready--;
+    transmit_packet_list(n);
   }
 }
 /*---------------------------------------------------------------------------*/
 static void
+neighbor_ready(void *ptr)
+{
+  struct neighbor_queue *n = ptr;
+
+  n->ready = 1;
+  schedule(NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
 free_first_packet(struct neighbor_queue *n)
 {
   struct rdc_buf_list *q = list_head(n->queued_packet_list);
   if(q != NULL) {
+    update_busy(n);
     /* Remove first packet from list and deallocate */
     queuebuf_free(q->buf);
     list_pop(n->queued_packet_list);
+    queued[packet_class(q)]--;
     memb_free(&metadata_memb, q->ptr);
     memb_free(&packet_memb, q);
     PRINTF("csma: free_queued_packet, queue length %d\n",
         list_length(n->queued_packet_list));
-    if(list_head(n->queued_packet_list)) {
-      /* There is a next packet. We reset current tx information */
+    if(n->in_flight > 0) {
+      /* The next packet of the burst follows right away */
       n->transmissions = 0;
       n->collisions = 0;
       n->deferrals = 0;
-      /* Set a timer for next transmissions */
-      ctimer_set(&n->transmit_timer, default_timebase(), transmit_packet_list, n);
+#if MACSTATS_ENABLED
+      if(list_head(n->queued_packet_list) != NULL) {
+        mark_first_tx(list_head(n->queued_packet_list));
+      }
+#endif /* MACSTATS_ENABLED */
+    } else if(list_head(n->queued_packet_list)) {
+      /* There is a next packet. We reset current tx information and
+         set a timer for next transmissions */
+      next_packet(n);
     } else {
       /* This was the last packet in the queue, we free the neighbor */
-      ctimer_stop(&n->transmit_timer);
-      list_remove(neighbor_list, n);
-      memb_free(&neighbor_memb, n);
+      remove_neighbor(n);
     }
   }
 }
@@ -187,13 +694,34 @@ static void
 packet_sent(void *ptr, int status, int num_transmissions)
 {
   struct neighbor_queue *n = ptr;
-  struct rdc_buf_list *q = list_head(n->queued_packet_list);
-  struct qbuf_metadata *metadata = (struct qbuf_metadata *)q->ptr;
+  struct rdc_buf_list *q;
+  struct qbuf_metadata *metadata;
   clock_time_t time = 0;
   mac_callback_t sent;
   void *cptr;
   int num_tx;
-  int backoff_transmissions;
+
+  if(!neighbor_is_queued(n) || n->in_flight == 0 ||
+     (q = list_head(n->queued_packet_list)) == NULL) {
+    /* A late report of an attempt that send_timeout() gave up on. The
+       packet is retried, so the report is not counted. */
+    PRINTF("csma: late report with status %d, ignored\n", status);
+    return;
+  }
+  metadata = (struct qbuf_metadata *)q->ptr;
+
+  if(status == MAC_TX_OK && n->in_flight > 1) {
+    /* The burst goes on with the next packet */
+    n->in_flight--;
+    ctimer_restart(&n->transmit_timer);
+  } else {
+    n->in_flight = 0;
+    ctimer_stop(&n->transmit_timer);
+    /* Let the other neighbors transmit once this packet is done with.
+       The callback may come from within send_list(), so it is not
+       called from here. */
+    ctimer_set(&schedule_timer, 0, schedule, NULL);
+  }
 
   switch(status) {
   case MAC_TX_OK:
@@ -233,30 +761,19 @@ packet_sent(void *ptr, int status, int num_transmissions)
        check interval of the underlying radio duty cycling layer. */
     time = default_timebase();
 
-    /* The retransmission time uses a linear backoff so that the
-       interval between the transmissions increase with each
-       retransmit. */
-    backoff_transmissions = n->transmissions + 1;
-
-    /* Clamp the number of backoffs so that we don't get a too long
-       timeout here, since that will delay all packets in the
-       queue. */
-    if(backoff_transmissions > 3) {
-      backoff_transmissions = 3;
-    }
-
-    time = time + (random_rand() % (backoff_transmissions * time));
+    time = time + (random_rand() % (backoff_window(n) * time));
 
     if(n->transmissions < metadata->max_transmissions) {
       PRINTF("csma: retransmitting with time %lu %p\n", time, q);
       ctimer_set(&n->transmit_timer, time,
-                 transmit_packet_list, n);
+                 neighbor_ready, n);
       /* This is needed to correctly attribute energy that we spent
          transmitting this packet. */
       queuebuf_update_attr_from_packetbuf(q->buf);
     } else {
       PRINTF("csma: drop with status %d after %d transmissions, %d collisions\n",
              status, n->transmissions, n->collisions);
+      MACSTATS_PACKET(&n->addr, metadata->queued, metadata->first_tx, status);
       free_first_packet(n);
       mac_call_sent_callback(sent, cptr, status, num_tx);
     }
@@ -266,6 +783,7 @@ packet_sent(void *ptr, int status, int num_transmissions)
     } else {
       PRINTF("csma: rexmit failed %d: %d\n", n->transmissions, status);
     }
+    MACSTATS_PACKET(&n->addr, metadata->queued, metadata->first_tx, status);
     free_first_packet(n);
     mac_call_sent_callback(sent, cptr, status, num_tx);
   }
@@ -277,6 +795,7 @@ send_packet(mac_callback_t sent, void *ptr)
   struct rdc_buf_list *q;
   struct neighbor_queue *n;
   static uint16_t seqno;
+  uint8_t class;
 
   packetbuf_set_attr(PACKETBUF_ATTR_MAC_SEQNO, seqno++);
   
@@ -297,16 +816,36 @@ send_packet(mac_callback_t sent, void *ptr)
         n->transmissions = 0;
         n->collisions = 0;
         n->deferrals = 0;
+        n->deficit = 0;
+        n->ready = 0;
+        n->in_flight = 0;
+#ifdef CSMA_CLASS_WEIGHTS
+        memcpy(n->credits, weights, sizeof(n->credits));
+#endif /* CSMA_CLASS_WEIGHTS */
         /* Init packet list for this neighbor */
         LIST_STRUCT_INIT(n, queued_packet_list);
-        /* Add neighbor to the list */
+        /* Add neighbor to the list and the hash */
         list_add(neighbor_list, n);
+        n->hash_next = neighbor_hash[neighbor_hash_index(addr)];
+        neighbor_hash[neighbor_hash_index(addr)] = n;
       }
     }
 
+    class = packetbuf_attr(PACKETBUF_ATTR_TRAFFIC_CLASS);
+    if(class >= CSMA_NUM_CLASSES) {
+      class = PACKETBUF_ATTR_TRAFFIC_CLASS_BULK;
+    }
+
     if(n != NULL) {
       /* Add packet to the neighbor's queue */
-      q = memb_alloc(&packet_memb);
+      q = NULL;
+      if(list_length(n->queued_packet_list) >= CSMA_MAX_PACKETS_PER_NEIGHBOR) {
+        PRINTF("csma: neighbor queue full\n");
+      } else if(class_has_room(class)) {
+        q = memb_alloc(&packet_memb);
+      } else {
+        PRINTF("csma: no queue slot left for class %u\n", class);
+      }
       if(q != NULL) {
         q->ptr = memb_alloc(&metadata_memb);
         if(q->ptr != NULL) {
@@ -323,9 +862,17 @@ send_packet(mac_callback_t sent, void *ptr)
             }
             metadata->sent = sent;
             metadata->cptr = ptr;
-
+            metadata->traffic_class = class;
+#if MACSTATS_ENABLED
+            metadata->queued = clock_time();
+            metadata->transmitted = 0;
+#endif /* MACSTATS_ENABLED */
+            queued[class]++;
+
+            /* The head of a neighbor with packets in flight is the
+               packet the RDC reports next, so it must not change */
             if(packetbuf_attr(PACKETBUF_ATTR_PACKET_TYPE) ==
-                PACKETBUF_ATTR_PACKET_TYPE_ACK) {
+                PACKETBUF_ATTR_PACKET_TYPE_ACK && n->in_flight == 0) {
               list_push(n->queued_packet_list, q);
             } else {
               list_add(n->queued_packet_list, q);
@@ -333,7 +880,7 @@ send_packet(mac_callback_t sent, void *ptr)
 
             /* If q is the first packet in the neighbor's queue, send asap */
             if(list_head(n->queued_packet_list) == q) {
-              ctimer_set(&n->transmit_timer, 0, transmit_packet_list, n);
+              ctimer_set(&n->transmit_timer, 0, neighbor_ready, n);
             }
             return;
           }
@@ -345,8 +892,7 @@ send_packet(mac_callback_t sent, void *ptr)
       }
       /* The packet allocation failed. Remove and free neighbor entry if empty. */
       if(list_length(n->queued_packet_list) == 0) {
-        list_remove(neighbor_list, n);
-        memb_free(&neighbor_memb, n);
+        remove_neighbor(n);
       }
       PRINTF("csma: could not allocate packet, dropping packet\n");
     } else {
@@ -359,6 +905,33 @@ send_packet(mac_callback_t sent, void *ptr)
   }
 }
 /*---------------------------------------------------------------------------*/
+uint8_t
+csma_channel_busy(void)
+{
+  return channel_busy;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+csma_neighbor_busy(const rimeaddr_t *addr)
+{
+  return neighbor_busy(addr);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+csma_backoff_window(const rimeaddr_t *addr)
+{
+  struct neighbor_queue *n = neighbor_queue_from_addr(addr);
+  struct neighbor_queue fresh;
+
+  if(n == NULL) {
+    /* The next packet starts without attempts */
+    memset(&fresh, 0, sizeof(fresh));
+    rimeaddr_copy(&fresh.addr, addr);
+    n = &fresh;
+  }
+  return backoff_window(n);
+}
+/*---------------------------------------------------------------------------*/
 static void
 input_packet(void)
 {
@@ -392,6 +965,11 @@ init(void)
   memb_init(&packet_memb);
   memb_init(&metadata_memb);
   memb_init(&neighbor_memb);
+  memset(neighbor_hash, 0, sizeof(neighbor_hash));
+  rr_next = NULL;
+  channel_busy = 0;
+  memset(busy_table, 0, sizeof(busy_table));
+  busy_next = 0;
 }
 /*---------------------------------------------------------------------------*/
 const struct mac_driver csma_driver = {
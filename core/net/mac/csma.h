@@ -44,9 +44,19 @@
 
 #include "net/mac/mac.h"
 #include "dev/radio.h"
+#include "net/rime/rimeaddr.h"
 
 extern const struct mac_driver csma_driver;
 
 const struct mac_driver *csma_init(const struct mac_driver *r);
 
+/* State of the adaptive backoff. The busy estimates go from 0, when
+   no attempt met a busy channel, to 255, when all of them did. A
+   neighbor without an estimate of its own gets that of the channel. */
+uint8_t csma_channel_busy(void);
+uint8_t csma_neighbor_busy(const rimeaddr_t *addr);
+/* Backoff window of the next retransmission, in units of the channel
+   check interval of the RDC */
+uint8_t csma_backoff_window(const rimeaddr_t *addr);
+
 #endif /* __CSMA_H__ */
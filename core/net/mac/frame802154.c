@@ -67,81 +67,98 @@
 #include <string.h>
 
 /**
- *  \brief Structure that contains the lengths of the various addressing and security fields
- *  in the 802.15.4 header.  This structure is used in \ref frame802154_create()
+ *  \brief Structure that gives the positions of the addressing fields
+ *  in the 802.15.4 header for one combination of addressing modes and
+ *  PAN ID compression.  The destination PAN ID, if any, is at offset 3.
  */
 typedef struct {
-  uint8_t dest_pid_len;    /**<  Length (in bytes) of destination PAN ID field */
-  uint8_t dest_addr_len;   /**<  Length (in bytes) of destination address field */
-  uint8_t src_pid_len;     /**<  Length (in bytes) of source PAN ID field */
-  uint8_t src_addr_len;    /**<  Length (in bytes) of source address field */
-  uint8_t aux_sec_len;     /**<  Length (in bytes) of aux security header field */
-} field_length_t;
+  uint8_t dest_addr;       /**<  Offset of destination address field */
+  uint8_t src_pid;         /**<  Offset of source PAN ID field */
+  uint8_t src_addr;        /**<  Offset of source address field */
+  uint8_t hdr_len;         /**<  Length (in bytes) of the header */
+} frame_layout_t;
 
-/*----------------------------------------------------------------------------*/
-CC_INLINE static uint8_t
-addr_len(uint8_t mode)
-{
-  switch(mode) {
-  case FRAME802154_SHORTADDRMODE:  /* 16-bit address */
-    return 2;
-  case FRAME802154_LONGADDRMODE:   /* 64-bit address */
-    return 8;
-  default:
-    return 0;
-  }
-}
-/*----------------------------------------------------------------------------*/
-static void
-field_len(frame802154_t *p, field_length_t *flen)
-{
-  /* init flen to zeros */
-  memset(flen, 0, sizeof(field_length_t));
+#define ADDR_LEN(mode) ((mode) == FRAME802154_SHORTADDRMODE ? 2 : \
+                        (mode) == FRAME802154_LONGADDRMODE ? 8 : 0)
+#define DEST_PID_LEN(dest) ((dest) ? 2 : 0)
+#define SRC_PID_LEN(src, comp) ((src) && !(comp) ? 2 : 0)
 
-  /* Determine lengths of each field based on fcf and other args */
-  if(p->fcf.dest_addr_mode & 3) {
-    flen->dest_pid_len = 2;
-  }
-  if(p->fcf.src_addr_mode & 3) {
-    flen->src_pid_len = 2;
-  }
+#define LAYOUT(dest, src, comp)                                         \
+  { 3 + DEST_PID_LEN(dest),                                             \
+    3 + DEST_PID_LEN(dest) + ADDR_LEN(dest),                            \
+    3 + DEST_PID_LEN(dest) + ADDR_LEN(dest) + SRC_PID_LEN(src, comp),   \
+    3 + DEST_PID_LEN(dest) + ADDR_LEN(dest) + SRC_PID_LEN(src, comp) +  \
+    ADDR_LEN(src) }
+#define LAYOUTS_DEST(src, comp) LAYOUT(0, src, comp), LAYOUT(1, src, comp), \
+                                LAYOUT(2, src, comp), LAYOUT(3, src, comp)
+#define LAYOUTS(comp) LAYOUTS_DEST(0, comp), LAYOUTS_DEST(1, comp), \
+                      LAYOUTS_DEST(2, comp), LAYOUTS_DEST(3, comp)
 
-  /* Set PAN ID compression bit if src pan id matches dest pan id. */
+/**
+ *  \brief The header layouts, indexed by LAYOUT_INDEX().
+ */
+static const frame_layout_t layouts[32] = { LAYOUTS(0), LAYOUTS(1) };
+
+#define LAYOUT_INDEX(dest, src, comp) ((dest) | ((src) << 2) | ((comp) << 4))
+
+/*----------------------------------------------------------------------------*/
+/* Determine the header layout of a frame to create. Sets the PAN ID
+   compression bit if the source PAN ID matches the destination PAN ID. */
+static const frame_layout_t *
+create_layout(frame802154_t *p)
+{
   if(p->fcf.dest_addr_mode & 3 && p->fcf.src_addr_mode & 3 &&
      p->src_pid == p->dest_pid) {
     p->fcf.panid_compression = 1;
-
-    /* compressed header, only do dest pid */
-    flen->src_pid_len = 0;
   } else {
     p->fcf.panid_compression = 0;
   }
 
-  /* determine address lengths */
-  flen->dest_addr_len = addr_len(p->fcf.dest_addr_mode & 3);
-  flen->src_addr_len = addr_len(p->fcf.src_addr_mode & 3);
+  /* TODO Aux security header not yet implemented */
 
-  /* Aux security header */
-  if(p->fcf.security_enabled & 1) {
-    /* TODO Aux security header not yet implemented */
-#if 0
-    switch(p->aux_hdr.security_control.key_id_mode) {
-    case 0:
-      flen->aux_sec_len = 5; /* minimum value */
-      break;
-    case 1:
-      flen->aux_sec_len = 6;
-      break;
-    case 2:
-      flen->aux_sec_len = 10;
-      break;
-    case 3:
-      flen->aux_sec_len = 14;
-      break;
-    default:
-      break;
+  return &layouts[LAYOUT_INDEX(p->fcf.dest_addr_mode & 3,
+                               p->fcf.src_addr_mode & 3,
+                               p->fcf.panid_compression)];
+}
+/*----------------------------------------------------------------------------*/
+/* Write an address in the reverse byte order of the header */
+CC_INLINE static void
+put_addr(uint8_t *to, const uint8_t *addr, uint8_t mode)
+{
+  if(mode == FRAME802154_SHORTADDRMODE) {
+    to[0] = addr[1];
+    to[1] = addr[0];
+  } else if(mode == FRAME802154_LONGADDRMODE) {
+    to[0] = addr[7];
+    to[1] = addr[6];
+    to[2] = addr[5];
+    to[3] = addr[4];
+    to[4] = addr[3];
+    to[5] = addr[2];
+    to[6] = addr[1];
+    to[7] = addr[0];
+  }
+}
+/*----------------------------------------------------------------------------*/
+/* Read an address from the reverse byte order of the header */
+CC_INLINE static void
+get_addr(uint8_t *addr, const uint8_t *from, uint8_t mode)
+{
+  if(mode == FRAME802154_LONGADDRMODE) {
+    addr[0] = from[7];
+    addr[1] = from[6];
+    addr[2] = from[5];
+    addr[3] = from[4];
+    addr[4] = from[3];
+    addr[5] = from[2];
+    addr[6] = from[1];
+    addr[7] = from[0];
+  } else {
+    rimeaddr_copy((rimeaddr_t *)addr, &rimeaddr_null);
+    if(mode == FRAME802154_SHORTADDRMODE) {
+      addr[0] = from[1];
+      addr[1] = from[0];
     }
-#endif
   }
 }
 /*----------------------------------------------------------------------------*/
@@ -157,10 +174,7 @@ field_len(frame802154_t *p, field_length_t *flen)
 uint8_t
 frame802154_hdrlen(frame802154_t *p)
 {
-  field_length_t flen;
-  field_len(p, &flen);
-  return 3 + flen.dest_pid_len + flen.dest_addr_len +
-    flen.src_pid_len + flen.src_addr_len + flen.aux_sec_len;
+  return create_layout(p)->hdr_len;
 }
 /*----------------------------------------------------------------------------*/
 /**
@@ -180,64 +194,46 @@ frame802154_hdrlen(frame802154_t *p)
 uint8_t
 frame802154_create(frame802154_t *p, uint8_t *buf, uint8_t buf_len)
 {
-  int c;
-  field_length_t flen;
-  uint8_t *tx_frame_buffer;
-  uint8_t pos;
+  const frame_layout_t *l;
 
-  field_len(p, &flen);
+  l = create_layout(p);
 
-  if(3 + flen.dest_pid_len + flen.dest_addr_len +
-     flen.src_pid_len + flen.src_addr_len + flen.aux_sec_len > buf_len) {
+  if(l->hdr_len > buf_len) {
     /* Too little space for headers. */
     return 0;
   }
 
-  /* OK, now we have field lengths.  Time to actually construct */
-  /* the outgoing frame, and store it in tx_frame_buffer */
-  tx_frame_buffer = buf;
-  tx_frame_buffer[0] = (p->fcf.frame_type & 7) |
+  buf[0] = (p->fcf.frame_type & 7) |
     ((p->fcf.security_enabled & 1) << 3) |
     ((p->fcf.frame_pending & 1) << 4) |
     ((p->fcf.ack_required & 1) << 5) |
     ((p->fcf.panid_compression & 1) << 6);
-  tx_frame_buffer[1] = ((p->fcf.dest_addr_mode & 3) << 2) |
+  buf[1] = ((p->fcf.dest_addr_mode & 3) << 2) |
     ((p->fcf.frame_version & 3) << 4) |
     ((p->fcf.src_addr_mode & 3) << 6);
 
   /* sequence number */
-  tx_frame_buffer[2] = p->seq;
-  pos = 3;
-
-  /* Destination PAN ID */
-  if(flen.dest_pid_len == 2) {
-    tx_frame_buffer[pos++] = p->dest_pid & 0xff;
-    tx_frame_buffer[pos++] = (p->dest_pid >> 8) & 0xff;
-  }
+  buf[2] = p->seq;
 
-  /* Destination address */
-  for(c = flen.dest_addr_len; c > 0; c--) {
-    tx_frame_buffer[pos++] = p->dest_addr[c - 1];
+  /* Destination PAN ID and address */
+  if(p->fcf.dest_addr_mode & 3) {
+    buf[3] = p->dest_pid & 0xff;
+    buf[4] = (p->dest_pid >> 8) & 0xff;
+    put_addr(&buf[l->dest_addr], p->dest_addr, p->fcf.dest_addr_mode & 3);
   }
 
   /* Source PAN ID */
-  if(flen.src_pid_len == 2) {
-    tx_frame_buffer[pos++] = p->src_pid & 0xff;
-    tx_frame_buffer[pos++] = (p->src_pid >> 8) & 0xff;
+  if(l->src_addr != l->src_pid) {
+    buf[l->src_pid] = p->src_pid & 0xff;
+    buf[l->src_pid + 1] = (p->src_pid >> 8) & 0xff;
   }
 
   /* Source address */
-  for(c = flen.src_addr_len; c > 0; c--) {
-    tx_frame_buffer[pos++] = p->src_addr[c - 1];
-  }
+  put_addr(&buf[l->src_addr], p->src_addr, p->fcf.src_addr_mode & 3);
 
-  /* Aux header */
-  if(flen.aux_sec_len) {
-    /* TODO Aux security header not yet implemented */
-/*     pos += flen.aux_sec_len; */
-  }
+  /* TODO Aux security header not yet implemented */
 
-  return pos;
+  return l->hdr_len;
 }
 /*----------------------------------------------------------------------------*/
 /**
@@ -252,105 +248,62 @@ frame802154_create(frame802154_t *p, uint8_t *buf, uint8_t buf_len)
 uint8_t
 frame802154_parse(uint8_t *data, uint8_t len, frame802154_t *pf)
 {
-  uint8_t *p;
+  const frame_layout_t *l;
   frame802154_fcf_t fcf;
-  uint8_t c;
 
   if(len < 3) {
     return 0;
   }
 
-  p = data;
-
   /* decode the FCF */
-  fcf.frame_type = p[0] & 7;
-  fcf.security_enabled = (p[0] >> 3) & 1;
-  fcf.frame_pending = (p[0] >> 4) & 1;
-  fcf.ack_required = (p[0] >> 5) & 1;
-  fcf.panid_compression = (p[0] >> 6) & 1;
+  fcf.frame_type = data[0] & 7;
+  fcf.security_enabled = (data[0] >> 3) & 1;
+  fcf.frame_pending = (data[0] >> 4) & 1;
+  fcf.ack_required = (data[0] >> 5) & 1;
+  fcf.panid_compression = (data[0] >> 6) & 1;
 
-  fcf.dest_addr_mode = (p[1] >> 2) & 3;
-  fcf.frame_version = (p[1] >> 4) & 3;
-  fcf.src_addr_mode = (p[1] >> 6) & 3;
+  fcf.dest_addr_mode = (data[1] >> 2) & 3;
+  fcf.frame_version = (data[1] >> 4) & 3;
+  fcf.src_addr_mode = (data[1] >> 6) & 3;
+
+  l = &layouts[LAYOUT_INDEX(fcf.dest_addr_mode, fcf.src_addr_mode,
+                            fcf.panid_compression)];
+  if(l->hdr_len > len) {
+    return 0;
+  }
 
   /* copy fcf and seqNum */
   memcpy(&pf->fcf, &fcf, sizeof(frame802154_fcf_t));
-  pf->seq = p[2];
-  p += 3;                             /* Skip first three bytes */
+  pf->seq = data[2];
 
-  /* Destination address, if any */
+  /* Destination PAN and address, if any */
   if(fcf.dest_addr_mode) {
-    /* Destination PAN */
-    pf->dest_pid = p[0] + (p[1] << 8);
-    p += 2;
-
-    /* Destination address */
-/*     l = addr_len(fcf.dest_addr_mode); */
-/*     for(c = 0; c < l; c++) { */
-/*       pf->dest_addr.u8[c] = p[l - c - 1]; */
-/*     } */
-/*     p += l; */
-    if(fcf.dest_addr_mode == FRAME802154_SHORTADDRMODE) {
-      rimeaddr_copy((rimeaddr_t *)&(pf->dest_addr), &rimeaddr_null);
-      pf->dest_addr[0] = p[1];
-      pf->dest_addr[1] = p[0];
-      p += 2;
-    } else if(fcf.dest_addr_mode == FRAME802154_LONGADDRMODE) {
-      for(c = 0; c < 8; c++) {
-        pf->dest_addr[c] = p[7 - c];
-      }
-      p += 8;
-    }
+    pf->dest_pid = data[3] + (data[4] << 8);
   } else {
-    rimeaddr_copy((rimeaddr_t *)&(pf->dest_addr), &rimeaddr_null);
     pf->dest_pid = 0;
   }
+  get_addr(pf->dest_addr, &data[l->dest_addr], fcf.dest_addr_mode);
 
-  /* Source address, if any */
-  if(fcf.src_addr_mode) {
-    /* Source PAN */
-    if(!fcf.panid_compression) {
-      pf->src_pid = p[0] + (p[1] << 8);
-      p += 2;
-    } else {
-      pf->src_pid = pf->dest_pid;
-    }
-
-    /* Source address */
-/*     l = addr_len(fcf.src_addr_mode); */
-/*     for(c = 0; c < l; c++) { */
-/*       pf->src_addr.u8[c] = p[l - c - 1]; */
-/*     } */
-/*     p += l; */
-    if(fcf.src_addr_mode == FRAME802154_SHORTADDRMODE) {
-      rimeaddr_copy((rimeaddr_t *)&(pf->src_addr), &rimeaddr_null);
-      pf->src_addr[0] = p[1];
-      pf->src_addr[1] = p[0];
-      p += 2;
-    } else if(fcf.src_addr_mode == FRAME802154_LONGADDRMODE) {
-      for(c = 0; c < 8; c++) {
-        pf->src_addr[c] = p[7 - c];
-      }
-      p += 8;
-    }
-  } else {
-    rimeaddr_copy((rimeaddr_t *)&(pf->src_addr), &rimeaddr_null);
+  /* Source PAN and address, if any */
+  if(!fcf.src_addr_mode) {
     pf->src_pid = 0;
+  } else if(fcf.panid_compression) {
+    pf->src_pid = pf->dest_pid;
+  } else {
+    pf->src_pid = data[l->src_pid] + (data[l->src_pid + 1] << 8);
   }
+  get_addr(pf->src_addr, &data[l->src_addr], fcf.src_addr_mode);
 
   if(fcf.security_enabled) {
     /* TODO aux security header, not yet implemented */
-/*     return 0; */
   }
 
-  /* header length */
-  c = p - data;
   /* payload length */
-  pf->payload_len = len - c;
+  pf->payload_len = len - l->hdr_len;
   /* payload */
-  pf->payload = p;
+  pf->payload = data + l->hdr_len;
 
-  /* return header length if successful */
-  return c > len ? 0 : c;
+  /* return header length */
+  return l->hdr_len;
 }
 /** \}   */
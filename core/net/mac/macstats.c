@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Timing statistics of the MAC layer, per neighbor
+ */
+
+#include "net/mac/macstats.h"
+#include "net/mac/mac.h"
+#include "lib/list.h"
+#include "lib/memb.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define LINE_LEN 128
+
+MEMB(neighbor_memb, struct macstats_neighbor, MACSTATS_NEIGHBORS);
+LIST(neighbor_list);
+
+/*---------------------------------------------------------------------------*/
+static void
+hist_add(struct macstats_hist *h, unsigned long value)
+{
+  uint8_t b;
+
+  for(b = 0; value > 0 && b < MACSTATS_BUCKETS - 1; b++) {
+    value >>= 1;
+  }
+  if(h->count[b] < 0xffff) {
+    h->count[b]++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The entry of a neighbor, moved to the front of the list. The entry
+   at the back is reused when all of them are taken. */
+static struct macstats_neighbor *
+lookup(const rimeaddr_t *addr)
+{
+  struct macstats_neighbor *n;
+
+  for(n = list_head(neighbor_list); n != NULL; n = list_item_next(n)) {
+    if(rimeaddr_cmp(&n->addr, addr)) {
+      list_remove(neighbor_list, n);
+      list_push(neighbor_list, n);
+      return n;
+    }
+  }
+
+  n = memb_alloc(&neighbor_memb);
+  if(n == NULL) {
+    n = list_chop(neighbor_list);
+    if(n == NULL) {
+      return NULL;
+    }
+  }
+  memset(n, 0, sizeof(struct macstats_neighbor));
+  rimeaddr_copy(&n->addr, addr);
+  list_push(neighbor_list, n);
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+void
+macstats_packet(const rimeaddr_t *addr, clock_time_t queued,
+                clock_time_t first_tx, int status)
+{
+  struct macstats_neighbor *n = lookup(addr);
+
+  if(n != NULL) {
+    hist_add(&n->queue, first_tx - queued);
+    if(status == MAC_TX_OK) {
+      hist_add(&n->ack, clock_time() - first_tx);
+      n->acked++;
+    } else {
+      n->dropped++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+macstats_transmission(const rimeaddr_t *addr, unsigned strobes,
+                      rtimer_clock_t airtime)
+{
+  struct macstats_neighbor *n = lookup(addr);
+
+  if(n != NULL) {
+    hist_add(&n->strobes, strobes);
+    n->airtime += airtime;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+macstats_reassembly(const rimeaddr_t *addr, clock_time_t duration)
+{
+  struct macstats_neighbor *n = lookup(addr);
+
+  if(n != NULL) {
+    hist_add(&n->reassembly, duration);
+  }
+}
+/*---------------------------------------------------------------------------*/
+struct macstats_neighbor *
+macstats_list(void)
+{
+  return list_head(neighbor_list);
+}
+/*---------------------------------------------------------------------------*/
+void
+macstats_reset(void)
+{
+  struct macstats_neighbor *n;
+
+  while((n = list_pop(neighbor_list)) != NULL) {
+    memb_free(&neighbor_memb, n);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+print_addr(char *buf, int len, const rimeaddr_t *addr)
+{
+  int i, pos;
+
+  pos = 0;
+  for(i = 0; i < RIMEADDR_SIZE && pos < len; i++) {
+    pos += snprintf(&buf[pos], len - pos, i == 0 ? "%u" : ".%u",
+                    addr->u8[i]);
+  }
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_hist(void (*output)(const char *line), const rimeaddr_t *addr,
+           const char *name, const struct macstats_hist *h)
+{
+  char line[LINE_LEN];
+  int i, pos;
+
+  pos = print_addr(line, sizeof(line), addr);
+  pos += snprintf(&line[pos], sizeof(line) - pos, " %s", name);
+  for(i = 0; i < MACSTATS_BUCKETS && pos < sizeof(line); i++) {
+    pos += snprintf(&line[pos], sizeof(line) - pos, " %u", h->count[i]);
+  }
+  output(line);
+}
+/*---------------------------------------------------------------------------*/
+void
+macstats_print(void (*output)(const char *line))
+{
+  struct macstats_neighbor *n;
+  char line[LINE_LEN];
+  int pos;
+
+  snprintf(line, sizeof(line),
+           "macstats: %lu clock ticks/s, %lu rtimer ticks/s, %u buckets",
+           (unsigned long)CLOCK_SECOND, (unsigned long)RTIMER_SECOND,
+           MACSTATS_BUCKETS);
+  output(line);
+
+  for(n = list_head(neighbor_list); n != NULL; n = list_item_next(n)) {
+    pos = print_addr(line, sizeof(line), &n->addr);
+    snprintf(&line[pos], sizeof(line) - pos, " acked %u dropped %u airtime %lu",
+             n->acked, n->dropped, n->airtime);
+    output(line);
+    print_hist(output, &n->addr, "queue", &n->queue);
+    print_hist(output, &n->addr, "ack", &n->ack);
+    print_hist(output, &n->addr, "strobes", &n->strobes);
+    print_hist(output, &n->addr, "reassembly", &n->reassembly);
+  }
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Timing statistics of the MAC layer, per neighbor
+ */
+
+#ifndef __MACSTATS_H__
+#define __MACSTATS_H__
+
+#include "contiki-conf.h"
+#include "net/rime/rimeaddr.h"
+#include "sys/clock.h"
+#include "sys/rtimer.h"
+
+#ifdef MACSTATS_CONF_ENABLED
+#define MACSTATS_ENABLED MACSTATS_CONF_ENABLED
+#else
+#define MACSTATS_ENABLED 0
+#endif /* MACSTATS_CONF_ENABLED */
+
+/* Number of neighbors that statistics are kept for. When the table is
+   full, the neighbor that was heard of the longest ago is replaced. */
+#ifdef MACSTATS_CONF_NEIGHBORS
+#define MACSTATS_NEIGHBORS MACSTATS_CONF_NEIGHBORS
+#else
+#define MACSTATS_NEIGHBORS 4
+#endif /* MACSTATS_CONF_NEIGHBORS */
+
+/* Bucket 0 of a histogram counts the value 0, bucket i the values from
+   2^(i-1) up to 2^i - 1, and the last bucket everything above. */
+#define MACSTATS_BUCKETS 12
+
+struct macstats_hist {
+  uint16_t count[MACSTATS_BUCKETS];
+};
+
+struct macstats_neighbor {
+  struct macstats_neighbor *next;
+  /* The null address collects broadcasts */
+  rimeaddr_t addr;
+  /* Clock ticks from the time a packet is queued to its first
+     transmission */
+  struct macstats_hist queue;
+  /* Clock ticks from the first transmission of a packet to its ack */
+  struct macstats_hist ack;
+  /* Strobes sent for each transmission */
+  struct macstats_hist strobes;
+  /* Clock ticks from the first fragment of a datagram from the
+     neighbor to the last */
+  struct macstats_hist reassembly;
+  /* Rtimer ticks spent transmitting to the neighbor */
+  unsigned long airtime;
+  uint16_t acked, dropped;
+};
+
+#if MACSTATS_ENABLED
+#define MACSTATS_PACKET(addr, queued, first_tx, status)         \
+  macstats_packet(addr, queued, first_tx, status)
+#define MACSTATS_TRANSMISSION(addr, strobes, airtime)           \
+  macstats_transmission(addr, strobes, airtime)
+#define MACSTATS_REASSEMBLY(addr, duration)                     \
+  macstats_reassembly(addr, duration)
+#else /* MACSTATS_ENABLED */
+#define MACSTATS_PACKET(addr, queued, first_tx, status)
+#define MACSTATS_TRANSMISSION(addr, strobes, airtime)
+#define MACSTATS_REASSEMBLY(addr, duration)
+#endif /* MACSTATS_ENABLED */
+
+/**
+ * Record a packet that is done with, acked or dropped. The times are
+ * the clock times it was queued and first transmitted at, and status
+ * is the MAC_TX_ status it ended with.
+ */
+void macstats_packet(const rimeaddr_t *addr, clock_time_t queued,
+                     clock_time_t first_tx, int status);
+void macstats_transmission(const rimeaddr_t *addr, unsigned strobes,
+                           rtimer_clock_t airtime);
+void macstats_reassembly(const rimeaddr_t *addr, clock_time_t duration);
+
+/* The neighbors that statistics are kept for, most recent first */
+struct macstats_neighbor *macstats_list(void);
+void macstats_reset(void);
+
+/**
+ * Print the statistics of all neighbors, one line at a time, through
+ * the given output function.
+ */
+void macstats_print(void (*output)(const char *line));
+
+#endif /* __MACSTATS_H__ */
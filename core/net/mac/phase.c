@@ -46,6 +46,8 @@
 #include "dev/watchdog.h"
 #include "dev/leds.h"
 
+#include <string.h>
+
 struct phase_queueitem {
   struct ctimer timer;
   mac_callback_t mac_callback;
@@ -61,6 +63,21 @@ struct phase_queueitem {
 
 #define MAX_NOACKS_TIME       CLOCK_SECOND * 30
 
+/* Seconds after which a phase that has not been seen again is
+   forgotten, as the clocks of the neighbors have drifted too far apart
+   for the phase to still be useful. */
+#ifdef PHASE_CONF_MAX_AGE
+#define PHASE_MAX_AGE         PHASE_CONF_MAX_AGE
+#else
+#define PHASE_MAX_AGE         (30 * 60)
+#endif
+
+/* The drift is estimated in rtimer ticks per PHASE_DRIFT_PERIOD
+   seconds, from phases that are at least PHASE_DRIFT_MIN_INTERVAL
+   seconds apart. */
+#define PHASE_DRIFT_PERIOD       256
+#define PHASE_DRIFT_MIN_INTERVAL 30
+
 MEMB(queued_packets_memb, struct phase_queueitem, PHASE_QUEUESIZE);
 
 #define DEBUG 0
@@ -73,11 +90,18 @@ MEMB(queued_packets_memb, struct phase_queueitem, PHASE_QUEUESIZE);
 #define PRINTDEBUG(...)
 #endif
 /*---------------------------------------------------------------------------*/
+static unsigned
+hash_index(const rimeaddr_t *addr)
+{
+  return (addr->u8[RIMEADDR_SIZE - 2] ^ addr->u8[RIMEADDR_SIZE - 1]) %
+    PHASE_HASH_SIZE;
+}
+/*---------------------------------------------------------------------------*/
 struct phase *
 find_neighbor(const struct phase_list *list, const rimeaddr_t *addr)
 {
   struct phase *e;
-  for(e = list_head(*list->list); e != NULL; e = list_item_next(e)) {
+  for(e = list->hash[hash_index(addr)]; e != NULL; e = e->hash_next) {
     if(rimeaddr_cmp(addr, &e->neighbor)) {
       return e;
     }
@@ -85,32 +109,98 @@ find_neighbor(const struct phase_list *list, const rimeaddr_t *addr)
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
+static void
+remove_phase(const struct phase_list *list, struct phase *e)
+{
+  struct phase **p;
+
+  for(p = &list->hash[hash_index(&e->neighbor)]; *p != NULL;
+      p = &(*p)->hash_next) {
+    if(*p == e) {
+      *p = e->hash_next;
+      break;
+    }
+  }
+  list_remove(*list->list, e);
+  memb_free(list->memb, e);
+}
+/*---------------------------------------------------------------------------*/
+#if PHASE_DRIFT_CORRECT
+/* The rtimer ticks that the phase of a neighbor is expected to have
+   moved since it was last seen. */
+static int32_t
+drift_since_update(const struct phase *e, unsigned long now)
+{
+  return (int32_t)e->drift * (int32_t)(now - e->updated) / PHASE_DRIFT_PERIOD;
+}
+/*---------------------------------------------------------------------------*/
+/* Refine the drift estimate of a neighbor from the difference between
+   the phase it was seen at and the phase that was expected. */
+static void
+update_drift(struct phase *e, rtimer_clock_t time, rtimer_clock_t cycle_time,
+             unsigned long now)
+{
+  unsigned long elapsed;
+  int32_t error, drift;
+
+  elapsed = now - e->updated;
+  if(elapsed < PHASE_DRIFT_MIN_INTERVAL || elapsed > PHASE_MAX_AGE) {
+    /* Too short an interval to tell drift from jitter, or too long
+       to tell how many cycles the phase moved */
+    return;
+  }
+
+  error = (rtimer_clock_t)(time - e->time - drift_since_update(e, now)) %
+    cycle_time;
+  if(error > (int32_t)cycle_time / 2) {
+    error -= (int32_t)cycle_time;
+  }
+  drift = e->drift + error * PHASE_DRIFT_PERIOD / (int32_t)elapsed;
+  if(e->drift != 0) {
+    /* Smooth out the jitter of single wake-ups */
+    drift = (3 * (int32_t)e->drift + drift) / 4;
+  }
+  if(drift > 32767) {
+    drift = 32767;
+  } else if(drift < -32767) {
+    drift = -32767;
+  }
+  e->drift = drift;
+}
+#endif /* PHASE_DRIFT_CORRECT */
+/*---------------------------------------------------------------------------*/
 void
 phase_remove(const struct phase_list *list, const rimeaddr_t *neighbor)
 {
   struct phase *e;
   e = find_neighbor(list, neighbor);
   if(e != NULL) {
-    list_remove(*list->list, e);
-    memb_free(list->memb, e);
+    remove_phase(list, e);
   }
 }
 /*---------------------------------------------------------------------------*/
 void
 phase_update(const struct phase_list *list,
              const rimeaddr_t *neighbor, rtimer_clock_t time,
-             int mac_status)
+             rtimer_clock_t cycle_time, int mac_status)
 {
   struct phase *e;
+  unsigned long now;
+
+  now = clock_seconds();
 
   /* If we have an entry for this neighbor already, we renew it. */
   e = find_neighbor(list, neighbor);
   if(e != NULL) {
     if(mac_status == MAC_TX_OK) {
 #if PHASE_DRIFT_CORRECT
-      e->drift = time-e->time;
+      update_drift(e, time, cycle_time, now);
 #endif
       e->time = time;
+      e->updated = now;
+      /* Keep the most recently seen neighbors first on the list */
+      list_remove(*list->list, e);
+      list_push(*list->list, e);
     }
     /* If the neighbor didn't reply to us, it may have switched
        phase (rebooted). We try a number of transmissions to it
@@ -123,8 +213,7 @@ phase_update(const struct phase_list *list,
       }
       if(e->noacks >= MAX_NOACKS || timer_expired(&e->noacks_timer)) {
         PRINTF("drop %d\n", neighbor->u8[0]);
-        list_remove(*list->list, e);
-        memb_free(list->memb, e);
+        remove_phase(list, e);
         return;
       }
     } else if(mac_status == MAC_TX_OK) {
@@ -137,16 +226,20 @@ phase_update(const struct phase_list *list,
       if(e == NULL) {
         PRINTF("phase alloc NULL\n");
         /* We could not allocate memory for this phase, so we drop
-           the last item on the list and reuse it for our phase. */
-        e = list_chop(*list->list);
+           the least recently seen phase and reuse it for our phase. */
+        remove_phase(list, list_tail(*list->list));
+        e = memb_alloc(list->memb);
       }
       rimeaddr_copy(&e->neighbor, neighbor);
       e->time = time;
+      e->updated = now;
 #if PHASE_DRIFT_CORRECT
       e->drift = 0;
 #endif
       e->noacks = 0;
       list_push(*list->list, e);
+      e->hash_next = list->hash[hash_index(neighbor)];
+      list->hash[hash_index(neighbor)] = e;
     }
   }
 }
@@ -181,6 +274,11 @@ phase_wait(struct phase_list *list,
      time for the next expected phase and setup a ctimer to switch on
      the radio just before the phase. */
   e = find_neighbor(list, neighbor);
+  if(e != NULL && clock_seconds() - e->updated > PHASE_MAX_AGE) {
+    PRINTF("phase of %d too old\n", neighbor->u8[0]);
+    remove_phase(list, e);
+    e = NULL;
+  }
   if(e != NULL) {
     rtimer_clock_t wait, now, expected, sync;
     clock_time_t ctimewait;
@@ -204,14 +302,8 @@ phase_wait(struct phase_list *list,
     sync = (e == NULL) ? now : e->time;
 
 #if PHASE_DRIFT_CORRECT
-    {
-      int32_t s;
-      if(e->drift > cycle_time) {
-        s = e->drift % cycle_time / (e->drift / cycle_time);  /* drift per cycle */
-        s = s * (now - sync) / cycle_time;                    /* estimated drift to now */
-        sync += s;                                            /* add it in */
-      }
-    }
+    /* Add in the drift estimated since the phase was last seen */
+    sync += drift_since_update(e, clock_seconds());
 #endif
 
     /* Check if cycle_time is a power of two */
@@ -263,6 +355,7 @@ phase_init(struct phase_list *list)
 {
   list_init(*list->list);
   memb_init(list->memb);
+  memset(list->hash, 0, PHASE_HASH_SIZE * sizeof(struct phase *));
   memb_init(&queued_packets_memb);
 }
 /*---------------------------------------------------------------------------*/
@@ -47,26 +47,40 @@
 #include "lib/memb.h"
 #include "net/netstack.h"
 
-#if PHASE_CONF_DRIFT_CORRECT
+#ifdef PHASE_CONF_DRIFT_CORRECT
 #define PHASE_DRIFT_CORRECT PHASE_CONF_DRIFT_CORRECT
 #else
-#define PHASE_DRIFT_CORRECT 0
+#define PHASE_DRIFT_CORRECT 1
+#endif
+
+/* Number of buckets in the hash that indexes the phases by neighbor */
+#ifdef PHASE_CONF_HASH_SIZE
+#define PHASE_HASH_SIZE PHASE_CONF_HASH_SIZE
+#else
+#define PHASE_HASH_SIZE 8
 #endif
 
 struct phase {
   struct phase *next;
+  struct phase *hash_next;
   rimeaddr_t neighbor;
   rtimer_clock_t time;
+  /* clock_seconds() when the phase was last seen */
+  unsigned long updated;
 #if PHASE_DRIFT_CORRECT
-  rtimer_clock_t drift;
+  /* Rtimer ticks that the phase moves in PHASE_DRIFT_PERIOD seconds */
+  int16_t drift;
 #endif
   uint8_t noacks;
   struct timer noacks_timer;
 };
 
+/* The phases are kept on the list in least recently used order, the
+   most recently seen neighbor first. */
 struct phase_list {
   list_t *list;
   struct memb *memb;
+  struct phase **hash;
 };
 
 typedef enum {
@@ -78,7 +92,9 @@ typedef enum {
 
 #define PHASE_LIST(name, num) LIST(phase_list_list);                              \
                               MEMB(phase_list_memb, struct phase, num);           \
-                              struct phase_list name = { &phase_list_list, &phase_list_memb }
+                              static struct phase *phase_list_hash[PHASE_HASH_SIZE]; \
+                              struct phase_list name = { &phase_list_list, &phase_list_memb, \
+                                                         phase_list_hash }
 
 void phase_init(struct phase_list *list);
 phase_status_t phase_wait(struct phase_list *list,  const rimeaddr_t *neighbor,
@@ -86,7 +102,8 @@ phase_status_t phase_wait(struct phase_list *list,  const rimeaddr_t *neighbor,
                           mac_callback_t mac_callback, void *mac_callback_ptr,
                           struct rdc_buf_list *buf_list);
 void phase_update(const struct phase_list *list, const rimeaddr_t *neighbor,
-                  rtimer_clock_t time, int mac_status);
+                  rtimer_clock_t time, rtimer_clock_t cycle_time,
+                  int mac_status);
 
 void phase_remove(const struct phase_list *list, const rimeaddr_t *neighbor);
 
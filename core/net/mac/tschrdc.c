@@ -0,0 +1,840 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         A time-slotted channel-hopping RDC, in the style of
+ *         IEEE 802.15.4e TSCH. Time is divided into slots that repeat
+ *         in a slotframe; a cell gives a slot of the slotframe and a
+ *         channel offset, and the channel of a cell hops with the
+ *         absolute slot number (ASN). Nodes join by listening for
+ *         enhanced beacons (EBs) that carry the ASN, and keep in sync
+ *         with their time source from the frames they receive from it.
+ */
+
+#include "net/mac/tschrdc.h"
+#include "net/mac/frame802154.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+#include "net/netstack.h"
+#include "lib/memb.h"
+#include "lib/list.h"
+#include "sys/rtimer.h"
+#include "sys/etimer.h"
+#include <string.h>
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+/* Length of a timeslot, in rtimer ticks */
+#ifdef TSCHRDC_CONF_SLOT_LENGTH
+#define SLOT_LENGTH TSCHRDC_CONF_SLOT_LENGTH
+#else
+#define SLOT_LENGTH (RTIMER_SECOND / 100)
+#endif
+
+/* Number of timeslots in the slotframe */
+#ifdef TSCHRDC_CONF_SLOTFRAME_LENGTH
+#define SLOTFRAME_LENGTH TSCHRDC_CONF_SLOTFRAME_LENGTH
+#else
+#define SLOTFRAME_LENGTH 7
+#endif
+
+#ifdef TSCHRDC_CONF_MAX_CELLS
+#define MAX_CELLS TSCHRDC_CONF_MAX_CELLS
+#else
+#define MAX_CELLS 8
+#endif
+
+#ifdef TSCHRDC_CONF_QUEUE_SIZE
+#define QUEUE_SIZE TSCHRDC_CONF_QUEUE_SIZE
+#else
+#define QUEUE_SIZE 8
+#endif
+
+/* Attempts made for a unicast frame, each in a slot of its own, before
+   it is reported as failed */
+#ifdef TSCHRDC_CONF_MAX_TRANSMISSIONS
+#define MAX_TRANSMISSIONS TSCHRDC_CONF_MAX_TRANSMISSIONS
+#else
+#define MAX_TRANSMISSIONS 1
+#endif
+
+/* Run the slots from the tschrdc process instead of an rtimer. This
+   is for platforms whose rtimers fire in a context where the slots
+   must not run, such as a signal handler on native. It needs rtimer
+   and clock ticks that are as fine as the slot timing. */
+#ifdef TSCHRDC_CONF_SLOTS_FROM_PROCESS
+#define SLOTS_FROM_PROCESS TSCHRDC_CONF_SLOTS_FROM_PROCESS
+#else
+#define SLOTS_FROM_PROCESS 0
+#endif
+
+#ifdef TSCHRDC_CONF_EB_PERIOD
+#define EB_PERIOD TSCHRDC_CONF_EB_PERIOD
+#else
+#define EB_PERIOD (16 * CLOCK_SECOND)
+#endif
+
+/* A node that has not heard its time source for this many seconds
+   leaves the network and scans for beacons again */
+#ifdef TSCHRDC_CONF_DESYNC_TIMEOUT
+#define DESYNC_TIMEOUT TSCHRDC_CONF_DESYNC_TIMEOUT
+#else
+#define DESYNC_TIMEOUT 60
+#endif
+
+#ifdef TSCHRDC_CONF_COORDINATOR
+#define COORDINATOR TSCHRDC_CONF_COORDINATOR
+#else
+#define COORDINATOR 0
+#endif
+
+#ifdef TSCHRDC_CONF_HOPPING_SEQUENCE
+static const uint8_t hopping_sequence[] = TSCHRDC_CONF_HOPPING_SEQUENCE;
+#else
+static const uint8_t hopping_sequence[] = { 15, 20, 25, 26 };
+#endif
+#define HOPPING_SEQUENCE_LENGTH (sizeof(hopping_sequence) / sizeof(hopping_sequence[0]))
+
+/* The radio API has no way to change the channel, so platforms that
+   can hop set TSCHRDC_CONF_SET_CHANNEL(channel). Without it, all cells
+   use the channel the radio is already on. */
+#ifdef TSCHRDC_CONF_SET_CHANNEL
+#define SET_CHANNEL(channel) TSCHRDC_CONF_SET_CHANNEL(channel)
+#else
+#define SET_CHANNEL(channel) (void)(channel)
+#endif
+
+/* Timing within a slot: the sender starts its frame TX_OFFSET into
+   the slot, and the receiver listens RX_GUARD on either side of it */
+#define TX_OFFSET  (SLOT_LENGTH / 4)
+#define RX_GUARD   (SLOT_LENGTH / 8 + 1)
+#define SCHEDULE_MARGIN 2
+
+/* Air time of a frame at 250 kbit/s, including the PHY header */
+#define FRAME_AIRTIME(len) \
+  ((rtimer_clock_t)(((unsigned long)(len) + 6) * RTIMER_SECOND / 31250))
+
+#define ACK_LEN 3
+
+/* An EB is a broadcast frame whose payload is a dispatch byte outside
+   of the 6lowpan range, the five byte ASN and the join priority */
+#define EB_DISPATCH 0x3e
+#define EB_LEN      7
+
+#define BUSYWAIT_UNTIL(t)                                          \
+  while(RTIMER_CLOCK_LT(RTIMER_NOW(), (t)))
+#define BUSYWAIT_UNTIL_COND(cond, t)                               \
+  while(!(cond) && RTIMER_CLOCK_LT(RTIMER_NOW(), (t)))
+
+enum {
+  PACKET_FREE,
+  PACKET_QUEUED,
+  PACKET_DONE
+};
+
+struct tsch_packet {
+  struct queuebuf *qb;
+  mac_callback_t sent;
+  void *ptr;
+  rimeaddr_t receiver;
+  uint16_t seqno;
+  uint8_t state;
+  uint8_t ret;
+  uint8_t transmissions;
+  uint8_t is_eb;
+};
+
+static struct tsch_packet queue[QUEUE_SIZE];
+static uint16_t next_seqno;
+
+MEMB(cell_memb, struct tschrdc_cell, MAX_CELLS);
+LIST(cell_list);
+
+#if SLOTS_FROM_PROCESS
+static struct etimer slot_etimer;
+#else /* SLOTS_FROM_PROCESS */
+static struct rtimer slot_timer;
+#endif /* SLOTS_FROM_PROCESS */
+static volatile uint32_t current_asn;
+static volatile rtimer_clock_t current_start;
+static volatile int sync_correction;
+static volatile uint8_t associated, is_coordinator, tsch_is_on;
+static volatile uint8_t slots_running;
+
+static uint8_t join_priority;
+static rimeaddr_t time_source;
+static unsigned long last_sync;
+
+/* A frame received in an RX cell, handed from the slot to the process */
+static uint8_t rx_frame[PACKETBUF_SIZE];
+static volatile uint8_t rx_len;
+static volatile rtimer_clock_t rx_offset;
+
+/* Set while packet_input() handles a frame that arrived in an RX cell */
+static uint8_t input_timed;
+static rtimer_clock_t input_offset;
+
+struct seqno {
+  rimeaddr_t sender;
+  uint8_t seqno;
+};
+
+#ifdef NETSTACK_CONF_MAC_SEQNO_HISTORY
+#define MAX_SEQNOS NETSTACK_CONF_MAC_SEQNO_HISTORY
+#else /* NETSTACK_CONF_MAC_SEQNO_HISTORY */
+#define MAX_SEQNOS 16
+#endif /* NETSTACK_CONF_MAC_SEQNO_HISTORY */
+
+static struct seqno received_seqnos[MAX_SEQNOS];
+
+PROCESS(tschrdc_process, "TSCH RDC");
+
+static void schedule_next_slot(void);
+/*---------------------------------------------------------------------------*/
+struct tschrdc_cell *
+tschrdc_add_cell(uint16_t timeslot, uint8_t channel_offset,
+                 uint8_t options, const rimeaddr_t *neighbor)
+{
+  struct tschrdc_cell *c;
+
+  if(timeslot >= SLOTFRAME_LENGTH) {
+    return NULL;
+  }
+  c = memb_alloc(&cell_memb);
+  if(c == NULL) {
+    return NULL;
+  }
+  c->timeslot = timeslot;
+  c->channel_offset = channel_offset;
+  c->options = options;
+  rimeaddr_copy(&c->neighbor, neighbor != NULL ? neighbor : &rimeaddr_null);
+  list_add(cell_list, c);
+  return c;
+}
+/*---------------------------------------------------------------------------*/
+void
+tschrdc_remove_cell(struct tschrdc_cell *cell)
+{
+  list_remove(cell_list, cell);
+  memb_free(&cell_memb, cell);
+}
+/*---------------------------------------------------------------------------*/
+/* Number of slots from the given ASN to the next one with a cell */
+static uint16_t
+slots_to_next_cell(uint32_t asn)
+{
+  struct tschrdc_cell *c;
+  uint16_t timeslot, d, min;
+
+  timeslot = asn % SLOTFRAME_LENGTH;
+  min = SLOTFRAME_LENGTH;
+  for(c = list_head(cell_list); c != NULL; c = list_item_next(c)) {
+    d = (c->timeslot + SLOTFRAME_LENGTH - timeslot) % SLOTFRAME_LENGTH;
+    if(d > 0 && d < min) {
+      min = d;
+    }
+  }
+  return min;
+}
+/*---------------------------------------------------------------------------*/
+/* The oldest queued packet that may be sent to the neighbor of a cell */
+static struct tsch_packet *
+select_packet(const rimeaddr_t *neighbor)
+{
+  struct tsch_packet *p, *best;
+  int i;
+
+  best = NULL;
+  for(i = 0; i < QUEUE_SIZE; i++) {
+    p = &queue[i];
+    if(p->state == PACKET_QUEUED &&
+       (rimeaddr_cmp(neighbor, &rimeaddr_null) ||
+        rimeaddr_cmp(neighbor, &p->receiver)) &&
+       (best == NULL || (int16_t)(p->seqno - best->seqno) < 0)) {
+      best = p;
+    }
+  }
+  return best;
+}
+/*---------------------------------------------------------------------------*/
+static void
+tx_slot(struct tsch_packet *p, struct tschrdc_cell *cell)
+{
+  uint8_t *frame;
+  uint16_t len;
+  uint8_t dsn;
+  int ret;
+
+  frame = queuebuf_dataptr(p->qb);
+  len = queuebuf_datalen(p->qb);
+  if(p->is_eb) {
+    /* The ASN of an EB is the one of the slot it goes out in */
+    uint8_t *asn = &frame[len - EB_LEN + 1];
+    asn[0] = current_asn & 0xff;
+    asn[1] = (current_asn >> 8) & 0xff;
+    asn[2] = (current_asn >> 16) & 0xff;
+    asn[3] = (current_asn >> 24) & 0xff;
+    asn[4] = 0;
+  }
+  dsn = frame[2];
+  NETSTACK_RADIO.prepare(frame, len);
+
+  BUSYWAIT_UNTIL(current_start + TX_OFFSET);
+
+  if(NETSTACK_RADIO.receiving_packet() || NETSTACK_RADIO.pending_packet() ||
+     ((cell->options & TSCHRDC_CELL_SHARED) &&
+      NETSTACK_RADIO.channel_clear() == 0)) {
+    ret = MAC_TX_COLLISION;
+  } else {
+    switch(NETSTACK_RADIO.transmit(len)) {
+    case RADIO_TX_OK:
+      if(rimeaddr_cmp(&p->receiver, &rimeaddr_null)) {
+        ret = MAC_TX_OK;
+      } else {
+        uint8_t ackbuf[ACK_LEN];
+
+        /* The receiver acks within the same slot */
+        NETSTACK_RADIO.on();
+        BUSYWAIT_UNTIL_COND(NETSTACK_RADIO.receiving_packet() ||
+                            NETSTACK_RADIO.pending_packet(),
+                            current_start + SLOT_LENGTH - RX_GUARD);
+        BUSYWAIT_UNTIL_COND(!NETSTACK_RADIO.receiving_packet(),
+                            current_start + SLOT_LENGTH - RX_GUARD);
+        ret = MAC_TX_NOACK;
+        if(NETSTACK_RADIO.pending_packet()) {
+          if(NETSTACK_RADIO.read(ackbuf, ACK_LEN) == ACK_LEN &&
+             ackbuf[2] == dsn) {
+            ret = MAC_TX_OK;
+          } else {
+            ret = MAC_TX_COLLISION;
+          }
+        }
+        NETSTACK_RADIO.off();
+      }
+      break;
+    case RADIO_TX_COLLISION:
+      ret = MAC_TX_COLLISION;
+      break;
+    default:
+      ret = MAC_TX_ERR;
+      break;
+    }
+  }
+
+  p->ret = ret;
+  p->transmissions++;
+  if((ret == MAC_TX_NOACK || ret == MAC_TX_COLLISION) &&
+     p->transmissions < MAX_TRANSMISSIONS) {
+    /* Try again in a later cell */
+    return;
+  }
+  p->state = PACKET_DONE;
+  process_poll(&tschrdc_process);
+}
+/*---------------------------------------------------------------------------*/
+static void
+rx_slot(void)
+{
+  rtimer_clock_t rx_start;
+  frame802154_t frame;
+  int len;
+
+  BUSYWAIT_UNTIL(current_start + TX_OFFSET - RX_GUARD);
+  NETSTACK_RADIO.on();
+  BUSYWAIT_UNTIL_COND(NETSTACK_RADIO.receiving_packet() ||
+                      NETSTACK_RADIO.pending_packet(),
+                      current_start + TX_OFFSET + RX_GUARD);
+  rx_start = RTIMER_NOW();
+
+  if(!NETSTACK_RADIO.receiving_packet() && !NETSTACK_RADIO.pending_packet()) {
+    NETSTACK_RADIO.off();
+    return;
+  }
+
+  BUSYWAIT_UNTIL_COND(!NETSTACK_RADIO.receiving_packet(),
+                      current_start + SLOT_LENGTH - RX_GUARD);
+
+  if(rx_len != 0 || !NETSTACK_RADIO.pending_packet()) {
+    /* The previous frame has not been handled yet: leave this one
+       to the radio driver */
+    NETSTACK_RADIO.off();
+    return;
+  }
+
+  len = NETSTACK_RADIO.read(rx_frame, sizeof(rx_frame));
+  if(len > ACK_LEN &&
+     frame802154_parse(rx_frame, len, &frame) &&
+     frame.fcf.frame_type == FRAME802154_DATAFRAME &&
+     frame.fcf.ack_required &&
+     rimeaddr_cmp((rimeaddr_t *)&frame.dest_addr, &rimeaddr_node_addr)) {
+    uint8_t ackbuf[ACK_LEN];
+
+    ackbuf[0] = FRAME802154_ACKFRAME;
+    ackbuf[1] = 0;
+    ackbuf[2] = frame.seq;
+    NETSTACK_RADIO.send(ackbuf, ACK_LEN);
+  }
+  NETSTACK_RADIO.off();
+
+  if(len > ACK_LEN) {
+    rx_offset = rx_start - current_start;
+    rx_len = len;
+    process_poll(&tschrdc_process);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+slot_operation(struct rtimer *t, void *ptr)
+{
+  struct tschrdc_cell *c, *cell;
+  struct tsch_packet *p;
+  uint16_t timeslot;
+
+  if(!tsch_is_on || !associated) {
+    slots_running = 0;
+    return;
+  }
+
+  /* A TX cell with a packet for its neighbor wins over an RX cell in
+     the same timeslot */
+  timeslot = current_asn % SLOTFRAME_LENGTH;
+  cell = NULL;
+  p = NULL;
+  for(c = list_head(cell_list); c != NULL; c = list_item_next(c)) {
+    if(c->timeslot != timeslot) {
+      continue;
+    }
+    if(p == NULL && (c->options & TSCHRDC_CELL_TX) &&
+       (p = select_packet(&c->neighbor)) != NULL) {
+      cell = c;
+    } else if(cell == NULL && (c->options & TSCHRDC_CELL_RX)) {
+      cell = c;
+    }
+  }
+
+  if(cell != NULL) {
+    SET_CHANNEL(hopping_sequence[(current_asn + cell->channel_offset) %
+                                 HOPPING_SEQUENCE_LENGTH]);
+    if(p != NULL) {
+      tx_slot(p, cell);
+    } else {
+      rx_slot();
+    }
+  }
+
+  schedule_next_slot();
+}
+/*---------------------------------------------------------------------------*/
+static void
+schedule_next_slot(void)
+{
+  rtimer_clock_t now;
+  uint16_t skip;
+
+  current_start += sync_correction;
+  sync_correction = 0;
+
+  /* Skip the slots that are already too close or past */
+  now = RTIMER_NOW();
+  do {
+    skip = slots_to_next_cell(current_asn);
+    current_asn += skip;
+    current_start += skip * SLOT_LENGTH;
+  } while(!RTIMER_CLOCK_LT(now + SCHEDULE_MARGIN, current_start));
+
+  slots_running = 1;
+#if SLOTS_FROM_PROCESS
+  /* Wake up no later than the start of the slot */
+  PROCESS_CONTEXT_BEGIN(&tschrdc_process);
+  etimer_set(&slot_etimer, (clock_time_t)((current_start - now) *
+                                          CLOCK_SECOND / RTIMER_SECOND));
+  PROCESS_CONTEXT_END(&tschrdc_process);
+#else /* SLOTS_FROM_PROCESS */
+  rtimer_set(&slot_timer, current_start, 1, slot_operation, NULL);
+#endif /* SLOTS_FROM_PROCESS */
+}
+/*---------------------------------------------------------------------------*/
+static void
+associate(uint32_t asn, rtimer_clock_t slot_start)
+{
+  current_asn = asn;
+  current_start = slot_start;
+  sync_correction = 0;
+  associated = 1;
+  last_sync = clock_seconds();
+  NETSTACK_RADIO.off();
+  if(tsch_is_on && !slots_running) {
+    schedule_next_slot();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+leave(void)
+{
+  PRINTF("tschrdc: lost sync\n");
+  associated = 0;
+  SET_CHANNEL(hopping_sequence[0]);
+  if(tsch_is_on) {
+    NETSTACK_RADIO.on();
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+tschrdc_set_coordinator(int coordinator)
+{
+  is_coordinator = coordinator;
+  if(is_coordinator) {
+    join_priority = 0;
+    rimeaddr_copy(&time_source, &rimeaddr_null);
+    if(!associated) {
+      associate(0, RTIMER_NOW());
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+tschrdc_is_associated(void)
+{
+  return associated;
+}
+/*---------------------------------------------------------------------------*/
+static int
+enqueue(mac_callback_t sent, void *ptr, uint8_t is_eb)
+{
+  struct tsch_packet *p;
+  int i;
+
+  p = NULL;
+  for(i = 0; i < QUEUE_SIZE; i++) {
+    if(queue[i].state == PACKET_FREE) {
+      p = &queue[i];
+      break;
+    }
+  }
+  if(p == NULL) {
+    PRINTF("tschrdc: queue full\n");
+    return MAC_TX_ERR;
+  }
+
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &rimeaddr_node_addr);
+  packetbuf_set_attr(PACKETBUF_ATTR_MAC_ACK, 1);
+  if(NETSTACK_FRAMER.create() < 0) {
+    PRINTF("tschrdc: send failed, too large header\n");
+    return MAC_TX_ERR_FATAL;
+  }
+  p->qb = queuebuf_new_from_packetbuf();
+  if(p->qb == NULL) {
+    return MAC_TX_ERR;
+  }
+  p->sent = sent;
+  p->ptr = ptr;
+  rimeaddr_copy(&p->receiver, packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+  p->seqno = next_seqno++;
+  p->transmissions = 0;
+  p->is_eb = is_eb;
+  p->state = PACKET_QUEUED;
+  return MAC_TX_DEFERRED;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_eb(void)
+{
+  uint8_t *eb;
+  int i;
+
+  for(i = 0; i < QUEUE_SIZE; i++) {
+    if(queue[i].state != PACKET_FREE && queue[i].is_eb) {
+      return;
+    }
+  }
+
+  packetbuf_clear();
+  eb = packetbuf_dataptr();
+  eb[0] = EB_DISPATCH;
+  memset(&eb[1], 0, 5);
+  eb[6] = join_priority;
+  packetbuf_set_datalen(EB_LEN);
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &rimeaddr_null);
+  enqueue(NULL, NULL, 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_packet(mac_callback_t sent, void *ptr)
+{
+  int ret;
+
+  if(!associated) {
+    /* Let the MAC retry once we have joined */
+    ret = MAC_TX_COLLISION;
+  } else {
+    ret = enqueue(sent, ptr, 0);
+  }
+  if(ret != MAC_TX_DEFERRED) {
+    mac_call_sent_callback(sent, ptr, ret, 1);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
+{
+  /* channel_check_interval() is 0, so the MAC hands over no bursts */
+  if(buf_list != NULL) {
+    queuebuf_to_packetbuf(buf_list->buf);
+    send_packet(sent, ptr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+eb_input(void)
+{
+  uint8_t *eb;
+  uint32_t asn;
+  rtimer_clock_t now;
+
+  if(associated || is_coordinator) {
+    return;
+  }
+
+  /* Without a slot to time it, the EB is taken to have ended just
+     now, which places the start of its slot before it */
+  now = RTIMER_NOW();
+  eb = packetbuf_dataptr();
+  asn = (uint32_t)eb[1] | ((uint32_t)eb[2] << 8) |
+    ((uint32_t)eb[3] << 16) | ((uint32_t)eb[4] << 24);
+  join_priority = eb[6] + 1;
+  rimeaddr_copy(&time_source, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+  PRINTF("tschrdc: joined at asn %lu, join priority %u\n",
+         (unsigned long)asn, join_priority);
+  associate(asn, now - TX_OFFSET - FRAME_AIRTIME(packetbuf_totlen()));
+}
+/*---------------------------------------------------------------------------*/
+static void
+packet_input(void)
+{
+  int i;
+
+  if(packetbuf_datalen() == ACK_LEN) {
+    /* Ignore ack packets */
+  } else if(NETSTACK_FRAMER.parse() < 0) {
+    PRINTF("tschrdc: failed to parse %u\n", packetbuf_datalen());
+  } else if(!rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
+                          &rimeaddr_node_addr) &&
+            !rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
+                          &rimeaddr_null)) {
+    PRINTF("tschrdc: not for us\n");
+  } else {
+    if(associated && !is_coordinator &&
+       rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_SENDER), &time_source)) {
+      if(input_timed) {
+        /* Follow the slot timing of the time source */
+        sync_correction = (int)input_offset - TX_OFFSET;
+      }
+      last_sync = clock_seconds();
+    }
+
+    if(packetbuf_datalen() == EB_LEN &&
+       ((uint8_t *)packetbuf_dataptr())[0] == EB_DISPATCH) {
+      eb_input();
+      return;
+    }
+
+    /* Check for duplicate packet by comparing the sequence number
+       of the incoming packet with the last few ones we saw. */
+    for(i = 0; i < MAX_SEQNOS; ++i) {
+      if(packetbuf_attr(PACKETBUF_ATTR_PACKET_ID) == received_seqnos[i].seqno &&
+         rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                      &received_seqnos[i].sender)) {
+        PRINTF("tschrdc: drop duplicate link layer packet %u\n",
+               packetbuf_attr(PACKETBUF_ATTR_PACKET_ID));
+        return;
+      }
+    }
+    for(i = MAX_SEQNOS - 1; i > 0; --i) {
+      memcpy(&received_seqnos[i], &received_seqnos[i - 1],
+             sizeof(struct seqno));
+    }
+    received_seqnos[0].seqno = packetbuf_attr(PACKETBUF_ATTR_PACKET_ID);
+    rimeaddr_copy(&received_seqnos[0].sender,
+                  packetbuf_addr(PACKETBUF_ADDR_SENDER));
+    NETSTACK_MAC.input();
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Report the packets the slots are done with, oldest first */
+static void
+deliver_sent(void)
+{
+  struct tsch_packet *p;
+  int i;
+
+  do {
+    p = NULL;
+    for(i = 0; i < QUEUE_SIZE; i++) {
+      if(queue[i].state == PACKET_DONE &&
+         (p == NULL || (int16_t)(queue[i].seqno - p->seqno) < 0)) {
+        p = &queue[i];
+      }
+    }
+    if(p != NULL) {
+      /* The MAC reads the attributes of the packet back from the
+         packetbuf */
+      queuebuf_to_packetbuf(p->qb);
+      queuebuf_free(p->qb);
+      p->state = PACKET_FREE;
+      if(p->sent != NULL) {
+        mac_call_sent_callback(p->sent, p->ptr, p->ret, p->transmissions);
+      }
+    }
+  } while(p != NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+deliver_received(void)
+{
+  if(rx_len == 0) {
+    return;
+  }
+  packetbuf_clear();
+  memcpy(packetbuf_dataptr(), rx_frame, rx_len);
+  packetbuf_set_datalen(rx_len);
+  input_offset = rx_offset;
+  rx_len = 0;
+
+  input_timed = 1;
+  packet_input();
+  input_timed = 0;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(tschrdc_process, ev, data)
+{
+  static struct etimer eb_timer;
+
+  PROCESS_BEGIN();
+
+  etimer_set(&eb_timer, EB_PERIOD);
+
+  while(1) {
+    PROCESS_WAIT_EVENT();
+    if(ev == PROCESS_EVENT_POLL) {
+      deliver_sent();
+      deliver_received();
+    } else if(ev == PROCESS_EVENT_TIMER && data == &eb_timer) {
+      if(associated && !is_coordinator &&
+         clock_seconds() - last_sync > DESYNC_TIMEOUT) {
+        leave();
+      }
+      if(associated && tsch_is_on) {
+        send_eb();
+      }
+      etimer_reset(&eb_timer);
+#if SLOTS_FROM_PROCESS
+    } else if(ev == PROCESS_EVENT_TIMER && data == &slot_etimer) {
+      slot_operation(NULL, NULL);
+#endif /* SLOTS_FROM_PROCESS */
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+static int
+on(void)
+{
+  tsch_is_on = 1;
+  if(!associated) {
+    /* Scan for beacons */
+    return NETSTACK_RADIO.on();
+  }
+  if(!slots_running) {
+    schedule_next_slot();
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+off(int keep_radio_on)
+{
+  tsch_is_on = 0;
+  if(keep_radio_on) {
+    return NETSTACK_RADIO.on();
+  } else {
+    return NETSTACK_RADIO.off();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+channel_check_interval(void)
+{
+  /* Frames are not strobed, so the MAC has no channel check to wait
+     for. This also keeps CSMA from handing over bursts, which would
+     only go out one per slot. */
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+  memb_init(&cell_memb);
+  list_init(cell_list);
+  memset(queue, 0, sizeof(queue));
+
+  /* The minimal schedule: a single shared cell that carries beacons
+     as well as the RPL and data traffic of all nodes */
+  tschrdc_add_cell(0, 0, TSCHRDC_CELL_TX | TSCHRDC_CELL_RX |
+                   TSCHRDC_CELL_SHARED, &rimeaddr_null);
+
+  process_start(&tschrdc_process, NULL);
+
+  SET_CHANNEL(hopping_sequence[0]);
+  on();
+  if(COORDINATOR) {
+    tschrdc_set_coordinator(1);
+  }
+}
+/*---------------------------------------------------------------------------*/
+const struct rdc_driver tschrdc_driver = {
+  "tschrdc",
+  init,
+  send_packet,
+  send_list,
+  packet_input,
+  on,
+  off,
+  channel_check_interval,
+};
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         A time-slotted channel-hopping RDC, in the style of
+ *         IEEE 802.15.4e TSCH
+ */
+
+#ifndef __TSCHRDC_H__
+#define __TSCHRDC_H__
+
+#include "net/mac/rdc.h"
+#include "net/rime/rimeaddr.h"
+
+/* Cell options */
+#define TSCHRDC_CELL_TX      0x01
+#define TSCHRDC_CELL_RX      0x02
+#define TSCHRDC_CELL_SHARED  0x04
+
+/**
+ * A cell is a timeslot of the slotframe together with a channel
+ * offset. A TX cell with a neighbor address only carries frames to
+ * that neighbor; with the null address it carries frames to anyone.
+ */
+struct tschrdc_cell {
+  struct tschrdc_cell *next;
+  rimeaddr_t neighbor;
+  uint16_t timeslot;
+  uint8_t channel_offset;
+  uint8_t options;
+};
+
+/*
+ * Pairing with the MAC: tschrdc reports a frame only once the slot it
+ * went out in has passed. CSMA keeps one unicast frame in flight per
+ * neighbor, so with CSMA on top dedicated cells to different neighbors
+ * carry traffic in parallel, while the frames to one neighbor wait for
+ * each other. To hand over every frame at once, run tschrdc under
+ * nullmac_driver and let tschrdc retransmit by setting
+ * TSCHRDC_CONF_MAX_TRANSMISSIONS. Under CSMA, leave it at 1 and CSMA
+ * does the retransmissions.
+ */
+extern const struct rdc_driver tschrdc_driver;
+
+/**
+ * Add a cell to the slotframe. Returns NULL if the timeslot is out of
+ * range or no cell is free.
+ */
+struct tschrdc_cell *tschrdc_add_cell(uint16_t timeslot,
+                                      uint8_t channel_offset,
+                                      uint8_t options,
+                                      const rimeaddr_t *neighbor);
+void tschrdc_remove_cell(struct tschrdc_cell *cell);
+
+/**
+ * Make this node start the slotframe and send beacons without
+ * waiting for one, typically called by the RPL DAG root.
+ */
+void tschrdc_set_coordinator(int is_coordinator);
+int tschrdc_is_associated(void);
+
+#endif /* __TSCHRDC_H__ */
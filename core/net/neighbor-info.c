@@ -134,6 +134,7 @@ neighbor_info_packet_sent(int status, int numtx)
        (nbr->state == STALE || nbr->state == DELAY || nbr->state == PROBE)) {
       nbr->state = REACHABLE;
       stimer_set(&nbr->reachable, UIP_ND6_REACHABLE_TIME / 1000);
+      UIP_DS6_WHEEL_UPDATE(nbr);
       PRINTF("neighbor-info : received a link layer ACK : ");
       PRINTLLADDR((uip_lladdr_t *)dest);
       PRINTF(" is reachable.\n");
@@ -61,6 +61,8 @@ static uint8_t hdrptr;
    msp430), having apotentially misaligned packet buffer may lead to
    problems when accessing 16-bit values. */
 static uint16_t packetbuf_aligned[(PACKETBUF_SIZE + PACKETBUF_HDR_SIZE) / 2 + 1];
+/* The storage of the packetbuf, either packetbuf_aligned or a buffer
+   shared with packetbuf_share() */
 static uint8_t *packetbuf = (uint8_t *)packetbuf_aligned;
 
 static uint8_t *packetbufptr;
@@ -80,6 +82,7 @@ packetbuf_clear(void)
   buflen = bufptr = 0;
   hdrptr = PACKETBUF_HDR_SIZE;
 
+  packetbuf = (uint8_t *)packetbuf_aligned;
   packetbufptr = &packetbuf[PACKETBUF_HDR_SIZE];
   packetbuf_attr_clear();
 }
@@ -103,6 +106,34 @@ packetbuf_copyfrom(const void *from, uint16_t len)
 }
 /*---------------------------------------------------------------------------*/
 void
+packetbuf_share(uint8_t *buf, uint16_t len)
+{
+  packetbuf_clear();
+  packetbuf = buf;
+  packetbufptr = &packetbuf[PACKETBUF_HDR_SIZE];
+  buflen = len > PACKETBUF_SIZE? PACKETBUF_SIZE: len;
+}
+/*---------------------------------------------------------------------------*/
+int
+packetbuf_is_shared(const uint8_t *buf)
+{
+  return packetbuf == buf;
+}
+/*---------------------------------------------------------------------------*/
+void
+packetbuf_unshare(void)
+{
+  uint8_t *own = (uint8_t *)packetbuf_aligned;
+
+  if(packetbuf != own) {
+    memcpy(&own[hdrptr], &packetbuf[hdrptr],
+           PACKETBUF_HDR_SIZE - hdrptr + bufptr + buflen);
+    packetbuf = own;
+    packetbufptr = &packetbuf[PACKETBUF_HDR_SIZE];
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
 packetbuf_compact(void)
 {
   int i, len;
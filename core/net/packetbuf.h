@@ -219,6 +219,41 @@ int packetbuf_is_reference(void);
  */
 void *packetbuf_reference_ptr(void);
 
+/**
+ * \brief      Use an external buffer as the storage of the packetbuf
+ * \param buf  A buffer of PACKETBUF_HDR_SIZE + PACKETBUF_SIZE bytes
+ * \param len  The length of the data in the buffer
+ *
+ *             This function makes the packetbuf use an external
+ *             buffer, such as the one of a queuebuf, instead of its
+ *             own storage. The data of the packet starts at
+ *             PACKETBUF_HDR_SIZE bytes into the buffer, and headers
+ *             are written in place in front of it, so the data is
+ *             not copied. The packetbuf goes back to its own storage
+ *             when it is cleared.
+ */
+void packetbuf_share(uint8_t *buf, uint16_t len);
+
+/**
+ * \brief      Check if the packetbuf uses an external buffer
+ * \param buf  The external buffer
+ * \retval     Non-zero if the packetbuf uses the buffer, zero otherwise.
+ *
+ *             This function is used to check if the packetbuf uses a
+ *             buffer that was previously given to packetbuf_share().
+ */
+int packetbuf_is_shared(const uint8_t *buf);
+
+/**
+ * \brief      Make the packetbuf stop using an external buffer
+ *
+ *             This function copies the header and data of the
+ *             packetbuf from the buffer given to packetbuf_share()
+ *             into the own storage of the packetbuf, so that the
+ *             buffer can be reused.
+ */
+void packetbuf_unshare(void);
+
 /**
  * \brief      Compact the packetbuf
  *
@@ -333,6 +368,12 @@ struct packetbuf_addr {
 #define PACKETBUF_ATTR_PACKET_TYPE_STREAM_END 3
 #define PACKETBUF_ATTR_PACKET_TYPE_TIMESTAMP 4
 
+/* Traffic classes, from the least to the most urgent */
+#define PACKETBUF_ATTR_TRAFFIC_CLASS_BULK    0
+#define PACKETBUF_ATTR_TRAFFIC_CLASS_IDS     1
+#define PACKETBUF_ATTR_TRAFFIC_CLASS_CONTROL 2
+#define PACKETBUF_NUM_TRAFFIC_CLASSES        3
+
 enum {
   PACKETBUF_ATTR_NONE,
 
@@ -348,6 +389,7 @@ enum {
   PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
   PACKETBUF_ATTR_MAC_SEQNO,
   PACKETBUF_ATTR_MAC_ACK,
+  PACKETBUF_ATTR_TRAFFIC_CLASS,
 
   /* Scope 1 attributes: used between two neighbors only. */
   PACKETBUF_ATTR_RELIABLE,
@@ -44,7 +44,7 @@
  */
 
 #include "contiki-net.h"
-#if WITH_SWAP
+#if WITH_SWAP && !QUEUEBUF_SWAP_MAPPED
 #include "cfs/cfs.h"
 #endif
 
@@ -56,6 +56,32 @@
 #define QUEUEBUF_REF_NUM 2
 #endif
 
+/* With zero copy, the packetbuf uses the storage of a queuebuf in RAM
+   when the queuebuf is copied to the packetbuf, and the MAC layer
+   writes its headers in place in front of the queued data. This saves
+   copying the frame for every transmission attempt, at the cost of
+   PACKETBUF_HDR_SIZE bytes of header room in every queuebuf. */
+#ifdef QUEUEBUF_CONF_ZERO_COPY
+#define QUEUEBUF_ZERO_COPY QUEUEBUF_CONF_ZERO_COPY
+#else
+#define QUEUEBUF_ZERO_COPY 0
+#endif
+
+/* With a mapped swap, queuebufs are swapped to memory that the
+   platform maps from a file with queuebuf_swap_arch_map(), rather
+   than written to and read from CFS files. */
+#ifdef QUEUEBUF_CONF_SWAP_MAPPED
+#define QUEUEBUF_SWAP_MAPPED QUEUEBUF_CONF_SWAP_MAPPED
+#else
+#define QUEUEBUF_SWAP_MAPPED 0
+#endif
+
+#if QUEUEBUF_ZERO_COPY
+#define QUEUEBUF_HDR_ROOM PACKETBUF_HDR_SIZE
+#else
+#define QUEUEBUF_HDR_ROOM 0
+#endif
+
 /* Structure pointing to a buffer either stored
    in RAM or swapped in CFS */
 struct queuebuf {
@@ -79,7 +105,7 @@ struct queuebuf {
 /* The actual queuebuf data */
 struct queuebuf_data {
   uint16_t len;
-  uint8_t data[PACKETBUF_SIZE];
+  uint8_t data[QUEUEBUF_HDR_ROOM + PACKETBUF_SIZE];
   struct packetbuf_attr attrs[PACKETBUF_NUM_ATTRS];
   struct packetbuf_addr addrs[PACKETBUF_NUM_ADDRS];
 };
@@ -95,7 +121,19 @@ MEMB(bufmem, struct queuebuf, QUEUEBUF_NUM);
 MEMB(refbufmem, struct queuebuf_ref, QUEUEBUF_REF_NUM);
 MEMB(buframmem, struct queuebuf_data, QUEUEBUFRAM_NUM);
 
-#if WITH_SWAP
+#if WITH_SWAP && QUEUEBUF_SWAP_MAPPED
+
+/* The mapped swap is a ring of QUEUEBUF_NUM - QUEUEBUFRAM_NUM
+   queuebufs. The swap id of a queuebuf is its index in the ring. */
+#define NQBUF_ID (QUEUEBUF_NUM - QUEUEBUFRAM_NUM)
+
+static struct queuebuf_data *swap_area;
+/* Non-zero for the swap ids in use */
+static uint8_t swap_used[NQBUF_ID];
+/* Where the search for a free swap id starts */
+static int next_swap_id = 0;
+
+#elif WITH_SWAP
 
 /* Swapping allows to store up to QUEUEBUF_NUM - QUEUEBUFRAM_NUM
    queuebufs in CFS. The swap is made of several large CFS files.
@@ -125,6 +163,12 @@ static struct ctimer renew_timer;
 
 #endif
 
+#if QUEUEBUF_ZERO_COPY
+/* The data of a freed queuebuf that the packetbuf still uses. It is
+   given back to buframmem once the packetbuf has moved on. */
+static struct queuebuf_data *released;
+#endif /* QUEUEBUF_ZERO_COPY */
+
 #if QUEUEBUF_DEBUG
 #include "lib/list.h"
 LIST(queuebuf_list);
@@ -148,7 +192,51 @@ LIST(queuebuf_list);
 uint8_t queuebuf_len, queuebuf_ref_len, queuebuf_max_len;
 #endif /* QUEUEBUF_STATS */
 
-#if WITH_SWAP
+#if WITH_SWAP && QUEUEBUF_SWAP_MAPPED
+/*---------------------------------------------------------------------------*/
+static void
+queuebuf_remove_from_file(int swap_id)
+{
+  if(swap_id != -1) {
+    swap_used[swap_id] = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+get_new_swap_id(void)
+{
+  int i, swap_id;
+
+  if(swap_area == NULL) {
+    return -1;
+  }
+  for(i = 0; i < NQBUF_ID; i++) {
+    swap_id = next_swap_id;
+    next_swap_id = (next_swap_id + 1) % NQBUF_ID;
+    if(!swap_used[swap_id]) {
+      swap_used[swap_id] = 1;
+      return swap_id;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+/* The mapped swap is written in place, there is nothing to flush */
+static int
+queuebuf_flush_tmpdata(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static struct queuebuf_data *
+queuebuf_load_to_ram(struct queuebuf *b)
+{
+  if(b->location == IN_RAM) {
+    return b->ram_ptr;
+  }
+  return &swap_area[b->swap_id];
+}
+#elif WITH_SWAP
 /*---------------------------------------------------------------------------*/
 static void
 qbuf_renew_file(int file)
@@ -290,10 +378,48 @@ queuebuf_load_to_ram(struct queuebuf *b)
 }
 #endif /* WITH_SWAP */
 /*---------------------------------------------------------------------------*/
+#if QUEUEBUF_ZERO_COPY
+/* Free the released queuebuf data if the packetbuf no longer uses
+   it. If force is set, the packetbuf is made to stop using it. */
+static void
+collect_released(int force)
+{
+  if(released != NULL) {
+    if(packetbuf_is_shared(released->data)) {
+      if(!force) {
+        return;
+      }
+      packetbuf_unshare();
+    }
+    memb_free(&buframmem, released);
+    released = NULL;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Whether the data of a queuebuf is in RAM and can be shared with
+   the packetbuf */
+static int
+is_shareable(struct queuebuf *b)
+{
+#if WITH_SWAP
+  return b->location == IN_RAM;
+#else
+  return 1;
+#endif
+}
+#endif /* QUEUEBUF_ZERO_COPY */
+/*---------------------------------------------------------------------------*/
 void
 queuebuf_init(void)
 {
-#if WITH_SWAP
+#if WITH_SWAP && QUEUEBUF_SWAP_MAPPED
+  swap_area = queuebuf_swap_arch_map(NQBUF_ID * sizeof(struct queuebuf_data));
+  if(swap_area == NULL) {
+    PRINTF("queuebuf_init: could not map the swap\n");
+  }
+  memset(swap_used, 0, sizeof(swap_used));
+  next_swap_id = 0;
+#elif WITH_SWAP
   int i;
   for(i=0; i<NQBUF_FILES; i++) {
     qbuf_files[i].renewable = 1;
@@ -303,6 +429,9 @@ queuebuf_init(void)
   memb_init(&buframmem);
   memb_init(&bufmem);
   memb_init(&refbufmem);
+#if QUEUEBUF_ZERO_COPY
+  released = NULL;
+#endif /* QUEUEBUF_ZERO_COPY */
 #if QUEUEBUF_STATS
   queuebuf_max_len = QUEUEBUF_NUM;
 #endif /* QUEUEBUF_STATS */
@@ -342,7 +471,17 @@ queuebuf_new_from_packetbuf(void)
       buf->line = line;
       buf->time = clock_time();
 #endif /* QUEUEBUF_DEBUG */
+#if QUEUEBUF_ZERO_COPY
+      collect_released(0);
       buf->ram_ptr = memb_alloc(&buframmem);
+      if(buf->ram_ptr == NULL && released != NULL) {
+        /* Take back the data that the packetbuf holds on to */
+        collect_released(1);
+        buf->ram_ptr = memb_alloc(&buframmem);
+      }
+#else /* QUEUEBUF_ZERO_COPY */
+      buf->ram_ptr = memb_alloc(&buframmem);
+#endif /* QUEUEBUF_ZERO_COPY */
 #if WITH_SWAP
       /* If the allocation failed, store the qbuf in swap files */
       if(buf->ram_ptr != NULL) {
@@ -350,9 +489,19 @@ queuebuf_new_from_packetbuf(void)
         buframptr = buf->ram_ptr;
       } else {
         buf->location = IN_CFS;
+#if QUEUEBUF_SWAP_MAPPED
+        buf->swap_id = get_new_swap_id();
+        if(buf->swap_id == -1) {
+          PRINTF("queuebuf_new_from_packetbuf: swap full\n");
+          memb_free(&bufmem, buf);
+          return NULL;
+        }
+        buframptr = &swap_area[buf->swap_id];
+#else /* QUEUEBUF_SWAP_MAPPED */
         buf->swap_id = -1;
         tmpdata_qbuf = buf;
         buframptr = &tmpdata;
+#endif /* QUEUEBUF_SWAP_MAPPED */
       }
 #else
       if(buf->ram_ptr == NULL) {
@@ -362,7 +511,7 @@ queuebuf_new_from_packetbuf(void)
       buframptr = buf->ram_ptr;
 #endif
 
-      buframptr->len = packetbuf_copyto(buframptr->data);
+      buframptr->len = packetbuf_copyto(&buframptr->data[QUEUEBUF_HDR_ROOM]);
       packetbuf_attr_copyto(buframptr->attrs, buframptr->addrs);
 
 #if WITH_SWAP
@@ -409,6 +558,17 @@ void
 queuebuf_free(struct queuebuf *buf)
 {
   if(memb_inmemb(&bufmem, buf)) {
+#if QUEUEBUF_ZERO_COPY
+    if(is_shareable(buf)) {
+      collect_released(0);
+      if(packetbuf_is_shared(buf->ram_ptr->data)) {
+        /* The packetbuf still uses the data, free it later on */
+        released = buf->ram_ptr;
+      } else {
+        memb_free(&buframmem, buf->ram_ptr);
+      }
+    } else
+#endif /* QUEUEBUF_ZERO_COPY */
 #if WITH_SWAP
     if(buf->location == IN_RAM) {
       memb_free(&buframmem, buf->ram_ptr);
@@ -440,7 +600,16 @@ queuebuf_to_packetbuf(struct queuebuf *b)
   struct queuebuf_ref *r;
   if(memb_inmemb(&bufmem, b)) {
     struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
+#if QUEUEBUF_ZERO_COPY
+    if(is_shareable(b)) {
+      packetbuf_share(buframptr->data, buframptr->len);
+      collect_released(0);
+    } else {
+      packetbuf_copyfrom(&buframptr->data[QUEUEBUF_HDR_ROOM], buframptr->len);
+    }
+#else /* QUEUEBUF_ZERO_COPY */
     packetbuf_copyfrom(buframptr->data, buframptr->len);
+#endif /* QUEUEBUF_ZERO_COPY */
     packetbuf_attr_copyfrom(buframptr->attrs, buframptr->addrs);
   } else if(memb_inmemb(&refbufmem, b)) {
     r = (struct queuebuf_ref *)b;
@@ -458,7 +627,7 @@ queuebuf_dataptr(struct queuebuf *b)
 
   if(memb_inmemb(&bufmem, b)) {
     struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
-    return buframptr->data;
+    return &buframptr->data[QUEUEBUF_HDR_ROOM];
   } else if(memb_inmemb(&refbufmem, b)) {
     r = (struct queuebuf_ref *)b;
     return r->ref;
@@ -488,6 +657,18 @@ queuebuf_attr(struct queuebuf *b, uint8_t type)
 }
 /*---------------------------------------------------------------------------*/
 void
+queuebuf_set_attr(struct queuebuf *b, uint8_t type, packetbuf_attr_t val)
+{
+  struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
+  buframptr->attrs[type].val = val;
+#if WITH_SWAP
+  if(b->location == IN_CFS) {
+    queuebuf_flush_tmpdata();
+  }
+#endif
+}
+/*---------------------------------------------------------------------------*/
+void
 queuebuf_debug_print(void)
 {
 #if QUEUEBUF_DEBUG
@@ -106,9 +106,14 @@ int queuebuf_datalen(struct queuebuf *b);
 
 rimeaddr_t *queuebuf_addr(struct queuebuf *b, uint8_t type);
 packetbuf_attr_t queuebuf_attr(struct queuebuf *b, uint8_t type);
+void queuebuf_set_attr(struct queuebuf *b, uint8_t type, packetbuf_attr_t val);
 
 void queuebuf_debug_print(void);
 
+/* Platforms that set QUEUEBUF_CONF_SWAP_MAPPED provide the memory
+   that queuebufs are swapped to. Returns NULL on failure. */
+void *queuebuf_swap_arch_map(unsigned long size);
+
 #endif /* __QUEUEBUF_H__ */
 
 /** @} */
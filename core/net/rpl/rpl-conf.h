@@ -66,6 +66,58 @@
 #define RPL_OF rpl_of_etx
 #endif /* RPL_CONF_OF */
 
+/*
+ * The objective functions that a node can join a DAG with, as a
+ * comma-separated list of rpl_of_t objects. RPL_OF is always used for
+ * DAGs that the node creates itself.
+ */
+#ifdef RPL_CONF_SUPPORTED_OFS
+#define RPL_SUPPORTED_OFS RPL_CONF_SUPPORTED_OFS
+#else
+#define RPL_SUPPORTED_OFS &RPL_OF
+#endif /* RPL_CONF_SUPPORTED_OFS */
+
+/*
+ * Default objective function parameters of new instances. The
+ * hysteresis is given in the fixed point format of the ETX object,
+ * in which 128 means one transmission.
+ */
+#ifdef RPL_CONF_OF_HYSTERESIS
+#define RPL_OF_HYSTERESIS RPL_CONF_OF_HYSTERESIS
+#else
+#define RPL_OF_HYSTERESIS 64
+#endif /* RPL_CONF_OF_HYSTERESIS */
+
+#ifdef RPL_CONF_OF_ETX_WEIGHT
+#define RPL_OF_ETX_WEIGHT RPL_CONF_OF_ETX_WEIGHT
+#else
+#define RPL_OF_ETX_WEIGHT 1
+#endif /* RPL_CONF_OF_ETX_WEIGHT */
+
+#ifdef RPL_CONF_OF_ENERGY_WEIGHT
+#define RPL_OF_ENERGY_WEIGHT RPL_CONF_OF_ENERGY_WEIGHT
+#else
+#define RPL_OF_ENERGY_WEIGHT 1
+#endif /* RPL_CONF_OF_ENERGY_WEIGHT */
+
+#ifdef RPL_CONF_OF_HOPCOUNT_WEIGHT
+#define RPL_OF_HOPCOUNT_WEIGHT RPL_CONF_OF_HOPCOUNT_WEIGHT
+#else
+#define RPL_OF_HOPCOUNT_WEIGHT 0
+#endif /* RPL_CONF_OF_HOPCOUNT_WEIGHT */
+
+/*
+ * The radio on-time, in seconds, that the battery of a node lasts for.
+ * The MRHOF objective function derives the residual energy of the node
+ * from this budget and the radio on-time measured by energest. Nodes
+ * with a budget of 0 are considered mains powered.
+ */
+#ifdef RPL_CONF_OF_ENERGY_BUDGET
+#define RPL_OF_ENERGY_BUDGET RPL_CONF_OF_ENERGY_BUDGET
+#else
+#define RPL_OF_ENERGY_BUDGET 0
+#endif /* RPL_CONF_OF_ENERGY_BUDGET */
+
 /* This value decides which DAG instance we should participate in by default. */
 #ifdef RPL_CONF_DEFAULT_INSTANCE
 #define RPL_DEFAULT_INSTANCE RPL_CONF_DEFAULT_INSTANCE
@@ -83,6 +135,17 @@
 #define RPL_LEAF_ONLY 0
 #endif
 
+/*
+ * Whether DIOs carry the 6LoWPAN address contexts of the network, so
+ * that contexts set on the border router reach every node. Needs IPHC
+ * header compression and must be enabled on all nodes.
+ */
+#ifdef RPL_CONF_WITH_CONTEXTS
+#define RPL_WITH_CONTEXTS RPL_CONF_WITH_CONTEXTS
+#else
+#define RPL_WITH_CONTEXTS 0
+#endif /* RPL_CONF_WITH_CONTEXTS */
+
 /*
  * Maximum of concurent RPL instances.
  */
@@ -101,6 +164,45 @@
 #define RPL_MAX_DAG_PER_INSTANCE     2
 #endif /* RPL_CONF_MAX_DAG_PER_INSTANCE */
 
+/*
+ * Number of buckets in the per instance hash that indexes the parents
+ * of all DAGs of an instance by their address.
+ */
+#ifdef RPL_CONF_PARENT_HASH_SIZE
+#define RPL_PARENT_HASH_SIZE         RPL_CONF_PARENT_HASH_SIZE
+#else
+#define RPL_PARENT_HASH_SIZE         8
+#endif /* RPL_CONF_PARENT_HASH_SIZE */
+
+/*
+ * Number of DAO targets, of this node and of its descendants, that
+ * can wait to be advertised to the preferred parent or for a DAO ACK.
+ */
+#ifdef RPL_CONF_DAO_MAX_TARGETS
+#define RPL_DAO_MAX_TARGETS          RPL_CONF_DAO_MAX_TARGETS
+#else
+#define RPL_DAO_MAX_TARGETS          8
+#endif /* RPL_CONF_DAO_MAX_TARGETS */
+
+/*
+ * Maximum number of targets aggregated into one DAO.
+ */
+#ifdef RPL_CONF_DAO_MAX_AGGREGATE
+#define RPL_DAO_MAX_AGGREGATE        RPL_CONF_DAO_MAX_AGGREGATE
+#else
+#define RPL_DAO_MAX_AGGREGATE        4
+#endif /* RPL_CONF_DAO_MAX_AGGREGATE */
+
+/*
+ * Number of times a target is advertised without a DAO ACK before
+ * it is given up. Only used with RPL_CONF_DAO_ACK.
+ */
+#ifdef RPL_CONF_DAO_MAX_TRANSMISSIONS
+#define RPL_DAO_MAX_TRANSMISSIONS    RPL_CONF_DAO_MAX_TRANSMISSIONS
+#else
+#define RPL_DAO_MAX_TRANSMISSIONS    3
+#endif /* RPL_CONF_DAO_MAX_TRANSMISSIONS */
+
 /*
  * 
  */
@@ -48,6 +48,9 @@
 #include "lib/list.h"
 #include "lib/memb.h"
 #include "sys/ctimer.h"
+#if RPL_WITH_CONTEXTS
+#include "net/sicslowpan.h"
+#endif /* RPL_WITH_CONTEXTS */
 
 #include <limits.h>
 #include <string.h>
@@ -59,7 +62,10 @@
 
 /************************************************************************/
 extern rpl_of_t RPL_OF;
-static rpl_of_t * const objective_functions[] = {&RPL_OF};
+extern rpl_of_t rpl_of0;
+extern rpl_of_t rpl_of_etx;
+extern rpl_of_t rpl_of_mrhof;
+static rpl_of_t * const objective_functions[] = {RPL_SUPPORTED_OFS};
 
 /************************************************************************/
 #ifndef RPL_CONF_MAX_PARENTS_PER_DAG
@@ -68,6 +74,15 @@ static rpl_of_t * const objective_functions[] = {&RPL_OF};
 #define RPL_MAX_PARENTS_PER_DAG       RPL_CONF_MAX_PARENTS_PER_DAG
 #endif /* !RPL_CONF_MAX_PARENTS_PER_DAG */
 
+/* Number of parents that can wait for a rank recalculation. If more
+   parents are updated between two recalculations, all parents are
+   swept for their updated flag instead. */
+#ifndef RPL_CONF_MAX_DIRTY_PARENTS
+#define RPL_MAX_DIRTY_PARENTS         RPL_MAX_PARENTS_PER_DAG
+#else
+#define RPL_MAX_DIRTY_PARENTS         RPL_CONF_MAX_DIRTY_PARENTS
+#endif /* !RPL_CONF_MAX_DIRTY_PARENTS */
+
 /************************************************************************/
 /* RPL definitions. */
 
@@ -86,6 +101,77 @@ MEMB(parent_memb, struct rpl_parent,
 rpl_instance_t instance_table[RPL_MAX_INSTANCES];
 rpl_instance_t *default_instance;
 /************************************************************************/
+/* Parents whose rank must be recalculated. */
+static rpl_parent_t *dirty_parents[RPL_MAX_DIRTY_PARENTS];
+static uint8_t dirty_count;
+static uint8_t dirty_overflow;
+/************************************************************************/
+/* The parents of all DAGs of an instance are indexed by the last bytes */
+/* of their address, which is the interface identifier of the neighbor. */
+/************************************************************************/
+static unsigned
+parent_hash(uip_ipaddr_t *addr)
+{
+  return (addr->u8[14] ^ addr->u8[15]) % RPL_PARENT_HASH_SIZE;
+}
+/************************************************************************/
+static void
+hash_parent(rpl_instance_t *instance, rpl_parent_t *parent)
+{
+  rpl_parent_t **bucket;
+
+  bucket = &instance->parent_hash[parent_hash(&parent->addr)];
+  parent->hash_next = *bucket;
+  *bucket = parent;
+}
+/************************************************************************/
+static void
+unhash_parent(rpl_instance_t *instance, rpl_parent_t *parent)
+{
+  rpl_parent_t **pp;
+
+  for(pp = &instance->parent_hash[parent_hash(&parent->addr)];
+      *pp != NULL; pp = &(*pp)->hash_next) {
+    if(*pp == parent) {
+      *pp = parent->hash_next;
+      return;
+    }
+  }
+}
+/************************************************************************/
+/* An address is a parent in at most one DAG of an instance.            */
+/************************************************************************/
+static rpl_parent_t *
+lookup_parent(rpl_instance_t *instance, uip_ipaddr_t *addr)
+{
+  rpl_parent_t *p;
+
+  for(p = instance->parent_hash[parent_hash(addr)]; p != NULL;
+      p = p->hash_next) {
+    if(uip_ipaddr_cmp(&p->addr, addr)) {
+      return p;
+    }
+  }
+  return NULL;
+}
+/************************************************************************/
+static void
+unqueue_parent(rpl_parent_t *parent)
+{
+  uint8_t i;
+
+  if(!parent->updated) {
+    return;
+  }
+  parent->updated = 0;
+  for(i = 0; i < dirty_count; i++) {
+    if(dirty_parents[i] == parent) {
+      dirty_parents[i] = dirty_parents[--dirty_count];
+      return;
+    }
+  }
+}
+/************************************************************************/
 /* Greater-than function for the lollipop counter.                      */
 /************************************************************************/
 static int
@@ -236,11 +322,10 @@ rpl_set_root(uint8_t instance_id, uip_ipaddr_t *dag_id)
 
   instance->dio_intdoubl = RPL_DIO_INTERVAL_DOUBLINGS;
   instance->dio_intmin = RPL_DIO_INTERVAL_MIN;
-  /* The current interval must differ from the minimum interval in order to
-     trigger a DIO timer reset. */
-  instance->dio_intcurrent = RPL_DIO_INTERVAL_MIN +
-    RPL_DIO_INTERVAL_DOUBLINGS;
   instance->dio_redundancy = RPL_DIO_REDUNDANCY;
+  /* The timer starts at its maximum interval, which differs from the
+     minimum interval in order to trigger a DIO timer reset. */
+  rpl_init_dio_timer(instance);
   instance->max_rankinc = RPL_MAX_RANKINC;
   instance->min_hoprankinc = RPL_MIN_HOPRANKINC;
   instance->default_lifetime = RPL_DEFAULT_LIFETIME;
@@ -350,6 +435,49 @@ rpl_set_prefix(rpl_dag_t *dag, uip_ipaddr_t *prefix, unsigned len)
   return 1;
 }
 /************************************************************************/
+#if RPL_WITH_CONTEXTS
+int
+rpl_set_context(rpl_dag_t *dag, uint8_t cid, uip_ipaddr_t *prefix,
+                unsigned len, uint16_t lifetime)
+{
+  if(dag->instance == NULL || dag->rank != ROOT_RANK(dag->instance) ||
+     cid > 15 || len > 128) {
+    return 0;
+  }
+
+  if(!sicslowpan_context_set(cid, prefix->u8, len,
+                             SICSLOWPAN_CONTEXT_COMPRESS, lifetime)) {
+    return 0;
+  }
+  PRINTF("RPL: Context %u set - will announce it in DIOs\n", cid);
+  rpl_reset_dio_timer(dag->instance);
+  return 1;
+}
+#endif /* RPL_WITH_CONTEXTS */
+/************************************************************************/
+void
+rpl_set_of_params(rpl_instance_t *instance, const struct rpl_of_params *params)
+{
+  rpl_dag_t *dag;
+
+  instance->of_params = *params;
+  PRINTF("RPL: OF parameters set - hysteresis %u, weights %u/%u/%u\n",
+         params->hysteresis, params->etx_weight, params->energy_weight,
+         params->hopcount_weight);
+
+  dag = instance->current_dag;
+  if(dag == NULL || !dag->used) {
+    return;
+  }
+  /* Advertise the objects that now have a weight, and let the next rank
+     recalculation redo the parent selection with the new path costs. */
+  instance->of->update_metric_container(instance);
+  if(dag->preferred_parent != NULL) {
+    rpl_parent_updated(dag->preferred_parent);
+  }
+  rpl_reset_dio_timer(instance);
+}
+/************************************************************************/
 int
 rpl_set_default_route(rpl_instance_t *instance, uip_ipaddr_t *from)
 {
@@ -387,6 +515,10 @@ rpl_alloc_instance(uint8_t instance_id)
       memset(instance, 0, sizeof(*instance));
       instance->instance_id = instance_id;
       instance->def_route = NULL;
+      instance->of_params.hysteresis = RPL_OF_HYSTERESIS;
+      instance->of_params.etx_weight = RPL_OF_ETX_WEIGHT;
+      instance->of_params.energy_weight = RPL_OF_ENERGY_WEIGHT;
+      instance->of_params.hopcount_weight = RPL_OF_HOPCOUNT_WEIGHT;
       instance->used = 1;
       return instance;
     }
@@ -449,7 +581,7 @@ rpl_free_instance(rpl_instance_t *instance)
 
   rpl_set_default_route(instance, NULL);
 
-  ctimer_stop(&instance->dio_timer);
+  trickle_timer_stop(&instance->dio_trickle);
   ctimer_stop(&instance->dao_timer);
 
   if(default_instance == instance) {
@@ -462,6 +594,8 @@ rpl_free_instance(rpl_instance_t *instance)
 void
 rpl_free_dag(rpl_dag_t *dag)
 {
+  rpl_parent_t *p;
+
   if(dag->joined) {
     PRINTF("RPL: Leaving the DAG ");
     PRINT6ADDR(&dag->dag_id);
@@ -477,6 +611,13 @@ rpl_free_dag(rpl_dag_t *dag)
     }
 
     remove_parents(dag, 0);
+  } else {
+    /* Release the candidate parents of a DAG that was never joined. */
+    while((p = list_pop(dag->parents)) != NULL) {
+      unqueue_parent(p);
+      unhash_parent(dag->instance, p);
+      memb_free(&parent_memb, p);
+    }
   }
   dag->used = 0;
 }
@@ -500,8 +641,10 @@ rpl_add_parent(rpl_dag_t *dag, rpl_dio_t *dio, uip_ipaddr_t *addr)
   p->rank = dio->rank;
   p->dtsn = dio->dtsn;
   p->link_metric = INITIAL_LINK_METRIC;
+  p->updated = 0;
   memcpy(&p->mc, &dio->mc, sizeof(p->mc));
   list_add(dag->parents, p);
+  hash_parent(dag->instance, p);
   return p;
 }
 /************************************************************************/
@@ -510,10 +653,9 @@ rpl_find_parent(rpl_dag_t *dag, uip_ipaddr_t *addr)
 {
   rpl_parent_t *p;
 
-  for(p = list_head(dag->parents); p != NULL; p = p->next) {
-    if(uip_ipaddr_cmp(&p->addr, addr)) {
-      return p;
-    }
+  p = lookup_parent(dag->instance, addr);
+  if(p != NULL && p->dag == dag) {
+    return p;
   }
   return NULL;
 }
@@ -523,36 +665,15 @@ static rpl_dag_t *
 find_parent_dag(rpl_instance_t *instance, uip_ipaddr_t *addr)
 {
   rpl_parent_t *p;
-  rpl_dag_t *dag, *end;
 
-  for(dag = &instance->dag_table[0], end = dag + RPL_MAX_DAG_PER_INSTANCE; dag < end; ++dag) {
-    if(dag->used) {
-      for(p = list_head(dag->parents); p != NULL; p = p->next) {
-        if(uip_ipaddr_cmp(&p->addr, addr)) {
-          return dag;
-        }
-      }
-    }
-  }
-  return NULL;
+  p = lookup_parent(instance, addr);
+  return p != NULL ? p->dag : NULL;
 }
 /************************************************************************/
 rpl_parent_t *
 rpl_find_parent_any_dag(rpl_instance_t *instance, uip_ipaddr_t *addr)
 {
-  rpl_parent_t *p;
-  rpl_dag_t *dag, *end;
-
-  for(dag = &instance->dag_table[0], end = dag + RPL_MAX_DAG_PER_INSTANCE; dag < end; ++dag) {
-    if(dag->used) {
-      for(p = list_head(dag->parents); p != NULL; p = p->next) {
-        if(uip_ipaddr_cmp(&p->addr, addr)) {
-          return p;
-        }
-      }
-    }
-  }
-  return NULL;
+  return lookup_parent(instance, addr);
 }
 /************************************************************************/
 rpl_dag_t *
@@ -679,6 +800,8 @@ rpl_remove_parent(rpl_dag_t *dag, rpl_parent_t *parent)
   PRINTF("\n");
 
   list_remove(dag->parents, parent);
+  unqueue_parent(parent);
+  unhash_parent(dag->instance, parent);
   memb_free(&parent_memb, parent);
 }
 /************************************************************************/
@@ -837,8 +960,8 @@ rpl_join_instance(uip_ipaddr_t *from, rpl_dio_t *dio)
   instance->min_hoprankinc = dio->dag_min_hoprankinc;
   instance->dio_intdoubl = dio->dag_intdoubl;
   instance->dio_intmin = dio->dag_intmin;
-  instance->dio_intcurrent = instance->dio_intmin + instance->dio_intdoubl;
   instance->dio_redundancy = dio->dag_redund;
+  rpl_init_dio_timer(instance);
   instance->default_lifetime = dio->default_lifetime;
   instance->lifetime_unit = dio->lifetime_unit;
 
@@ -1001,9 +1124,79 @@ rpl_local_repair(rpl_instance_t *instance)
 }
 /************************************************************************/
 void
+rpl_parent_updated(rpl_parent_t *p)
+{
+  if(p->updated) {
+    return;
+  }
+  p->updated = 1;
+  if(dirty_count < RPL_MAX_DIRTY_PARENTS) {
+    dirty_parents[dirty_count++] = p;
+  } else {
+    dirty_overflow = 1;
+  }
+}
+/************************************************************************/
+/*
+ * Check an updated parent against the rank bounds of its DAG. Returns
+ * non-zero if the DAG needs a new parent selection as a consequence.
+ */
+static int
+check_parent(rpl_parent_t *p)
+{
+  p->updated = 0;
+  if(!acceptable_rank(p->dag, p->rank)) {
+    /* The candidate parent is no longer valid: the rank increase resulting
+       from the choice of it as a parent would be too high. */
+    PRINTF("RPL: Unacceptable rank %u\n", (unsigned)p->rank);
+    if(p != p->dag->instance->current_dag->preferred_parent) {
+      rpl_nullify_parent(p->dag, p);
+      return 0;
+    }
+    rpl_nullify_parent(p->dag, p);
+  }
+  return 1;
+}
+/************************************************************************/
+static int
+update_dag(rpl_instance_t *instance, rpl_parent_t *p)
+{
+  rpl_rank_t old_rank;
+
+  old_rank = instance->current_dag->rank;
+
+  if(rpl_select_dag(instance, p) == NULL) {
+    /* No suitable parent; trigger a local repair. */
+    PRINTF("RPL: No parents found in any DAG\n");
+    rpl_local_repair(instance);
+    return 0;
+  }
+
+#if DEBUG
+  if(DAG_RANK(old_rank, instance) != DAG_RANK(instance->current_dag->rank, instance)) {
+    PRINTF("RPL: Moving in the instance from rank %hu to %hu\n",
+	   DAG_RANK(old_rank, instance), DAG_RANK(instance->current_dag->rank, instance));
+    if(instance->current_dag->rank != INFINITE_RANK) {
+      PRINTF("RPL: The preferred parent is ");
+      PRINT6ADDR(&instance->current_dag->preferred_parent->addr);
+      PRINTF(" (rank %u)\n",
+           (unsigned)DAG_RANK(instance->current_dag->preferred_parent->rank, instance));
+    } else {
+      PRINTF("RPL: We don't have any parent");
+    }
+  }
+#endif /* DEBUG */
+
+  return 1;
+}
+/************************************************************************/
+void
 rpl_recalculate_ranks(void)
 {
+  /* One parent per DAG that needs a new parent and DAG selection. */
+  rpl_parent_t *selection[RPL_MAX_INSTANCES * RPL_MAX_DAG_PER_INSTANCE];
   rpl_instance_t *instance, *end;
+  rpl_dag_t *dag;
   rpl_parent_t *p;
   int i;
 
@@ -1011,38 +1204,59 @@ rpl_recalculate_ranks(void)
    * We recalculate ranks when we receive feedback from the system rather
    * than RPL protocol messages. This periodical recalculation is called
    * from a timer in order to keep the stack depth reasonably low.
+   *
+   * All parents that have been updated since the last call are checked
+   * first, and then each affected DAG goes through a single parent and
+   * DAG selection.
    */
-  for(instance = &instance_table[0], end = instance + RPL_MAX_INSTANCES; instance < end; ++instance) {
-    if(instance->used) {
-      for(i = 0; i < RPL_MAX_DAG_PER_INSTANCE; i++) {
-        if(instance->dag_table[i].used) {
-          for(p = list_head(instance->dag_table[i].parents); p != NULL; p = p->next) {
-            if(p->updated) {
-              p->updated = 0;
-              if(!rpl_process_parent_event(instance, p)) {
-                PRINTF("RPL: A parent was dropped\n");
+  memset(selection, 0, sizeof(selection));
+
+  if(dirty_overflow) {
+    /* The queue has overflowed: sweep for the updated flag. */
+    for(instance = &instance_table[0], end = instance + RPL_MAX_INSTANCES; instance < end; ++instance) {
+      if(instance->used) {
+        for(i = 0; i < RPL_MAX_DAG_PER_INSTANCE; i++) {
+          dag = &instance->dag_table[i];
+          if(dag->used) {
+            for(p = list_head(dag->parents); p != NULL; p = p->next) {
+              if(p->updated && check_parent(p)) {
+                selection[(instance - instance_table) * RPL_MAX_DAG_PER_INSTANCE + i] = p;
               }
-	      /*
-	       * Stop calculating here because the parent list may have changed.
-	       * If more ranks need to be recalculated, it will be taken care of
-	       * in subsequent calls to this functions.
-	       */
-              break;
             }
           }
         }
       }
     }
+    dirty_overflow = 0;
+  } else {
+    for(i = 0; i < dirty_count; i++) {
+      p = dirty_parents[i];
+      if(check_parent(p)) {
+        instance = p->dag->instance;
+        selection[(instance - instance_table) * RPL_MAX_DAG_PER_INSTANCE +
+                  (p->dag - instance->dag_table)] = p;
+      }
+    }
+  }
+  dirty_count = 0;
+
+  /* Parents are only nullified above, never removed, so the selected
+     parent pointers remain valid. */
+  for(i = 0; i < RPL_MAX_INSTANCES * RPL_MAX_DAG_PER_INSTANCE; i++) {
+    p = selection[i];
+    if(p != NULL && p->dag->used) {
+      if(!update_dag(p->dag->instance, p)) {
+        PRINTF("RPL: A parent was dropped\n");
+      }
+    }
   }
 }
 /************************************************************************/
 int
 rpl_process_parent_event(rpl_instance_t *instance, rpl_parent_t *p)
 {
-  rpl_rank_t old_rank;
   int return_value;
 
-  old_rank = instance->current_dag->rank;
   return_value = 1;
 
   if(!acceptable_rank(p->dag, p->rank)) {
@@ -1058,29 +1272,52 @@ rpl_process_parent_event(rpl_instance_t *instance, rpl_parent_t *p)
     }
   }
 
-  if(rpl_select_dag(instance, p) == NULL) {
-    /* No suitable parent; trigger a local repair. */
-    PRINTF("RPL: No parents found in any DAG\n");
-    rpl_local_repair(instance);
+  if(!update_dag(instance, p)) {
     return 0;
   }
+  return return_value;
+}
+/************************************************************************/
+int
+rpl_process_redundant_dio(uip_ipaddr_t *from, rpl_dio_t *dio)
+{
+  rpl_instance_t *instance;
+  rpl_dag_t *dag;
+  rpl_parent_t *p;
 
-#if DEBUG
-  if(DAG_RANK(old_rank, instance) != DAG_RANK(instance->current_dag->rank, instance)) {
-    PRINTF("RPL: Moving in the instance from rank %hu to %hu\n",
-	   DAG_RANK(old_rank, instance), DAG_RANK(instance->current_dag->rank, instance));
-    if(instance->current_dag->rank != INFINITE_RANK) {
-      PRINTF("RPL: The preferred parent is ");
-      PRINT6ADDR(&instance->current_dag->preferred_parent->addr);
-      PRINTF(" (rank %u)\n",
-           (unsigned)DAG_RANK(instance->current_dag->preferred_parent->rank, instance));
-    } else {
-      PRINTF("RPL: We don't have any parent");
-    }
+  /* Only the base object and the metric container of the DIO have been
+     decoded. The DIO is redundant if rpl_process_dio() would do no more
+     than count it as consistent. */
+  if(dio->mop != RPL_MOP_DEFAULT || dio->rank == INFINITE_RANK) {
+    return 0;
   }
-#endif /* DEBUG */
 
-  return return_value;
+  instance = rpl_get_instance(dio->instance_id);
+  if(instance == NULL) {
+    return 0;
+  }
+
+  /* DIOs of the other DAGs of the instance may make one of them
+     preferable, so only those of the current DAG are short-cut. */
+  dag = get_dag(dio->instance_id, &dio->dag_id);
+  if(dag == NULL || dag != instance->current_dag ||
+     dag->version != dio->version || dio->rank < ROOT_RANK(instance)) {
+    return 0;
+  }
+
+  if(dag->rank == ROOT_RANK(instance)) {
+    trickle_timer_consistent(&instance->dio_trickle);
+    return 1;
+  }
+
+  p = rpl_find_parent(dag, from);
+  if(p == NULL || p->rank != dio->rank || p->dtsn != dio->dtsn ||
+     memcmp(&p->mc, &dio->mc, sizeof(p->mc)) != 0) {
+    return 0;
+  }
+
+  trickle_timer_consistent(&instance->dio_trickle);
+  return 1;
 }
 /************************************************************************/
 void
@@ -1147,7 +1384,7 @@ rpl_process_dio(uip_ipaddr_t *from, rpl_dio_t *dio)
 
   if(dag->rank == ROOT_RANK(instance)) {
     if(dio->rank != INFINITE_RANK) {
-      instance->dio_counter++;
+      trickle_timer_consistent(&instance->dio_trickle);
     }
     return;
   }
@@ -1188,7 +1425,7 @@ rpl_process_dio(uip_ipaddr_t *from, rpl_dio_t *dio)
     if(p->rank == dio->rank) {
       PRINTF("RPL: Received consistent DIO\n");
       if(dag->joined) {
-        instance->dio_counter++;
+        trickle_timer_consistent(&instance->dio_trickle);
       }
     } else {
       p->rank=dio->rank;
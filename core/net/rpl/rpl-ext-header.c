@@ -45,7 +45,9 @@
 #include "net/uip.h"
 #include "net/tcpip.h"
 #include "net/uip-ds6.h"
+#include "net/uip-icmp6.h"
 #include "net/rpl/rpl-private.h"
+#include "net/rpl/rpl-ns.h"
 
 #define DEBUG DEBUG_NONE
 #include "net/uip-debug.h"
@@ -61,6 +63,17 @@
 #define UIP_EXT_HDR_OPT_BUF       ((struct uip_ext_hdr_opt *)&uip_buf[uip_l2_l3_hdr_len + uip_ext_opt_offset])
 #define UIP_EXT_HDR_OPT_PADN_BUF  ((struct uip_ext_hdr_opt_padn *)&uip_buf[uip_l2_l3_hdr_len + uip_ext_opt_offset])
 #define UIP_EXT_HDR_OPT_RPL_BUF   ((struct uip_ext_hdr_opt_rpl *)&uip_buf[uip_l2_l3_hdr_len + uip_ext_opt_offset])
+#define UIP_RH_BUF                ((struct uip_routing_hdr *)&uip_buf[uip_l2_l3_hdr_len])
+#define UIP_SRH_BUF               ((uint8_t *)&uip_buf[uip_l2_l3_hdr_len])
+
+/* Source Routing Header (RFC 6554) */
+#define RPL_RH_TYPE_SRH           3
+#define RPL_SRH_CMPR_OFFSET       4
+#define RPL_SRH_PAD_OFFSET        5
+#define RPL_SRH_ADDR_OFFSET       8
+/* Offsets of the fields that ICMP errors point to */
+#define RPL_SRH_LEN_OFFSET        1
+#define RPL_SRH_SEG_LEFT_OFFSET   3
 /************************************************************************/
 int
 rpl_verify_header(int uip_ext_opt_offset)
@@ -293,3 +306,326 @@ rpl_invert_header(void)
   }
 }
 /************************************************************************/
+#if RPL_WITH_NON_STORING
+/************************************************************************/
+static rpl_dag_t *
+get_ns_root_dag(void)
+{
+  rpl_dag_t *dag;
+
+  if(default_instance == NULL || !default_instance->used ||
+     default_instance->mop != RPL_MOP_NON_STORING) {
+    return NULL;
+  }
+  dag = default_instance->current_dag;
+  if(dag == NULL || !dag->joined ||
+     dag->rank != ROOT_RANK(default_instance)) {
+    return NULL;
+  }
+  return dag;
+}
+/************************************************************************/
+static uint8_t
+common_prefix_len(uip_ipaddr_t *a, uip_ipaddr_t *b)
+{
+  uint8_t i;
+
+  /* At most 15 octets can be elided. */
+  for(i = 0; i < 15 && a->u8[i] == b->u8[i]; i++);
+  return i;
+}
+#endif /* RPL_WITH_NON_STORING */
+/************************************************************************/
+int
+rpl_insert_srh_header(void)
+{
+#if RPL_WITH_NON_STORING
+  rpl_dag_t *dag;
+  rpl_ns_node_t *dest_node;
+  rpl_ns_node_t *node;
+  uip_ipaddr_t addr;
+  uip_ipaddr_t first_hop;
+  uint8_t *hops;
+  uint8_t cmpri, cmpre;
+  uint8_t pad;
+  uint8_t temp_len;
+  int path_len;
+  int srh_len;
+  int last_uip_ext_len;
+  int i;
+
+  dag = get_ns_root_dag();
+  if(dag == NULL) {
+    return 1;
+  }
+
+  dest_node = rpl_ns_get_node(dag, &UIP_IP_BUF->destipaddr);
+  if(dest_node == NULL) {
+    /* Not in the DAG, routed as usual. */
+    return 1;
+  }
+
+  path_len = rpl_ns_path_length(dest_node);
+  if(path_len == 0) {
+    PRINTF("RPL: No source route to ");
+    PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+    PRINTF("\n");
+    return 0;
+  }
+  if(path_len == 1) {
+    /* A child of the root, no routing header needed. */
+    return 1;
+  }
+
+  /* Find the first hop and how many octets the addresses have in
+     common with it. */
+  for(node = dest_node; node->parent != NULL; node = node->parent);
+  rpl_ns_get_node_global_addr(&first_hop, node);
+  cmpri = 15;
+  cmpre = common_prefix_len(&first_hop, &UIP_IP_BUF->destipaddr);
+  for(node = dest_node->parent; node->parent != NULL; node = node->parent) {
+    rpl_ns_get_node_global_addr(&addr, node);
+    i = common_prefix_len(&first_hop, &addr);
+    if(i < cmpri) {
+      cmpri = i;
+    }
+  }
+  /* The elided octets are taken from the destination address at each
+     hop, which is one of the intermediate addresses. */
+  if(cmpre > cmpri) {
+    cmpre = cmpri;
+  }
+
+  srh_len = RPL_SRH_ADDR_OFFSET + (path_len - 2) * (16 - cmpri) + (16 - cmpre);
+  pad = (8 - (srh_len & 0x07)) & 0x07;
+
+  /* The hop-by-hop option is not used together with source routes. */
+  last_uip_ext_len = uip_ext_len;
+  if(UIP_IP_BUF->proto == UIP_PROTO_HBHO) {
+    last_uip_ext_len -= UIP_HBHO_BUF->len + 8;
+    rpl_remove_header();
+  }
+  uip_ext_len = 0;
+
+  if(uip_len + srh_len + pad > UIP_BUFSIZE - UIP_LLH_LEN) {
+    PRINTF("RPL: Packet too long: impossible to add a source routing header\n");
+    uip_ext_len = last_uip_ext_len;
+    return 0;
+  }
+
+  memmove(UIP_SRH_BUF + srh_len + pad, UIP_SRH_BUF, uip_len - UIP_IPH_LEN);
+  memset(UIP_SRH_BUF, 0, srh_len + pad);
+  UIP_RH_BUF->next = UIP_IP_BUF->proto;
+  UIP_IP_BUF->proto = UIP_PROTO_ROUTING;
+  UIP_RH_BUF->len = (srh_len + pad) / 8 - 1;
+  UIP_RH_BUF->routing_type = RPL_RH_TYPE_SRH;
+  UIP_RH_BUF->seg_left = path_len - 1;
+  UIP_SRH_BUF[RPL_SRH_CMPR_OFFSET] = (cmpri << 4) | cmpre;
+  UIP_SRH_BUF[RPL_SRH_PAD_OFFSET] = pad << 4;
+
+  /* Fill in the addresses backwards, from the final destination up to
+     the hop after the first one. */
+  hops = UIP_SRH_BUF + srh_len;
+  hops -= 16 - cmpre;
+  memcpy(hops, &UIP_IP_BUF->destipaddr.u8[cmpre], 16 - cmpre);
+  for(node = dest_node->parent; node->parent != NULL; node = node->parent) {
+    rpl_ns_get_node_global_addr(&addr, node);
+    hops -= 16 - cmpri;
+    memcpy(hops, &addr.u8[cmpri], 16 - cmpri);
+  }
+
+  PRINTF("RPL: Source routing ");
+  PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+  PRINTF(" over %d hops through ", path_len);
+  PRINT6ADDR(&first_hop);
+  PRINTF("\n");
+
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &first_hop);
+
+  uip_len += srh_len + pad;
+  temp_len = UIP_IP_BUF->len[1];
+  UIP_IP_BUF->len[1] += srh_len + pad;
+  if(UIP_IP_BUF->len[1] < temp_len) {
+    UIP_IP_BUF->len[0]++;
+  }
+  uip_ext_len = last_uip_ext_len + srh_len + pad;
+#endif /* RPL_WITH_NON_STORING */
+  return 1;
+}
+/************************************************************************/
+/* Number of addresses in a source routing header, or -1 if the header
+   is too short to hold the last one */
+static int
+srh_num_addresses(const uint8_t *srh)
+{
+  const struct uip_routing_hdr *rh = (const struct uip_routing_hdr *)srh;
+  uint8_t cmpri, cmpre;
+  uint8_t pad;
+
+  cmpri = srh[RPL_SRH_CMPR_OFFSET] >> 4;
+  cmpre = srh[RPL_SRH_CMPR_OFFSET] & 0x0f;
+  pad = srh[RPL_SRH_PAD_OFFSET] >> 4;
+  if(rh->len * 8 < pad + (16 - cmpre)) {
+    return -1;
+  }
+  return ((rh->len * 8) - pad - (16 - cmpre)) / (16 - cmpri) + 1;
+}
+/************************************************************************/
+static void
+srh_error(uint8_t offset)
+{
+  uip_icmp6_error_output(ICMP6_PARAM_PROB, ICMP6_PARAMPROB_HEADER,
+                         UIP_IPH_LEN + uip_ext_len + offset);
+}
+/************************************************************************/
+/* Check whether two of our addresses, with another address in between,
+   are in the source route, which means that the route has a loop. */
+static int
+srh_has_loop(uint8_t cmpri, uint8_t cmpre, int n)
+{
+  uip_ipaddr_t addr;
+  uint8_t cmpr;
+  uint8_t *hop;
+  int seen_mine;
+  int left_mine;
+  int i;
+
+  seen_mine = 0;
+  left_mine = 0;
+  hop = UIP_SRH_BUF + RPL_SRH_ADDR_OFFSET;
+  for(i = 1; i <= n; i++) {
+    /* Elided prefixes are those of the destination address */
+    cmpr = i < n ? cmpri : cmpre;
+    uip_ipaddr_copy(&addr, &UIP_IP_BUF->destipaddr);
+    memcpy(&addr.u8[cmpr], hop, 16 - cmpr);
+    hop += 16 - cmpr;
+
+    if(uip_ds6_is_my_addr(&addr)) {
+      if(left_mine) {
+        return 1;
+      }
+      seen_mine = 1;
+    } else if(seen_mine) {
+      left_mine = 1;
+    }
+  }
+  return 0;
+}
+/************************************************************************/
+int
+rpl_process_srh_header(void)
+{
+  uip_ipaddr_t addr;
+  uint8_t cmpri, cmpre, cmpr;
+  uint8_t *hop;
+  int size;
+  int n;
+  int i;
+
+  /* Called from uip_process() with uip_ext_len at the routing header. */
+  if(UIP_RH_BUF->routing_type != RPL_RH_TYPE_SRH) {
+    return 0;
+  }
+
+  size = (UIP_RH_BUF->len + 1) * 8;
+  cmpri = UIP_SRH_BUF[RPL_SRH_CMPR_OFFSET] >> 4;
+  cmpre = UIP_SRH_BUF[RPL_SRH_CMPR_OFFSET] & 0x0f;
+  n = srh_num_addresses(UIP_SRH_BUF);
+  if(UIP_IPH_LEN + uip_ext_len + size > uip_len || n < 0) {
+    PRINTF("RPL: Source routing header does not fit in the packet\n");
+    srh_error(RPL_SRH_LEN_OFFSET);
+    return -1;
+  }
+
+  if(UIP_RH_BUF->seg_left > n) {
+    PRINTF("RPL: Bad source routing header, %u segments left of %d\n",
+           UIP_RH_BUF->seg_left, n);
+    srh_error(RPL_SRH_SEG_LEFT_OFFSET);
+    return -1;
+  }
+
+  if(srh_has_loop(cmpri, cmpre, n)) {
+    PRINTF("RPL: Loop in the source routing header\n");
+    srh_error(RPL_SRH_ADDR_OFFSET);
+    return -1;
+  }
+
+  UIP_RH_BUF->seg_left--;
+  i = n - UIP_RH_BUF->seg_left;
+  cmpr = i < n ? cmpri : cmpre;
+  hop = UIP_SRH_BUF + RPL_SRH_ADDR_OFFSET + (i - 1) * (16 - cmpri);
+
+  /* Swap the next hop with the destination address. */
+  uip_ipaddr_copy(&addr, &UIP_IP_BUF->destipaddr);
+  memcpy(&UIP_IP_BUF->destipaddr.u8[cmpr], hop, 16 - cmpr);
+  memcpy(hop, &addr.u8[cmpr], 16 - cmpr);
+
+  if(uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
+    /* RFC 6554 drops these without an ICMP error */
+    PRINTF("RPL: Multicast next hop in source routing header\n");
+    uip_len = 0;
+    return -1;
+  }
+  if(uip_ds6_is_my_addr(&UIP_IP_BUF->destipaddr)) {
+    PRINTF("RPL: Bad next hop in source routing header\n");
+    srh_error(RPL_SRH_ADDR_OFFSET + (i - 1) * (16 - cmpri));
+    return -1;
+  }
+
+  PRINTF("RPL: Source routing to ");
+  PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+  PRINTF(", %u segments left\n", UIP_RH_BUF->seg_left);
+  return 1;
+}
+/************************************************************************/
+int
+rpl_srh_get_next_hop(uip_ipaddr_t *ipaddr)
+{
+#if RPL_WITH_NON_STORING
+  uint8_t *proto;
+  uint8_t *srh;
+  int ext_len;
+  int n;
+  rpl_dag_t *dag;
+  rpl_ns_node_t *node;
+
+  proto = &UIP_IP_BUF->proto;
+  ext_len = 0;
+  if(*proto == UIP_PROTO_HBHO) {
+    proto = &uip_buf[UIP_LLIPH_LEN];
+    ext_len = (uip_buf[UIP_LLIPH_LEN + 1] + 1) * 8;
+  }
+  if(*proto == UIP_PROTO_ROUTING) {
+    /* Only a source routing header that holds the segments it has left
+       gives the next hop. The destination then is the next hop, also
+       once the last segment has been swapped in. */
+    srh = &uip_buf[UIP_LLIPH_LEN + ext_len];
+    if(UIP_IPH_LEN + ext_len + RPL_SRH_ADDR_OFFSET > uip_len ||
+       ((struct uip_routing_hdr *)srh)->routing_type != RPL_RH_TYPE_SRH) {
+      return 0;
+    }
+    n = srh_num_addresses(srh);
+    if(n < 0 || ((struct uip_routing_hdr *)srh)->seg_left > n) {
+      return 0;
+    }
+  } else {
+    /* The root reaches its own children without a routing header. */
+    dag = get_ns_root_dag();
+    if(dag == NULL) {
+      return 0;
+    }
+    node = rpl_ns_get_node(dag, &UIP_IP_BUF->destipaddr);
+    if(node == NULL || node->parent != NULL || node->lifetime == 0) {
+      return 0;
+    }
+  }
+
+  /* The destination is a neighbor, reached on its link-local address. */
+  uip_create_linklocal_prefix(ipaddr);
+  memcpy(&ipaddr->u8[8], &UIP_IP_BUF->destipaddr.u8[8], 8);
+  return 1;
+#else /* RPL_WITH_NON_STORING */
+  return 0;
+#endif /* RPL_WITH_NON_STORING */
+}
+/************************************************************************/
@@ -48,7 +48,14 @@
 #include "net/uip-nd6.h"
 #include "net/uip-icmp6.h"
 #include "net/rpl/rpl-private.h"
+#include "net/rpl/rpl-ns.h"
 #include "net/packetbuf.h"
+#if RPL_WITH_CONTEXTS
+#include "net/sicslowpan.h"
+#endif /* RPL_WITH_CONTEXTS */
+#include "lib/list.h"
+#include "lib/memb.h"
+#include "sys/ctimer.h"
 
 #include <limits.h>
 #include <string.h>
@@ -63,6 +70,10 @@
 #define RPL_DIO_MOP_MASK                 0x3c
 #define RPL_DIO_PREFERENCE_MASK          0x07
 
+/* DIO options decoded by a pass of dio_input_options() */
+#define DIO_OPTIONS_MC                   0
+#define DIO_OPTIONS_OTHER                1
+
 #define UIP_IP_BUF       ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
 #define UIP_ICMP_BUF     ((struct uip_icmp_hdr *)&uip_buf[uip_l2_l3_hdr_len])
 #define UIP_ICMP_PAYLOAD ((unsigned char *)&uip_buf[uip_l2_l3_icmp_hdr_len])
@@ -83,6 +94,34 @@ void RPL_DEBUG_DAO_OUTPUT(rpl_parent_t *);
 
 static uint8_t dao_sequence = RPL_LOLLIPOP_INIT;
 
+/* A target waiting to be advertised to the preferred parent, or
+   waiting for the DAO ACK of the DAO it was advertised in. */
+struct dao_target {
+  struct dao_target *next;
+  rpl_instance_t *instance;
+  uip_ipaddr_t prefix;
+  clock_time_t sent;
+  uint8_t prefixlen;
+  uint8_t lifetime;
+  uint8_t sequence;
+  uint8_t transmissions;
+  uint8_t state;
+  uint8_t own;
+};
+
+#define DAO_TARGET_PENDING        0
+#define DAO_TARGET_SENT           1
+
+/* Room needed for one more target in a DAO: the Target option and, in
+   the worst case, a Transit option before and after it. */
+#define DAO_TARGET_MAX_LEN        (20 + 2 * 22)
+
+MEMB(dao_target_memb, struct dao_target, RPL_DAO_MAX_TARGETS);
+LIST(dao_target_list);
+#if RPL_CONF_DAO_ACK
+static struct ctimer dao_ack_timer;
+#endif /* RPL_CONF_DAO_ACK */
+
 /* some debug callbacks useful when debugging RPL networks */
 #ifdef RPL_DEBUG_DIO_INPUT
 void RPL_DEBUG_DIO_INPUT(uip_ipaddr_t *, rpl_dio_t *);
@@ -199,30 +238,246 @@ dis_output(uip_ipaddr_t *addr)
   uip_icmp6_send(addr, ICMP6_RPL, RPL_CODE_DIS, 2);
 }
 /*---------------------------------------------------------------------------*/
+static int
+dio_input_metric_objects(unsigned char *buffer, int i, int end,
+                         rpl_metric_container_t *mc)
+{
+  int first;
+  uint8_t type;
+  uint8_t length;
+
+  /* The first object that we understand is the routing metric, the
+     others are only recorded. Unknown objects are skipped. */
+  mc->type = RPL_DAG_MC_NONE;
+  mc->objects = 0;
+  for(; i + 4 <= end; i += 4 + length) {
+    type = buffer[i];
+    length = buffer[i + 3];
+    if(i + 4 + length > end || length < 2) {
+      break;
+    }
+    first = mc->type == RPL_DAG_MC_NONE;
+    if(type == RPL_DAG_MC_ETX) {
+      mc->obj.etx = get16(buffer, i + 4);
+    } else if(type == RPL_DAG_MC_ENERGY) {
+      mc->obj.energy.flags = buffer[i + 4];
+      mc->obj.energy.energy_est = buffer[i + 5];
+    } else if(type == RPL_DAG_MC_HOPCOUNT) {
+      mc->obj.hopcount = buffer[i + 5];
+    } else {
+      continue;
+    }
+    mc->objects |= RPL_DAG_MC_BIT(type);
+    if(first) {
+      mc->type = type;
+      mc->flags = buffer[i + 1] << 1;
+      mc->flags |= buffer[i + 2] >> 7;
+      mc->aggr = (buffer[i + 2] >> 4) & 0x3;
+      mc->prec = buffer[i + 2] & 0xf;
+      mc->length = length;
+    }
+  }
+
+  PRINTF("RPL: DAG MC: type %u, flags %u, aggr %u, prec %u, length %u, objects 0x%x, ETX %u, energy %u, hops %u\n",
+	 (unsigned)mc->type,
+	 (unsigned)mc->flags,
+	 (unsigned)mc->aggr,
+	 (unsigned)mc->prec,
+	 (unsigned)mc->length,
+	 (unsigned)mc->objects,
+	 (unsigned)mc->obj.etx,
+	 (unsigned)mc->obj.energy.energy_est,
+	 (unsigned)mc->obj.hopcount);
+
+  return mc->objects != 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+dio_input_options(unsigned char *buffer, int i, int buffer_length,
+                  rpl_dio_t *dio, uint8_t options)
+{
+  uint8_t subopt_type;
+  int len;
+
+  /* The options are walked in place. The first pass validates them and
+     decodes only the metric container, which is all that a redundant
+     DIO is checked against, and the address contexts, which are taken
+     from redundant DIOs too; the second pass decodes the rest. */
+  for(; i < buffer_length; i += len) {
+    subopt_type = buffer[i];
+    if(subopt_type == RPL_OPTION_PAD1) {
+      len = 1;
+    } else {
+      /* Suboption with a two-byte header + payload */
+      len = 2 + buffer[i + 1];
+    }
+
+    if(len + i > buffer_length) {
+      PRINTF("RPL: Invalid DIO packet\n");
+      RPL_STAT(rpl_stats.malformed_msgs++);
+      return 0;
+    }
+
+    PRINTF("RPL: DIO option %u, length: %u\n", subopt_type, len - 2);
+
+#if RPL_WITH_CONTEXTS
+    if((subopt_type == RPL_OPTION_DAG_METRIC_CONTAINER ||
+        subopt_type == RPL_OPTION_6CO) != (options == DIO_OPTIONS_MC)) {
+      continue;
+    }
+#else /* RPL_WITH_CONTEXTS */
+    if((subopt_type == RPL_OPTION_DAG_METRIC_CONTAINER) !=
+       (options == DIO_OPTIONS_MC)) {
+      continue;
+    }
+#endif /* RPL_WITH_CONTEXTS */
+
+    switch(subopt_type) {
+    case RPL_OPTION_DAG_METRIC_CONTAINER:
+      if(len < 6) {
+        PRINTF("RPL: Invalid DAG MC, len = %d\n", len);
+	RPL_STAT(rpl_stats.malformed_msgs++);
+        return 0;
+      }
+      if(dio_input_metric_objects(buffer, i + 2, i + len, &dio->mc) == 0) {
+        PRINTF("RPL: Unhandled DAG MC type: %u\n", (unsigned)buffer[i + 2]);
+        return 0;
+      }
+      break;
+    case RPL_OPTION_ROUTE_INFO:
+      if(len < 9) {
+        PRINTF("RPL: Invalid destination prefix option, len = %d\n", len);
+	RPL_STAT(rpl_stats.malformed_msgs++);
+        return 0;
+      }
+
+      /* The flags field includes the preference value. */
+      dio->destination_prefix.length = buffer[i + 2];
+      dio->destination_prefix.flags = buffer[i + 3];
+      dio->destination_prefix.lifetime = get32(buffer, i + 4);
+
+      if(((dio->destination_prefix.length + 7) / 8) + 8 <= len &&
+         dio->destination_prefix.length <= 128) {
+        PRINTF("RPL: Copying destination prefix\n");
+        memcpy(&dio->destination_prefix.prefix, &buffer[i + 8],
+               (dio->destination_prefix.length + 7) / 8);
+      } else {
+        PRINTF("RPL: Invalid route info option, len = %d\n", len);
+	RPL_STAT(rpl_stats.malformed_msgs++);
+	return 0;
+      }
+
+      break;
+    case RPL_OPTION_DAG_CONF:
+      if(len != 16) {
+        PRINTF("RPL: Invalid DAG configuration option, len = %d\n", len);
+	RPL_STAT(rpl_stats.malformed_msgs++);
+        return 0;
+      }
+
+      /* Path control field not yet implemented - at i + 2 */
+      dio->dag_intdoubl = buffer[i + 3];
+      dio->dag_intmin = buffer[i + 4];
+      dio->dag_redund = buffer[i + 5];
+      dio->dag_max_rankinc = get16(buffer, i + 6);
+      dio->dag_min_hoprankinc = get16(buffer, i + 8);
+      dio->ocp = get16(buffer, i + 10);
+      /* buffer + 12 is reserved */
+      dio->default_lifetime = buffer[i + 13];
+      dio->lifetime_unit = get16(buffer, i + 14);
+      PRINTF("RPL: DAG conf:dbl=%d, min=%d red=%d maxinc=%d mininc=%d ocp=%d d_l=%u l_u=%u\n",
+             dio->dag_intdoubl, dio->dag_intmin, dio->dag_redund,
+             dio->dag_max_rankinc, dio->dag_min_hoprankinc, dio->ocp,
+             dio->default_lifetime, dio->lifetime_unit);
+      break;
+    case RPL_OPTION_PREFIX_INFO:
+      if(len != 32) {
+        PRINTF("RPL: DAG prefix info not ok, len != 32\n");
+	RPL_STAT(rpl_stats.malformed_msgs++);
+        return 0;
+      }
+      dio->prefix_info.length = buffer[i + 2];
+      dio->prefix_info.flags = buffer[i + 3];
+      /* valid lifetime is ingnored for now - at i + 4 */
+      /* preferred lifetime stored in lifetime */
+      dio->prefix_info.lifetime = get32(buffer, i + 8);
+      /* 32-bit reserved at i + 12 */
+      PRINTF("RPL: Copying prefix information\n");
+      memcpy(&dio->prefix_info.prefix, &buffer[i + 16], 16);
+      break;
+#if RPL_WITH_CONTEXTS
+    case RPL_OPTION_6CO:
+      /* A 16-bit version followed by contexts of 12 bytes each. */
+      if(len < 4 || (len - 4) % 12 != 0) {
+        PRINTF("RPL: Invalid context option, len = %d\n", len);
+	RPL_STAT(rpl_stats.malformed_msgs++);
+        return 0;
+      }
+      dio->contexts = &buffer[i + 2];
+      dio->contexts_len = len - 2;
+      break;
+#endif /* RPL_WITH_CONTEXTS */
+    default:
+      PRINTF("RPL: Unsupported suboption type in DIO: %u\n",
+	(unsigned)subopt_type);
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+#if RPL_WITH_CONTEXTS
+static void
+dio_input_contexts(rpl_dio_t *dio)
+{
+  rpl_instance_t *instance;
+  uint8_t *c;
+  uint16_t advertised;
+  int accept;
+
+  instance = rpl_get_instance(dio->instance_id);
+  if(instance == NULL || instance->current_dag == NULL ||
+     !uip_ipaddr_cmp(&instance->current_dag->dag_id, &dio->dag_id)) {
+    return;
+  }
+  /* The root is the authority for the contexts of its DAG. */
+  if(instance->current_dag->rank == ROOT_RANK(instance)) {
+    return;
+  }
+
+  accept = sicslowpan_context_accept_version(get16(dio->contexts, 0));
+  if(accept < 0) {
+    PRINTF("RPL: Ignoring contexts of old version %u\n",
+           (unsigned)get16(dio->contexts, 0));
+    return;
+  }
+  advertised = 0;
+  for(c = dio->contexts + 2; c < dio->contexts + dio->contexts_len; c += 12) {
+    sicslowpan_context_update(c[1] & 0x0f, &c[4], c[0],
+                              c[1] & SICSLOWPAN_CONTEXT_COMPRESS,
+                              get16(c, 2));
+    advertised |= 1 << (c[1] & 0x0f);
+  }
+  if(accept > 0) {
+    /* A new version replaces the whole list. Spread it as quickly as
+       a new DAG version. */
+    sicslowpan_context_prune(advertised);
+    rpl_reset_dio_timer(instance);
+  }
+}
+#endif /* RPL_WITH_CONTEXTS */
+/*---------------------------------------------------------------------------*/
 static void
 dio_input(void)
 {
   unsigned char *buffer;
   uint8_t buffer_length;
   rpl_dio_t dio;
-  uint8_t subopt_type;
   int i;
-  int len;
   uip_ipaddr_t from;
   uip_ds6_nbr_t *nbr;
 
   memset(&dio, 0, sizeof(dio));
 
-  /* Set default values in case the DIO configuration option is missing. */
-  dio.dag_intdoubl = RPL_DIO_INTERVAL_DOUBLINGS;
-  dio.dag_intmin = RPL_DIO_INTERVAL_MIN;
-  dio.dag_redund = RPL_DIO_REDUNDANCY;
-  dio.dag_min_hoprankinc = RPL_MIN_HOPRANKINC;
-  dio.dag_max_rankinc = RPL_MAX_RANKINC;
-  dio.ocp = RPL_OF.ocp;
-  dio.default_lifetime = RPL_DEFAULT_LIFETIME;
-  dio.lifetime_unit = RPL_DEFAULT_LIFETIME_UNIT;
-
   uip_ipaddr_copy(&from, &UIP_IP_BUF->srcipaddr);
 
   /* DAG Information Object */
@@ -236,6 +491,7 @@ dio_input(void)
                               0, NBR_REACHABLE)) != NULL) {
       /* set reachable timer */
       stimer_set(&nbr->reachable, UIP_ND6_REACHABLE_TIME / 1000);
+      UIP_DS6_WHEEL_UPDATE(nbr);
       PRINTF("RPL: Neighbor added to neighbor cache ");
       PRINT6ADDR(&from);
       PRINTF(", ");
@@ -277,121 +533,34 @@ dio_input(void)
   PRINT6ADDR(&dio.dag_id);
   PRINTF(", %u)\n", dio.preference);
 
-  /* Check if there are any DIO suboptions. */
-  for(; i < buffer_length; i += len) {
-    subopt_type = buffer[i];
-    if(subopt_type == RPL_OPTION_PAD1) {
-      len = 1;
-    } else {
-      /* Suboption with a two-byte header + payload */
-      len = 2 + buffer[i + 1];
-    }
-
-    if(len + i > buffer_length) {
-      PRINTF("RPL: Invalid DIO packet\n");
-      RPL_STAT(rpl_stats.malformed_msgs++);
-      return;
-    }
-
-    PRINTF("RPL: DIO option %u, length: %u\n", subopt_type, len - 2);
-
-    switch(subopt_type) {
-    case RPL_OPTION_DAG_METRIC_CONTAINER:
-      if(len < 6) {
-        PRINTF("RPL: Invalid DAG MC, len = %d\n", len);
-	RPL_STAT(rpl_stats.malformed_msgs++);
-        return;
-      }
-      dio.mc.type = buffer[i + 2];
-      dio.mc.flags = buffer[i + 3] << 1;
-      dio.mc.flags |= buffer[i + 4] >> 7;
-      dio.mc.aggr = (buffer[i + 4] >> 4) & 0x3;
-      dio.mc.prec = buffer[i + 4] & 0xf;
-      dio.mc.length = buffer[i + 5];
-
-      if(dio.mc.type == RPL_DAG_MC_ETX) {
-        dio.mc.obj.etx = get16(buffer, i + 6);
-
-        PRINTF("RPL: DAG MC: type %u, flags %u, aggr %u, prec %u, length %u, ETX %u\n",
-	       (unsigned)dio.mc.type,  
-	       (unsigned)dio.mc.flags, 
-	       (unsigned)dio.mc.aggr, 
-	       (unsigned)dio.mc.prec, 
-	       (unsigned)dio.mc.length, 
-	       (unsigned)dio.mc.obj.etx);
-      } else if(dio.mc.type == RPL_DAG_MC_ENERGY) {
-        dio.mc.obj.energy.flags = buffer[i + 6];
-        dio.mc.obj.energy.energy_est = buffer[i + 7];
-      } else {
-       PRINTF("RPL: Unhandled DAG MC type: %u\n", (unsigned)dio.mc.type);
-       return;
-      }
-      break;
-    case RPL_OPTION_ROUTE_INFO:
-      if(len < 9) {
-        PRINTF("RPL: Invalid destination prefix option, len = %d\n", len);
-	RPL_STAT(rpl_stats.malformed_msgs++);
-        return;
-      }
+  if(!dio_input_options(buffer, i, buffer_length, &dio, DIO_OPTIONS_MC)) {
+    return;
+  }
 
-      /* The flags field includes the preference value. */
-      dio.destination_prefix.length = buffer[i + 2];
-      dio.destination_prefix.flags = buffer[i + 3];
-      dio.destination_prefix.lifetime = get32(buffer, i + 4);
+#if RPL_WITH_CONTEXTS
+  if(dio.contexts != NULL) {
+    dio_input_contexts(&dio);
+  }
+#endif /* RPL_WITH_CONTEXTS */
 
-      if(((dio.destination_prefix.length + 7) / 8) + 8 <= len &&
-         dio.destination_prefix.length <= 128) {
-        PRINTF("RPL: Copying destination prefix\n");
-        memcpy(&dio.destination_prefix.prefix, &buffer[i + 8],
-               (dio.destination_prefix.length + 7) / 8);
-      } else {
-        PRINTF("RPL: Invalid route info option, len = %d\n", len);
-	RPL_STAT(rpl_stats.malformed_msgs++);
-	return;
-      }
+  /* Most DIOs in a dense neighborhood only confirm what we know. */
+  if(rpl_process_redundant_dio(&from, &dio)) {
+    PRINTF("RPL: Redundant DIO\n");
+    return;
+  }
 
-      break;
-    case RPL_OPTION_DAG_CONF:
-      if(len != 16) {
-        PRINTF("RPL: Invalid DAG configuration option, len = %d\n", len);
-	RPL_STAT(rpl_stats.malformed_msgs++);
-        return;
-      }
+  /* Set default values in case the DIO configuration option is missing. */
+  dio.dag_intdoubl = RPL_DIO_INTERVAL_DOUBLINGS;
+  dio.dag_intmin = RPL_DIO_INTERVAL_MIN;
+  dio.dag_redund = RPL_DIO_REDUNDANCY;
+  dio.dag_min_hoprankinc = RPL_MIN_HOPRANKINC;
+  dio.dag_max_rankinc = RPL_MAX_RANKINC;
+  dio.ocp = RPL_OF.ocp;
+  dio.default_lifetime = RPL_DEFAULT_LIFETIME;
+  dio.lifetime_unit = RPL_DEFAULT_LIFETIME_UNIT;
 
-      /* Path control field not yet implemented - at i + 2 */
-      dio.dag_intdoubl = buffer[i + 3];
-      dio.dag_intmin = buffer[i + 4];
-      dio.dag_redund = buffer[i + 5];
-      dio.dag_max_rankinc = get16(buffer, i + 6);
-      dio.dag_min_hoprankinc = get16(buffer, i + 8);
-      dio.ocp = get16(buffer, i + 10);
-      /* buffer + 12 is reserved */
-      dio.default_lifetime = buffer[i + 13];
-      dio.lifetime_unit = get16(buffer, i + 14);
-      PRINTF("RPL: DAG conf:dbl=%d, min=%d red=%d maxinc=%d mininc=%d ocp=%d d_l=%u l_u=%u\n",
-             dio.dag_intdoubl, dio.dag_intmin, dio.dag_redund,
-             dio.dag_max_rankinc, dio.dag_min_hoprankinc, dio.ocp,
-             dio.default_lifetime, dio.lifetime_unit);
-      break;
-    case RPL_OPTION_PREFIX_INFO:
-      if(len != 32) {
-        PRINTF("RPL: DAG prefix info not ok, len != 32\n");
-	RPL_STAT(rpl_stats.malformed_msgs++);
-        return;
-      }
-      dio.prefix_info.length = buffer[i + 2];
-      dio.prefix_info.flags = buffer[i + 3];
-      /* valid lifetime is ingnored for now - at i + 4 */
-      /* preferred lifetime stored in lifetime */
-      dio.prefix_info.lifetime = get32(buffer, i + 8);
-      /* 32-bit reserved at i + 12 */
-      PRINTF("RPL: Copying prefix information\n");
-      memcpy(&dio.prefix_info.prefix, &buffer[i + 16], 16);
-      break;
-    default:
-      PRINTF("RPL: Unsupported suboption type in DIO: %u\n",
-	(unsigned)subopt_type);
-    }
+  if(!dio_input_options(buffer, i, buffer_length, &dio, DIO_OPTIONS_OTHER)) {
+    return;
   }
 
 #ifdef RPL_DEBUG_DIO_INPUT
@@ -401,6 +570,65 @@ dio_input(void)
   rpl_process_dio(&from, &dio);
 }
 /*---------------------------------------------------------------------------*/
+#if !RPL_LEAF_ONLY
+static int
+dio_add_metric_object(unsigned char *buffer, int pos,
+                      rpl_metric_container_t *mc, uint8_t type)
+{
+  buffer[pos++] = type;
+  buffer[pos++] = mc->flags >> 1;
+  buffer[pos] = (mc->flags & 1) << 7;
+  buffer[pos++] |= (mc->aggr << 4) | mc->prec;
+  buffer[pos++] = 2;
+  if(type == RPL_DAG_MC_ETX) {
+    set16(buffer, pos, mc->obj.etx);
+    pos += 2;
+  } else if(type == RPL_DAG_MC_ENERGY) {
+    buffer[pos++] = mc->obj.energy.flags;
+    buffer[pos++] = mc->obj.energy.energy_est;
+  } else if(type == RPL_DAG_MC_HOPCOUNT) {
+    buffer[pos++] = 0;
+    buffer[pos++] = mc->obj.hopcount;
+  } else {
+    return -1;
+  }
+  return pos;
+}
+#endif /* !RPL_LEAF_ONLY */
+/*---------------------------------------------------------------------------*/
+#if RPL_WITH_CONTEXTS
+static int
+dio_add_contexts(unsigned char *buffer, int pos)
+{
+  const struct sicslowpan_addr_context *c;
+  int start;
+  uint8_t i;
+
+  start = pos;
+  buffer[pos++] = RPL_OPTION_6CO;
+  pos++;
+  set16(buffer, pos, sicslowpan_context_version());
+  pos += 2;
+  for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
+    c = sicslowpan_context_get(i);
+    if(c != NULL) {
+      buffer[pos++] = c->length;
+      buffer[pos++] = (c->flags & SICSLOWPAN_CONTEXT_COMPRESS) | c->number;
+      set16(buffer, pos, c->lifetime);
+      pos += 2;
+      memcpy(&buffer[pos], c->prefix, 8);
+      pos += 8;
+    }
+  }
+  if(pos == start + 4) {
+    /* No contexts to announce. */
+    return start;
+  }
+  buffer[start + 1] = pos - start - 2;
+  return pos;
+}
+#endif /* RPL_WITH_CONTEXTS */
+/*---------------------------------------------------------------------------*/
 void
 dio_output(rpl_instance_t *instance, uip_ipaddr_t *uc_addr)
 {
@@ -409,6 +637,8 @@ dio_output(rpl_instance_t *instance, uip_ipaddr_t *uc_addr)
   rpl_dag_t *dag = instance->current_dag;
 #if !RPL_LEAF_ONLY
   uip_ipaddr_t addr;
+  int len;
+  uint8_t type;
 #endif /* !RPL_LEAF_ONLY */
 
 #if RPL_LEAF_ONLY
@@ -459,24 +689,20 @@ dio_output(rpl_instance_t *instance, uip_ipaddr_t *uc_addr)
     instance->of->update_metric_container(instance);
 
     buffer[pos++] = RPL_OPTION_DAG_METRIC_CONTAINER;
-    buffer[pos++] = 6;
-    buffer[pos++] = instance->mc.type;
-    buffer[pos++] = instance->mc.flags >> 1;
-    buffer[pos] = (instance->mc.flags & 1) << 7;
-    buffer[pos++] |= (instance->mc.aggr << 4) | instance->mc.prec;
-    if(instance->mc.type == RPL_DAG_MC_ETX) {
-      buffer[pos++] = 2;
-      set16(buffer, pos, instance->mc.obj.etx);
-      pos += 2;
-    } else if(instance->mc.type == RPL_DAG_MC_ENERGY) {
-      buffer[pos++] = 2;
-      buffer[pos++] = instance->mc.obj.energy.flags;
-      buffer[pos++] = instance->mc.obj.energy.energy_est;
-    } else {
+    len = pos++;
+    pos = dio_add_metric_object(buffer, pos, &instance->mc, instance->mc.type);
+    for(type = 0; type < 16 && pos > 0; type++) {
+      if(type != instance->mc.type &&
+         (instance->mc.objects & RPL_DAG_MC_BIT(type))) {
+        pos = dio_add_metric_object(buffer, pos, &instance->mc, type);
+      }
+    }
+    if(pos < 0) {
       PRINTF("RPL: Unable to send DIO because of unhandled DAG MC type %u\n",
 	(unsigned)instance->mc.type);
       return;
     }
+    buffer[len] = pos - len - 1;
   }
 #endif /* !RPL_LEAF_ONLY */
 
@@ -521,6 +747,10 @@ dio_output(rpl_instance_t *instance, uip_ipaddr_t *uc_addr)
            dag->prefix_info.length);
   }
 
+#if RPL_WITH_CONTEXTS
+  pos = dio_add_contexts(buffer, pos);
+#endif /* RPL_WITH_CONTEXTS */
+
 #if RPL_LEAF_ONLY
   PRINTF("RPL: Sending unicast-DIO with rank %u to ",
       (unsigned)dag->rank);
@@ -544,6 +774,76 @@ dio_output(rpl_instance_t *instance, uip_ipaddr_t *uc_addr)
 #endif /* RPL_LEAF_ONLY */
 }
 /*---------------------------------------------------------------------------*/
+/* Returns 0 if the target could not be stored or queued for forwarding. */
+static int
+dao_input_target(rpl_instance_t *instance, uip_ipaddr_t *from,
+                 int learned_from, uip_ipaddr_t *prefix, uint8_t prefixlen,
+                 uint8_t lifetime, uip_ipaddr_t *parent_addr)
+{
+  rpl_dag_t *dag;
+  uip_ds6_route_t *rep;
+
+  dag = instance->current_dag;
+
+  PRINTF("RPL: DAO lifetime: %u, prefix length: %u prefix: ",
+          (unsigned)lifetime, (unsigned)prefixlen);
+  PRINT6ADDR(prefix);
+  PRINTF("\n");
+
+#if RPL_WITH_NON_STORING
+  if(instance->mop == RPL_MOP_NON_STORING) {
+    /* Only the root collects the parent of every node, from which it
+       builds source routes. Nobody else keeps downward routes. */
+    if(parent_addr == NULL || dag->rank != ROOT_RANK(instance)) {
+      PRINTF("RPL: Ignoring a non-storing DAO\n");
+      return 1;
+    }
+    if(lifetime == RPL_ZERO_LIFETIME) {
+      rpl_ns_expire_parent(dag, prefix, parent_addr);
+    } else if(rpl_ns_update_node(dag, prefix, parent_addr,
+                                 RPL_LIFETIME(instance, lifetime)) == NULL) {
+      PRINTF("RPL: Could not add a source route after receiving a DAO\n");
+      return 0;
+    }
+    return 1;
+  }
+#endif /* RPL_WITH_NON_STORING */
+
+  rep = uip_ds6_route_lookup(prefix);
+
+  if(lifetime == RPL_ZERO_LIFETIME) {
+    /* No-Path DAO received; invoke the route purging routine. */
+    if(rep != NULL && rep->state.saved_lifetime == 0 && rep->length == prefixlen) {
+      PRINTF("RPL: Setting expiration timer for prefix ");
+      PRINT6ADDR(prefix);
+      PRINTF("\n");
+      rep->state.saved_lifetime = rep->state.lifetime;
+      rep->state.lifetime = DAO_EXPIRATION_TIMEOUT;
+    }
+    return 1;
+  }
+
+  rep = rpl_add_route(dag, prefix, prefixlen, from);
+  if(rep == NULL) {
+    RPL_STAT(rpl_stats.mem_overflows++);
+    PRINTF("RPL: Could not add a route after receiving a DAO\n");
+    return 0;
+  }
+
+  rep->state.lifetime = RPL_LIFETIME(instance, lifetime);
+  rep->state.learned_from = learned_from;
+
+  if(learned_from == RPL_ROUTE_FROM_UNICAST_DAO && dag->preferred_parent) {
+    /* Advertise the target further up together with the other targets
+       that arrive in the meantime. */
+    if(!rpl_dao_queue_target(instance, prefix, prefixlen, lifetime)) {
+      return 0;
+    }
+    rpl_schedule_dao_forward(instance);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
 static void
 dao_input(void)
 {
@@ -554,21 +854,25 @@ dao_input(void)
   uint16_t sequence;
   uint8_t instance_id;
   uint8_t lifetime;
-  uint8_t prefixlen;
   uint8_t flags;
   uint8_t subopt_type;
   uint8_t pathcontrol;
   uint8_t pathsequence;
-  uip_ipaddr_t prefix;
-  uip_ds6_route_t *rep;
-  uint8_t buffer_length;
+  uip_ipaddr_t prefix[RPL_DAO_MAX_AGGREGATE];
+  uint8_t prefixlen[RPL_DAO_MAX_AGGREGATE];
+  uip_ipaddr_t *parent_addr;
+  int buffer_length;
+  int num_targets;
   int pos;
   int len;
   int i;
+  int t;
   int learned_from;
+  int stored;
   rpl_parent_t *p;
-
-  prefixlen = 0;
+#if RPL_WITH_NON_STORING
+  uip_ipaddr_t transit_parent;
+#endif /* RPL_WITH_NON_STORING */
 
   uip_ipaddr_copy(&dao_sender_addr, &UIP_IP_BUF->srcipaddr);
 
@@ -579,6 +883,12 @@ dao_input(void)
 
   buffer = UIP_ICMP_PAYLOAD;
   buffer_length = uip_len - uip_l3_icmp_hdr_len;
+  if(buffer_length < 4 ||
+     ((buffer[1] & RPL_DAO_D_FLAG) && buffer_length < 4 + 16)) {
+    PRINTF("RPL: Invalid DAO packet\n");
+    RPL_STAT(rpl_stats.malformed_msgs++);
+    return;
+  }
 
   pos = 0;
   instance_id = buffer[pos++];
@@ -590,8 +900,6 @@ dao_input(void)
     return;
   }
 
-  lifetime = instance->default_lifetime;
-
   flags = buffer[pos++];
   /* reserved */
   pos++;
@@ -609,120 +917,122 @@ dao_input(void)
     /* Perhaps, there are verification to do but ... */
   }
 
-  /* Check if there are any RPL options present. */
+  learned_from = uip_is_addr_mcast(&dao_sender_addr) ?
+                 RPL_ROUTE_FROM_MULTICAST_DAO : RPL_ROUTE_FROM_UNICAST_DAO;
+
+  if(learned_from == RPL_ROUTE_FROM_UNICAST_DAO) {
+    /* Check whether this is a DAO forwarding loop. */
+    p = rpl_find_parent(dag, &dao_sender_addr);
+    /* check if this is a new DAO registration with an "illegal" rank */
+    /* if we already route to this node it is likely */
+    if(p != NULL && DAG_RANK(p->rank, instance) < DAG_RANK(dag->rank, instance)) {
+      PRINTF("RPL: Loop detected when receiving a unicast DAO from a node with a lower rank! (%u < %u)\n",
+          DAG_RANK(p->rank, instance), DAG_RANK(dag->rank, instance));
+      p->rank = INFINITE_RANK;
+      rpl_parent_updated(p);
+      return;
+    }
+  }
+
+  /* A Transit option applies to all Target options that precede it,
+     so an aggregated DAO carries groups of targets sharing a lifetime. */
+  num_targets = 0;
+  stored = 1;
   i = pos;
   for(; i < buffer_length; i += len) {
     subopt_type = buffer[i];
     if(subopt_type == RPL_OPTION_PAD1) {
       len = 1;
-    } else {
+    } else if(i + 1 < buffer_length) {
       /* The option consists of a two-byte header and a payload. */
       len = 2 + buffer[i + 1];
+    } else {
+      len = 2;
+    }
+
+    if(len + i > buffer_length) {
+      PRINTF("RPL: Invalid DAO packet\n");
+      RPL_STAT(rpl_stats.malformed_msgs++);
+      return;
     }
 
     switch(subopt_type) {
     case RPL_OPTION_TARGET:
       /* Handle the target option. */
-      prefixlen = buffer[i + 3];
-      memset(&prefix, 0, sizeof(prefix));
-      memcpy(&prefix, buffer + i + 4, (prefixlen + 7) / CHAR_BIT);
+      if(len < 4 || buffer[i + 3] > 128 ||
+         (buffer[i + 3] + 7) / CHAR_BIT > len - 4) {
+        PRINTF("RPL: Invalid target in a DAO\n");
+        RPL_STAT(rpl_stats.malformed_msgs++);
+        return;
+      }
+      if(num_targets == RPL_DAO_MAX_AGGREGATE) {
+        PRINTF("RPL: Too many targets in a DAO\n");
+        stored = 0;
+        break;
+      }
+      prefixlen[num_targets] = buffer[i + 3];
+      memset(&prefix[num_targets], 0, sizeof(prefix[num_targets]));
+      memcpy(&prefix[num_targets], buffer + i + 4,
+             (prefixlen[num_targets] + 7) / CHAR_BIT);
+      num_targets++;
       break;
     case RPL_OPTION_TRANSIT:
+      if(len < 6) {
+        PRINTF("RPL: Invalid transit information in a DAO\n");
+        RPL_STAT(rpl_stats.malformed_msgs++);
+        return;
+      }
       /* The path sequence and control are ignored. */
       pathcontrol = buffer[i + 3];
       pathsequence = buffer[i + 4];
       lifetime = buffer[i + 5];
-      /* The parent address is also ignored. */
+      parent_addr = NULL;
+#if RPL_WITH_NON_STORING
+      /* The parent address is only used in non-storing mode. */
+      if(buffer[i + 1] >= 20) {
+        memcpy(&transit_parent, buffer + i + 6, sizeof(transit_parent));
+        parent_addr = &transit_parent;
+      }
+#endif /* RPL_WITH_NON_STORING */
+      for(t = 0; t < num_targets; t++) {
+        if(!dao_input_target(instance, &dao_sender_addr, learned_from,
+                             &prefix[t], prefixlen[t], lifetime,
+                             parent_addr)) {
+          stored = 0;
+        }
+      }
+      num_targets = 0;
       break;
     }
   }
 
-  PRINTF("RPL: DAO lifetime: %u, prefix length: %u prefix: ",
-          (unsigned)lifetime, (unsigned)prefixlen);
-  PRINT6ADDR(&prefix);
-  PRINTF("\n");
-
-  rep = uip_ds6_route_lookup(&prefix);
-
-  if(lifetime == RPL_ZERO_LIFETIME) {
-    /* No-Path DAO received; invoke the route purging routine. */
-    if(rep != NULL && rep->state.saved_lifetime == 0 && rep->length == prefixlen) {
-      PRINTF("RPL: Setting expiration timer for prefix ");
-      PRINT6ADDR(&prefix);
-      PRINTF("\n");
-      rep->state.saved_lifetime = rep->state.lifetime;
-      rep->state.lifetime = DAO_EXPIRATION_TIMEOUT;
+  /* Targets without a Transit option get the default lifetime. */
+  for(t = 0; t < num_targets; t++) {
+    if(!dao_input_target(instance, &dao_sender_addr, learned_from,
+                         &prefix[t], prefixlen[t], instance->default_lifetime,
+                         NULL)) {
+      stored = 0;
     }
-    return;
   }
 
-  learned_from = uip_is_addr_mcast(&dao_sender_addr) ?
-                 RPL_ROUTE_FROM_MULTICAST_DAO : RPL_ROUTE_FROM_UNICAST_DAO;
-
-  if(learned_from == RPL_ROUTE_FROM_UNICAST_DAO) {
-    /* Check whether this is a DAO forwarding loop. */
-    p = rpl_find_parent(dag, &dao_sender_addr);
-    /* check if this is a new DAO registration with an "illegal" rank */
-    /* if we already route to this node it is likely */
-    if(p != NULL && DAG_RANK(p->rank, instance) < DAG_RANK(dag->rank, instance)) {
-      PRINTF("RPL: Loop detected when receiving a unicast DAO from a node with a lower rank! (%u < %u)\n",
-          DAG_RANK(p->rank, instance), DAG_RANK(dag->rank, instance));
-      p->rank = INFINITE_RANK;
-      p->updated = 1;
-      return;
-    }
-  }
-
-  rep = rpl_add_route(dag, &prefix, prefixlen, &dao_sender_addr);
-  if(rep == NULL) {
-    RPL_STAT(rpl_stats.mem_overflows++);
-    PRINTF("RPL: Could not add a route after receiving a DAO\n");
+  /* Withhold the ACK if a target was lost, so that the sender
+     retransmits the DAO once there is room again. */
+  if(!stored) {
+    PRINTF("RPL: Not acknowledging a DAO whose targets were not all stored\n");
     return;
   }
 
-  rep->state.lifetime = RPL_LIFETIME(instance, lifetime);
-  rep->state.learned_from = learned_from;
-
-  if(learned_from == RPL_ROUTE_FROM_UNICAST_DAO) {
-    if(dag->preferred_parent) {
-      PRINTF("RPL: Forwarding DAO to parent ");
-      PRINT6ADDR(&dag->preferred_parent->addr);
-      PRINTF("\n");
-      uip_icmp6_send(&dag->preferred_parent->addr,
-                     ICMP6_RPL, RPL_CODE_DAO, buffer_length);
-    }
-    if(flags & RPL_DAO_K_FLAG) {
-      dao_ack_output(instance, &dao_sender_addr, sequence);
-    }
+  if(learned_from == RPL_ROUTE_FROM_UNICAST_DAO &&
+     (flags & RPL_DAO_K_FLAG)) {
+    dao_ack_output(instance, &dao_sender_addr, sequence);
   }
 }
 /*---------------------------------------------------------------------------*/
-void
-dao_output(rpl_parent_t *n, uint8_t lifetime)
+static int
+dao_add_header(unsigned char *buffer, rpl_instance_t *instance)
 {
-  rpl_dag_t *dag;
-  rpl_instance_t *instance;
-  unsigned char *buffer;
-  uint8_t prefixlen;
-  uip_ipaddr_t prefix;
   int pos;
 
-  /* Destination Advertisement Object */
-
-  if(get_global_addr(&prefix) == 0) {
-    PRINTF("RPL: No global address set for this node - suppressing DAO\n");
-    return;
-  }
-
-  dag = n->dag;
-  instance = dag->instance;
-
-#ifdef RPL_DEBUG_DAO_OUTPUT
-  RPL_DEBUG_DAO_OUTPUT(n);
-#endif
-
-  buffer = UIP_ICMP_PAYLOAD;
-
   RPL_LOLLIPOP_INCREMENT(dao_sequence);
   pos = 0;
 
@@ -738,34 +1048,279 @@ dao_output(rpl_parent_t *n, uint8_t lifetime)
   buffer[pos++] = 0; /* reserved */
   buffer[pos++] = dao_sequence;
 #if RPL_DAO_SPECIFY_DAG
-  memcpy(buffer + pos, &dag->dag_id, sizeof(dag->dag_id));
-  pos+=sizeof(dag->dag_id);
+  memcpy(buffer + pos, &instance->current_dag->dag_id,
+         sizeof(instance->current_dag->dag_id));
+  pos+=sizeof(instance->current_dag->dag_id);
 #endif /* RPL_DAO_SPECIFY_DAG */
-
-  /* create target subopt */
-  prefixlen = sizeof(prefix) * CHAR_BIT;
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static int
+dao_add_target(unsigned char *buffer, int pos, uip_ipaddr_t *prefix,
+               uint8_t prefixlen)
+{
   buffer[pos++] = RPL_OPTION_TARGET;
   buffer[pos++] = 2 + ((prefixlen + 7) / CHAR_BIT);
   buffer[pos++] = 0; /* reserved */
   buffer[pos++] = prefixlen;
-  memcpy(buffer + pos, &prefix, (prefixlen + 7) / CHAR_BIT);
+  memcpy(buffer + pos, prefix, (prefixlen + 7) / CHAR_BIT);
   pos += ((prefixlen + 7) / CHAR_BIT);
-
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static int
+dao_add_transit(unsigned char *buffer, int pos, rpl_parent_t *n,
+                uint8_t lifetime)
+{
   /* Create a transit information sub-option. */
   buffer[pos++] = RPL_OPTION_TRANSIT;
+#if RPL_WITH_NON_STORING
+  buffer[pos++] = n->dag->instance->mop == RPL_MOP_NON_STORING ? 20 : 4;
+#else /* RPL_WITH_NON_STORING */
   buffer[pos++] = 4;
+#endif /* RPL_WITH_NON_STORING */
   buffer[pos++] = 0; /* flags - ignored */
   buffer[pos++] = 0; /* path control - ignored */
   buffer[pos++] = 0; /* path seq - ignored */
   buffer[pos++] = lifetime;
 
+#if RPL_WITH_NON_STORING
+  if(n->dag->instance->mop == RPL_MOP_NON_STORING) {
+    /* Non-storing DAOs carry the global address of the parent. */
+    memcpy(buffer + pos, &n->dag->prefix_info.prefix, 8);
+    memcpy(buffer + pos + 8, &n->addr.u8[8], 8);
+    pos += 16;
+  }
+#endif /* RPL_WITH_NON_STORING */
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static uip_ipaddr_t *
+dao_destination(rpl_parent_t *n)
+{
+#if RPL_WITH_NON_STORING
+  /* Non-storing DAOs go directly to the root. */
+  if(n->dag->instance->mop == RPL_MOP_NON_STORING) {
+    return &n->dag->dag_id;
+  }
+#endif /* RPL_WITH_NON_STORING */
+  return &n->addr;
+}
+/*---------------------------------------------------------------------------*/
+void
+dao_output(rpl_parent_t *n, uint8_t lifetime)
+{
+  rpl_dag_t *dag;
+  unsigned char *buffer;
+  uip_ipaddr_t prefix;
+  int pos;
+
+  /* Destination Advertisement Object */
+
+  if(get_global_addr(&prefix) == 0) {
+    PRINTF("RPL: No global address set for this node - suppressing DAO\n");
+    return;
+  }
+
+  dag = n->dag;
+
+#ifdef RPL_DEBUG_DAO_OUTPUT
+  RPL_DEBUG_DAO_OUTPUT(n);
+#endif
+
+  buffer = UIP_ICMP_PAYLOAD;
+
+  pos = dao_add_header(buffer, dag->instance);
+  pos = dao_add_target(buffer, pos, &prefix, sizeof(prefix) * CHAR_BIT);
+  pos = dao_add_transit(buffer, pos, n, lifetime);
+
   PRINTF("RPL: Sending DAO with prefix ");
   PRINT6ADDR(&prefix);
   PRINTF(" to ");
-  PRINT6ADDR(&n->addr);
+  PRINT6ADDR(dao_destination(n));
   PRINTF("\n");
 
-  uip_icmp6_send(&n->addr, ICMP6_RPL, RPL_CODE_DAO, pos);
+  uip_icmp6_send(dao_destination(n), ICMP6_RPL, RPL_CODE_DAO, pos);
+}
+/*---------------------------------------------------------------------------*/
+static void
+dao_target_remove(struct dao_target *t)
+{
+  list_remove(dao_target_list, t);
+  memb_free(&dao_target_memb, t);
+}
+/*---------------------------------------------------------------------------*/
+#if RPL_CONF_DAO_ACK
+static void
+handle_dao_ack_timer(void *ptr)
+{
+  struct dao_target *t, *next;
+  clock_time_t now;
+  clock_time_t wait;
+  clock_time_t next_timeout;
+
+  now = clock_time();
+  next_timeout = 0;
+
+  for(t = list_head(dao_target_list); t != NULL; t = next) {
+    next = list_item_next(t);
+    if(t->state != DAO_TARGET_SENT) {
+      continue;
+    }
+    wait = now - t->sent;
+    if(wait < RPL_DAO_ACK_TIMEOUT) {
+      wait = RPL_DAO_ACK_TIMEOUT - wait;
+      if(next_timeout == 0 || wait < next_timeout) {
+        next_timeout = wait;
+      }
+    } else if(!t->instance->used ||
+              t->transmissions >= RPL_DAO_MAX_TRANSMISSIONS) {
+      PRINTF("RPL: No DAO ACK for target ");
+      PRINT6ADDR(&t->prefix);
+      PRINTF(", giving up\n");
+      dao_target_remove(t);
+    } else {
+      PRINTF("RPL: No DAO ACK for target ");
+      PRINT6ADDR(&t->prefix);
+      PRINTF(", retrying\n");
+      t->state = DAO_TARGET_PENDING;
+      rpl_schedule_dao_forward(t->instance);
+    }
+  }
+
+  if(next_timeout != 0) {
+    ctimer_set(&dao_ack_timer, next_timeout, handle_dao_ack_timer, NULL);
+  }
+}
+#endif /* RPL_CONF_DAO_ACK */
+/*---------------------------------------------------------------------------*/
+/* Returns 0 if there was no room to queue the target. */
+int
+rpl_dao_queue_target(rpl_instance_t *instance, uip_ipaddr_t *prefix,
+                     uint8_t prefixlen, uint8_t lifetime)
+{
+  struct dao_target *t;
+
+  for(t = list_head(dao_target_list); t != NULL; t = list_item_next(t)) {
+    if(t->instance == instance &&
+       (prefix == NULL ? t->own :
+        !t->own && t->prefixlen == prefixlen &&
+        uip_ipaddr_cmp(&t->prefix, prefix))) {
+      break;
+    }
+  }
+
+  if(t == NULL) {
+    t = memb_alloc(&dao_target_memb);
+    if(t == NULL) {
+      RPL_STAT(rpl_stats.mem_overflows++);
+      PRINTF("RPL: No room to queue a DAO target\n");
+      return 0;
+    }
+    t->instance = instance;
+    t->own = prefix == NULL;
+    if(prefix != NULL) {
+      uip_ipaddr_copy(&t->prefix, prefix);
+    } else {
+      memset(&t->prefix, 0, sizeof(t->prefix));
+    }
+    t->prefixlen = prefixlen;
+    list_add(dao_target_list, t);
+  }
+
+  /* A new advertisement restarts the retransmissions of the target. */
+  t->lifetime = lifetime;
+  t->transmissions = 0;
+  t->state = DAO_TARGET_PENDING;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_dao_output_queued(rpl_instance_t *instance)
+{
+  rpl_parent_t *n;
+  struct dao_target *t, *next;
+  unsigned char *buffer;
+  uint8_t lifetime;
+  int num_targets;
+  int pos;
+
+  n = instance->current_dag->preferred_parent;
+  if(n == NULL) {
+    return 0;
+  }
+
+#ifdef RPL_DEBUG_DAO_OUTPUT
+  RPL_DEBUG_DAO_OUTPUT(n);
+#endif
+
+  buffer = UIP_ICMP_PAYLOAD;
+  pos = dao_add_header(buffer, instance);
+  num_targets = 0;
+  lifetime = 0;
+
+  for(t = list_head(dao_target_list); t != NULL; t = next) {
+    next = list_item_next(t);
+    if(t->instance != instance || t->state != DAO_TARGET_PENDING) {
+      continue;
+    }
+    if(num_targets == RPL_DAO_MAX_AGGREGATE ||
+       pos + DAO_TARGET_MAX_LEN > UIP_BUFSIZE - uip_l2_l3_icmp_hdr_len) {
+      break;
+    }
+    if(t->own) {
+      if(get_global_addr(&t->prefix) == 0) {
+        PRINTF("RPL: No global address set for this node - suppressing DAO\n");
+        continue;
+      }
+      t->prefixlen = sizeof(t->prefix) * CHAR_BIT;
+    }
+    /* Targets with the same lifetime share one Transit option. */
+    if(num_targets > 0 && t->lifetime != lifetime) {
+      pos = dao_add_transit(buffer, pos, n, lifetime);
+    }
+    lifetime = t->lifetime;
+    pos = dao_add_target(buffer, pos, &t->prefix, t->prefixlen);
+    num_targets++;
+
+    PRINTF("RPL: Adding DAO target ");
+    PRINT6ADDR(&t->prefix);
+    PRINTF("\n");
+
+#if RPL_CONF_DAO_ACK
+    t->state = DAO_TARGET_SENT;
+    t->sequence = dao_sequence;
+    t->sent = clock_time();
+    t->transmissions++;
+#else /* RPL_CONF_DAO_ACK */
+    dao_target_remove(t);
+#endif /* RPL_CONF_DAO_ACK */
+  }
+
+  if(num_targets == 0) {
+    return 0;
+  }
+  pos = dao_add_transit(buffer, pos, n, lifetime);
+
+  PRINTF("RPL: Sending DAO with %d targets to ", num_targets);
+  PRINT6ADDR(dao_destination(n));
+  PRINTF("\n");
+
+  uip_icmp6_send(dao_destination(n), ICMP6_RPL, RPL_CODE_DAO, pos);
+
+#if RPL_CONF_DAO_ACK
+  if(ctimer_expired(&dao_ack_timer)) {
+    ctimer_set(&dao_ack_timer, RPL_DAO_ACK_TIMEOUT, handle_dao_ack_timer, NULL);
+  }
+#endif /* RPL_CONF_DAO_ACK */
+
+  /* Tell the caller whether another DAO is needed for the rest. */
+  for(t = list_head(dao_target_list); t != NULL; t = list_item_next(t)) {
+    if(t->instance == instance && t->state == DAO_TARGET_PENDING) {
+      return 1;
+    }
+  }
+  return 0;
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -776,6 +1331,7 @@ dao_ack_input(void)
   uint8_t instance_id;
   uint8_t sequence;
   uint8_t status;
+  struct dao_target *t, *next;
 
   buffer = UIP_ICMP_PAYLOAD;
   buffer_length = uip_len - uip_l3_icmp_hdr_len;
@@ -788,6 +1344,16 @@ dao_ack_input(void)
     sequence, status);
   PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
   PRINTF("\n");
+
+  /* The targets of the acknowledged DAO are done with, also when the
+     parent rejected them. */
+  for(t = list_head(dao_target_list); t != NULL; t = next) {
+    next = list_item_next(t);
+    if(t->state == DAO_TARGET_SENT && t->sequence == sequence &&
+       t->instance->instance_id == instance_id) {
+      dao_target_remove(t);
+    }
+  }
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+/**
+ * \file
+ *         Source routing table for the root of a non-storing RPL DAG
+ */
+
+#include <string.h>
+
+#include "net/rpl/rpl-private.h"
+#include "net/rpl/rpl-ns.h"
+#include "lib/list.h"
+#include "lib/memb.h"
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+#if RPL_WITH_NON_STORING
+
+MEMB(nodememb, rpl_ns_node_t, RPL_NS_LINK_NUM);
+LIST(nodelist);
+
+static int num_nodes;
+
+/************************************************************************/
+static int
+node_matches_address(rpl_dag_t *dag, rpl_ns_node_t *node, uip_ipaddr_t *addr)
+{
+  return node->dag == dag &&
+    memcmp(node->link_identifier, &addr->u8[8], 8) == 0;
+}
+/************************************************************************/
+static rpl_ns_node_t *
+get_or_add_node(rpl_dag_t *dag, uip_ipaddr_t *addr)
+{
+  rpl_ns_node_t *node;
+
+  node = rpl_ns_get_node(dag, addr);
+  if(node == NULL) {
+    node = memb_alloc(&nodememb);
+    if(node == NULL) {
+      RPL_STAT(rpl_stats.mem_overflows++);
+      return NULL;
+    }
+    node->lifetime = 0;
+    node->dag = dag;
+    node->parent = NULL;
+    memcpy(node->link_identifier, &addr->u8[8], 8);
+    list_add(nodelist, node);
+    num_nodes++;
+  }
+  return node;
+}
+/************************************************************************/
+void
+rpl_ns_init(void)
+{
+  memb_init(&nodememb);
+  list_init(nodelist);
+  num_nodes = 0;
+}
+/************************************************************************/
+rpl_ns_node_t *
+rpl_ns_update_node(rpl_dag_t *dag, uip_ipaddr_t *child, uip_ipaddr_t *parent,
+                   uint32_t lifetime)
+{
+  rpl_ns_node_t *child_node;
+  rpl_ns_node_t *parent_node;
+
+  child_node = get_or_add_node(dag, child);
+  if(child_node == NULL) {
+    return NULL;
+  }
+
+  if(parent == NULL || uip_ipaddr_cmp(parent, &dag->dag_id) ||
+     memcmp(&parent->u8[8], &dag->dag_id.u8[8], 8) == 0) {
+    /* A child of the root */
+    parent_node = NULL;
+  } else {
+    parent_node = get_or_add_node(dag, parent);
+    if(parent_node == NULL) {
+      return NULL;
+    }
+  }
+
+  child_node->parent = parent_node;
+  child_node->lifetime = lifetime;
+
+  PRINTF("RPL: NS node ");
+  PRINT6ADDR(child);
+  PRINTF(" has parent ");
+  PRINT6ADDR(parent);
+  PRINTF(", lifetime %lu\n", (unsigned long)lifetime);
+
+  return child_node;
+}
+/************************************************************************/
+void
+rpl_ns_expire_parent(rpl_dag_t *dag, uip_ipaddr_t *child, uip_ipaddr_t *parent)
+{
+  rpl_ns_node_t *node;
+
+  node = rpl_ns_get_node(dag, child);
+  if(node == NULL) {
+    return;
+  }
+  /* The node may already have registered a new parent. */
+  if(node->parent == NULL ?
+     memcmp(&parent->u8[8], &dag->dag_id.u8[8], 8) == 0 :
+     node_matches_address(dag, node->parent, parent)) {
+    node->lifetime = 0;
+  }
+}
+/************************************************************************/
+rpl_ns_node_t *
+rpl_ns_get_node(rpl_dag_t *dag, uip_ipaddr_t *addr)
+{
+  rpl_ns_node_t *node;
+
+  if(dag->prefix_info.length > 0 &&
+     !uip_ipaddr_prefixcmp(&dag->prefix_info.prefix, addr,
+                           dag->prefix_info.length)) {
+    return NULL;
+  }
+  for(node = list_head(nodelist); node != NULL; node = list_item_next(node)) {
+    if(node_matches_address(dag, node, addr)) {
+      return node;
+    }
+  }
+  return NULL;
+}
+/************************************************************************/
+int
+rpl_ns_path_length(rpl_ns_node_t *node)
+{
+  int length;
+
+  /* Entries can form a loop while parent changes propagate, so never
+     walk more hops than there are nodes. */
+  for(length = 1; length <= num_nodes; length++) {
+    if(node->lifetime == 0) {
+      return 0;
+    }
+    if(node->parent == NULL) {
+      return length;
+    }
+    node = node->parent;
+  }
+  return 0;
+}
+/************************************************************************/
+void
+rpl_ns_get_node_global_addr(uip_ipaddr_t *addr, rpl_ns_node_t *node)
+{
+  memcpy(addr, &node->dag->prefix_info.prefix, 8);
+  memcpy(&addr->u8[8], node->link_identifier, 8);
+}
+/************************************************************************/
+int
+rpl_ns_num_nodes(void)
+{
+  return num_nodes;
+}
+/************************************************************************/
+void
+rpl_ns_periodic(void)
+{
+  rpl_ns_node_t *node, *next, *n;
+
+  for(node = list_head(nodelist); node != NULL; node = list_item_next(node)) {
+    if(!node->dag->used) {
+      node->lifetime = 0;
+    } else if(node->lifetime > 0) {
+      node->lifetime--;
+    }
+  }
+
+  /* Remove expired nodes that are not the parent of any other node. */
+  for(node = list_head(nodelist); node != NULL; node = next) {
+    next = list_item_next(node);
+    if(node->lifetime == 0) {
+      for(n = list_head(nodelist); n != NULL; n = list_item_next(n)) {
+        if(n->parent == node && n->lifetime > 0) {
+          break;
+        }
+      }
+      if(n == NULL) {
+        /* Expired children may still point to it. */
+        for(n = list_head(nodelist); n != NULL; n = list_item_next(n)) {
+          if(n->parent == node) {
+            n->parent = NULL;
+          }
+        }
+        list_remove(nodelist, node);
+        memb_free(&nodememb, node);
+        num_nodes--;
+      }
+    }
+  }
+}
+/************************************************************************/
+#endif /* RPL_WITH_NON_STORING */
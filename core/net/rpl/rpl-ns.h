@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+/**
+ * \file
+ *         Source routing table for the root of a non-storing RPL DAG
+ *
+ *         In non-storing mode, every node reports its preferred parent
+ *         to the root in its DAOs. The root keeps one entry per node
+ *         with the interface identifier of the node and a pointer to
+ *         the entry of its parent, from which the path down to any node
+ *         can be rebuilt. The prefix of the addresses is that of the DAG.
+ */
+
+#ifndef RPL_NS_H
+#define RPL_NS_H
+
+#include "net/rpl/rpl-private.h"
+
+/* Number of nodes the root can keep source routes for */
+#ifdef RPL_CONF_NS_LINK_NUM
+#define RPL_NS_LINK_NUM RPL_CONF_NS_LINK_NUM
+#else /* RPL_CONF_NS_LINK_NUM */
+#define RPL_NS_LINK_NUM 32
+#endif /* RPL_CONF_NS_LINK_NUM */
+
+struct rpl_ns_node {
+  struct rpl_ns_node *next;
+  /* Remaining lifetime in seconds. Zero for a parent that has not
+     registered itself (yet), or whose registration has expired. */
+  uint32_t lifetime;
+  rpl_dag_t *dag;
+  uint8_t link_identifier[8];
+  /* NULL if the node is a child of the root */
+  struct rpl_ns_node *parent;
+};
+typedef struct rpl_ns_node rpl_ns_node_t;
+
+void rpl_ns_init(void);
+
+/* Record that child has parent as preferred parent. */
+rpl_ns_node_t *rpl_ns_update_node(rpl_dag_t *dag, uip_ipaddr_t *child,
+                                  uip_ipaddr_t *parent, uint32_t lifetime);
+/* Handle a No-Path DAO; ignored if parent is not the current parent. */
+void rpl_ns_expire_parent(rpl_dag_t *dag, uip_ipaddr_t *child,
+                          uip_ipaddr_t *parent);
+rpl_ns_node_t *rpl_ns_get_node(rpl_dag_t *dag, uip_ipaddr_t *addr);
+/* Number of hops from the root to the node, or 0 if there is no
+   complete path to it. */
+int rpl_ns_path_length(rpl_ns_node_t *node);
+void rpl_ns_get_node_global_addr(uip_ipaddr_t *addr, rpl_ns_node_t *node);
+int rpl_ns_num_nodes(void);
+/* Age the entries, called once per second. */
+void rpl_ns_periodic(void);
+
+#endif /* RPL_NS_H */
@@ -72,12 +72,6 @@ rpl_of_t rpl_of_etx = {
 /* Reject parents that have a higher path cost than the following. */
 #define MAX_PATH_COST			100
 
-/*
- * The rank must differ more than 1/PARENT_SWITCH_THRESHOLD_DIV in order
- * to switch preferred parent.
- */
-#define PARENT_SWITCH_THRESHOLD_DIV	2
-
 typedef uint16_t rpl_path_metric_t;
 
 static rpl_path_metric_t
@@ -157,8 +151,9 @@ best_parent(rpl_parent_t *p1, rpl_parent_t *p2)
 
   dag = p1->dag; /* Both parents must be in the same DAG. */
 
-  min_diff = RPL_DAG_MC_ETX_DIVISOR /
-             PARENT_SWITCH_THRESHOLD_DIV;
+  /* The path cost must differ more than the hysteresis of the instance
+     in order to switch preferred parent. */
+  min_diff = dag->instance->of_params.hysteresis;
 
   p1_metric = calculate_path_metric(p1);
   p2_metric = calculate_path_metric(p2);
@@ -207,6 +202,7 @@ update_metric_container(rpl_instance_t *instance)
 #if RPL_DAG_MC == RPL_DAG_MC_ETX
 
   instance->mc.type = RPL_DAG_MC_ETX;
+  instance->mc.objects = RPL_DAG_MC_BIT(RPL_DAG_MC_ETX);
   instance->mc.length = sizeof(instance->mc.obj.etx);
   instance->mc.obj.etx = path_metric;
 
@@ -217,6 +213,7 @@ update_metric_container(rpl_instance_t *instance)
 #elif RPL_DAG_MC == RPL_DAG_MC_ENERGY
 
   instance->mc.type = RPL_DAG_MC_ENERGY;
+  instance->mc.objects = RPL_DAG_MC_BIT(RPL_DAG_MC_ENERGY);
   instance->mc.length = sizeof(instance->mc.obj.energy);
 
   if(dag->rank == ROOT_RANK(instance)) {
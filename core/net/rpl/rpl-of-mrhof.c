@@ -0,0 +1,269 @@
+/**
+ * \addtogroup uip6
+ * @{
+ */
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+/**
+ * \file
+ *         A minrank-hysteresis objective function (OCP 1) with a
+ *         composite routing metric.
+ *
+ *         The path cost through a parent is a weighted sum of the
+ *         path ETX, the energy cost of the path and the hop count.
+ *         The weights and the hysteresis are taken from the
+ *         of_params of each instance.
+ *
+ *         The energy cost of a node is the fraction of its battery
+ *         that it has used, scaled to 0-255, as derived from the
+ *         radio on-time measured by energest and
+ *         RPL_OF_ENERGY_BUDGET. Nodes advertise the sum of the energy
+ *         costs of the nodes on their path in the energy object, so
+ *         that children move away from drained relays.
+ */
+
+#include "net/rpl/rpl-private.h"
+#include "net/neighbor-info.h"
+#include "sys/energest.h"
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+static void reset(rpl_dag_t *);
+static rpl_parent_t *best_parent(rpl_parent_t *, rpl_parent_t *);
+static rpl_dag_t *best_dag(rpl_dag_t *, rpl_dag_t *);
+static rpl_rank_t calculate_rank(rpl_parent_t *, rpl_rank_t);
+static void update_metric_container(rpl_instance_t *);
+
+rpl_of_t rpl_of_mrhof = {
+  reset,
+  NULL,
+  best_parent,
+  best_dag,
+  calculate_rank,
+  update_metric_container,
+  1
+};
+
+/* Reject parents that have a higher path cost than the following. */
+#define MAX_PATH_COST			100
+
+#define MAX_ENERGY_COST			255
+
+typedef uint32_t rpl_path_cost_t;
+
+static uint8_t
+energy_cost(void)
+{
+#if ENERGEST_CONF_ON && RPL_OF_ENERGY_BUDGET > 0
+  unsigned long radio_on;
+
+  radio_on = (energest_type_time(ENERGEST_TYPE_LISTEN) +
+              energest_type_time(ENERGEST_TYPE_TRANSMIT)) / RTIMER_SECOND;
+  if(radio_on >= RPL_OF_ENERGY_BUDGET) {
+    return MAX_ENERGY_COST;
+  }
+  return (radio_on * MAX_ENERGY_COST) / RPL_OF_ENERGY_BUDGET;
+#else
+  return 0;
+#endif
+}
+static int
+is_root_parent(rpl_parent_t *p)
+{
+  return p->rank <= ROOT_RANK(p->dag->instance);
+}
+static uint16_t
+path_etx(rpl_parent_t *p)
+{
+  long etx;
+
+  if(p == NULL || (!(p->mc.objects & RPL_DAG_MC_BIT(RPL_DAG_MC_ETX)) &&
+                   !is_root_parent(p))) {
+    return MAX_PATH_COST * RPL_DAG_MC_ETX_DIVISOR;
+  }
+  etx = p->link_metric;
+  etx = (etx * RPL_DAG_MC_ETX_DIVISOR) / NEIGHBOR_INFO_ETX_DIVISOR;
+  if(p->mc.objects & RPL_DAG_MC_BIT(RPL_DAG_MC_ETX)) {
+    etx += p->mc.obj.etx;
+  }
+  return etx > 0xffff ? 0xffff : (uint16_t)etx;
+}
+static uint8_t
+path_energy(rpl_parent_t *p)
+{
+  if(p == NULL || !(p->mc.objects & RPL_DAG_MC_BIT(RPL_DAG_MC_ENERGY))) {
+    return 0;
+  }
+  return p->mc.obj.energy.energy_est;
+}
+static uint8_t
+path_hopcount(rpl_parent_t *p)
+{
+  if(p == NULL || !(p->mc.objects & RPL_DAG_MC_BIT(RPL_DAG_MC_HOPCOUNT))) {
+    return 1;
+  }
+  return p->mc.obj.hopcount == 0xff ? 0xff : p->mc.obj.hopcount + 1;
+}
+static rpl_path_cost_t
+path_cost(rpl_parent_t *p)
+{
+  struct rpl_of_params *params;
+
+  params = &p->dag->instance->of_params;
+  return (rpl_path_cost_t)params->etx_weight * path_etx(p) +
+    (rpl_path_cost_t)params->energy_weight * path_energy(p) +
+    (rpl_path_cost_t)params->hopcount_weight * path_hopcount(p) *
+    RPL_DAG_MC_ETX_DIVISOR;
+}
+static void
+reset(rpl_dag_t *dag)
+{
+}
+static rpl_rank_t
+calculate_rank(rpl_parent_t *p, rpl_rank_t base_rank)
+{
+  rpl_rank_t new_rank;
+  rpl_rank_t rank_increase;
+
+  if(p == NULL) {
+    if(base_rank == 0) {
+      return INFINITE_RANK;
+    }
+    rank_increase = NEIGHBOR_INFO_FIX2ETX(INITIAL_LINK_METRIC) * RPL_MIN_HOPRANKINC;
+  } else {
+    /* multiply first, then scale down to avoid truncation effects */
+    rank_increase = NEIGHBOR_INFO_FIX2ETX(p->link_metric * p->dag->instance->min_hoprankinc);
+    if(base_rank == 0) {
+      base_rank = p->rank;
+    }
+  }
+
+  if(INFINITE_RANK - base_rank < rank_increase) {
+    /* Reached the maximum rank. */
+    new_rank = INFINITE_RANK;
+  } else {
+    new_rank = base_rank + rank_increase;
+  }
+
+  return new_rank;
+}
+static rpl_dag_t *
+best_dag(rpl_dag_t *d1, rpl_dag_t *d2)
+{
+  if(d1->grounded != d2->grounded) {
+    return d1->grounded ? d1 : d2;
+  }
+
+  if(d1->preference != d2->preference) {
+    return d1->preference > d2->preference ? d1 : d2;
+  }
+
+  return d1->rank < d2->rank ? d1 : d2;
+}
+static rpl_parent_t *
+best_parent(rpl_parent_t *p1, rpl_parent_t *p2)
+{
+  rpl_dag_t *dag;
+  rpl_path_cost_t min_diff;
+  rpl_path_cost_t p1_cost;
+  rpl_path_cost_t p2_cost;
+
+  dag = p1->dag; /* Both parents must be in the same DAG. */
+
+  min_diff = dag->instance->of_params.hysteresis;
+
+  p1_cost = path_cost(p1);
+  p2_cost = path_cost(p2);
+
+  /* Maintain stability of the preferred parent in case of similar costs. */
+  if(p1 == dag->preferred_parent || p2 == dag->preferred_parent) {
+    if(p1_cost < p2_cost + min_diff &&
+       p1_cost + min_diff > p2_cost) {
+      PRINTF("RPL: MRHOF hysteresis: %lu <= %lu <= %lu\n",
+             (unsigned long)p2_cost - min_diff,
+             (unsigned long)p1_cost,
+             (unsigned long)p2_cost + min_diff);
+      return dag->preferred_parent;
+    }
+  }
+
+  return p1_cost < p2_cost ? p1 : p2;
+}
+static void
+update_metric_container(rpl_instance_t *instance)
+{
+  rpl_dag_t *dag;
+  rpl_parent_t *p;
+  unsigned energy;
+  uint8_t own_energy;
+
+  instance->mc.type = RPL_DAG_MC_ETX;
+  instance->mc.flags = RPL_DAG_MC_FLAG_P;
+  instance->mc.aggr = RPL_DAG_MC_AGGR_ADDITIVE;
+  instance->mc.prec = 0;
+  instance->mc.length = sizeof(instance->mc.obj.etx);
+  instance->mc.objects = RPL_DAG_MC_BIT(RPL_DAG_MC_ETX);
+  if(instance->of_params.energy_weight > 0) {
+    instance->mc.objects |= RPL_DAG_MC_BIT(RPL_DAG_MC_ENERGY);
+  }
+  if(instance->of_params.hopcount_weight > 0) {
+    instance->mc.objects |= RPL_DAG_MC_BIT(RPL_DAG_MC_HOPCOUNT);
+  }
+
+  dag = instance->current_dag;
+
+  if(!dag->joined) {
+    return;
+  }
+
+  own_energy = energy_cost();
+  instance->mc.obj.energy.flags = (RPL_OF_ENERGY_BUDGET > 0 ?
+                                   RPL_DAG_MC_ENERGY_TYPE_BATTERY :
+                                   RPL_DAG_MC_ENERGY_TYPE_MAINS) << RPL_DAG_MC_ENERGY_TYPE;
+
+  if(dag->rank == ROOT_RANK(instance)) {
+    instance->mc.obj.etx = 0;
+    instance->mc.obj.energy.energy_est = own_energy;
+    instance->mc.obj.hopcount = 0;
+  } else {
+    p = dag->preferred_parent;
+    instance->mc.obj.etx = path_etx(p);
+    energy = path_energy(p) + own_energy;
+    instance->mc.obj.energy.energy_est = energy > MAX_ENERGY_COST ?
+      MAX_ENERGY_COST : energy;
+    instance->mc.obj.hopcount = path_hopcount(p);
+  }
+
+  PRINTF("RPL: My path ETX %u, energy cost %u (own %u), hop count %u\n",
+         instance->mc.obj.etx, instance->mc.obj.energy.energy_est,
+         own_energy, instance->mc.obj.hopcount);
+}
@@ -160,4 +160,5 @@ static void
 update_metric_container(rpl_instance_t *instance)
 {
   instance->mc.type = RPL_DAG_MC_NONE;
+  instance->mc.objects = 0;
 }
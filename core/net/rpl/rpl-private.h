@@ -86,6 +86,9 @@
 #define RPL_OPTION_SOLICITED_INFO        7
 #define RPL_OPTION_PREFIX_INFO           8
 #define RPL_OPTION_TARGET_DESC           9
+/* Not assigned by RFC 6550. The 6LoWPAN contexts use the number of
+   the 6LoWPAN context option of RFC 6775. */
+#define RPL_OPTION_6CO                   0x22
 
 #define RPL_DAO_K_FLAG                   0x80 /* DAO ACK requested */
 #define RPL_DAO_D_FLAG                   0x40 /* DODAG ID present */
@@ -105,6 +108,12 @@
 /* The default value for the DAO timer. */
 #define RPL_DAO_LATENCY                 (CLOCK_SECOND * 4)
 
+/* Time to wait for more targets before forwarding a DAO. */
+#define RPL_DAO_AGGREGATION_DELAY       (CLOCK_SECOND / 2)
+
+/* Time to wait for a DAO ACK before advertising the targets again. */
+#define RPL_DAO_ACK_TIMEOUT             (CLOCK_SECOND * 4)
+
 /* Special value indicating immediate removal. */
 #define RPL_ZERO_LIFETIME               0
 
@@ -185,6 +194,10 @@
 #define RPL_MOP_DEFAULT                 RPL_MOP_STORING_NO_MULTICAST
 #endif
 
+/* Non-storing mode keeps source routes at the root instead of
+   downward routes in every node. */
+#define RPL_WITH_NON_STORING            (RPL_MOP_DEFAULT == RPL_MOP_NON_STORING)
+
 /*
  * The ETX in the metric container is expressed as a fixed-point value 
  * whose integer part can be obtained by dividing the value by 
@@ -236,6 +249,10 @@ struct rpl_dio {
   rpl_prefix_t destination_prefix;
   rpl_prefix_t prefix_info;
   struct rpl_metric_container mc;
+#if RPL_WITH_CONTEXTS
+  uint8_t *contexts;
+  uint8_t contexts_len;
+#endif /* RPL_WITH_CONTEXTS */
 };
 typedef struct rpl_dio rpl_dio_t;
 
@@ -271,11 +288,15 @@ void dis_output(uip_ipaddr_t *addr);
 void dio_output(rpl_instance_t *, uip_ipaddr_t *uc_addr);
 void dao_output(rpl_parent_t *, uint8_t lifetime);
 void dao_ack_output(rpl_instance_t *, uip_ipaddr_t *, uint8_t);
+int rpl_dao_queue_target(rpl_instance_t *, uip_ipaddr_t *prefix,
+                         uint8_t prefixlen, uint8_t lifetime);
+int rpl_dao_output_queued(rpl_instance_t *);
 
 /* RPL logic functions. */
 void rpl_join_dag(uip_ipaddr_t *from, rpl_dio_t *dio);
 void rpl_join_instance(uip_ipaddr_t *from, rpl_dio_t *dio);
 void rpl_local_repair(rpl_instance_t *instance);
+int rpl_process_redundant_dio(uip_ipaddr_t *, rpl_dio_t *);
 void rpl_process_dio(uip_ipaddr_t *, rpl_dio_t *);
 int rpl_process_parent_event(rpl_instance_t *, rpl_parent_t *);
 
@@ -294,6 +315,7 @@ void rpl_remove_parent(rpl_dag_t *, rpl_parent_t *);
 void rpl_move_parent(rpl_dag_t *dag_src, rpl_dag_t *dag_dst, rpl_parent_t *parent);
 rpl_parent_t *rpl_select_parent(rpl_dag_t *dag);
 rpl_dag_t *rpl_select_dag(rpl_instance_t *instance,rpl_parent_t *parent);
+void rpl_parent_updated(rpl_parent_t *p);
 void rpl_recalculate_ranks(void);
 
 /* RPL routing table functions. */
@@ -308,6 +330,8 @@ rpl_of_t *rpl_find_of(rpl_ocp_t);
 
 /* Timer functions. */
 void rpl_schedule_dao(rpl_instance_t *);
+void rpl_schedule_dao_forward(rpl_instance_t *);
+void rpl_init_dio_timer(rpl_instance_t *);
 void rpl_reset_dio_timer(rpl_instance_t *);
 void rpl_reset_periodic_timer(void);
 
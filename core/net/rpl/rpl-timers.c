@@ -41,6 +41,7 @@
 
 #include "contiki-conf.h"
 #include "net/rpl/rpl-private.h"
+#include "net/rpl/rpl-ns.h"
 #include "lib/random.h"
 #include "sys/ctimer.h"
 
@@ -51,8 +52,6 @@
 static struct ctimer periodic_timer;
 
 static void handle_periodic_timer(void *ptr);
-static void new_dio_interval(rpl_instance_t *instance);
-static void handle_dio_timer(void *ptr);
 
 static uint16_t next_dis;
 
@@ -65,6 +64,9 @@ handle_periodic_timer(void *ptr)
 {
   rpl_purge_routes();
   rpl_recalculate_ranks();
+#if RPL_WITH_NON_STORING
+  rpl_ns_periodic();
+#endif /* RPL_WITH_NON_STORING */
 
   /* handle DIS */
 #ifdef RPL_DIS_SEND
@@ -77,54 +79,8 @@ handle_periodic_timer(void *ptr)
   ctimer_reset(&periodic_timer);
 }
 /************************************************************************/
-static void
-new_dio_interval(rpl_instance_t *instance)
-{
-  uint32_t time;
-
-  /* TODO: too small timer intervals for many cases */
-  time = 1UL << instance->dio_intcurrent;
-
-  /* Convert from milliseconds to CLOCK_TICKS. */
-  time = (time * CLOCK_SECOND) / 1000;
-
-  instance->dio_next_delay = time;
-
-  /* random number between I/2 and I */
-  time = time >> 1;
-  time += (time * random_rand()) / RANDOM_RAND_MAX;
-
-  /*
-   * The intervals must be equally long among the nodes for Trickle to
-   * operate efficiently. Therefore we need to calculate the delay between
-   * the randomized time and the start time of the next interval.
-   */
-  instance->dio_next_delay -= time;
-  instance->dio_send = 1;
-
-#if RPL_CONF_STATS
-  /* keep some stats */
-  instance->dio_totint++;
-  instance->dio_totrecv += instance->dio_counter;
-  ANNOTATE("#A rank=%u.%u(%u),stats=%d %d %d %d,color=%s\n",
-	   DAG_RANK(instance->current_dag->rank, instance),
-           (10 * (instance->current_dag->rank % instance->min_hoprankinc)) / instance->min_hoprankinc,
-           instance->current_dag->version,
-           instance->dio_totint, instance->dio_totsend,
-           instance->dio_totrecv,instance->dio_intcurrent,
-	   instance->current_dag->rank == ROOT_RANK(instance) ? "BLUE" : "ORANGE");
-#endif /* RPL_CONF_STATS */
-
-  /* reset the redundancy counter */
-  instance->dio_counter = 0;
-
-  /* schedule the timer */
-  PRINTF("RPL: Scheduling DIO timer %lu ticks in future (Interval)\n", time);
-  ctimer_set(&instance->dio_timer, time, &handle_dio_timer, instance);
-}
-/************************************************************************/
-static void
-handle_dio_timer(void *ptr)
+static int
+handle_dio_transmit(void *ptr)
 {
   rpl_instance_t *instance;
 
@@ -136,34 +92,25 @@ handle_dio_timer(void *ptr)
       dio_send_ok = 1;
     } else {
       PRINTF("RPL: Postponing DIO transmission since link local address is not ok\n");
-      ctimer_set(&instance->dio_timer, CLOCK_SECOND, &handle_dio_timer, instance);
-      return;
+      return 0;
     }
   }
 
-  if(instance->dio_send) {
-    /* send DIO if counter is less than desired redundancy */
-    if(instance->dio_counter < instance->dio_redundancy) {
 #if RPL_CONF_STATS
-      instance->dio_totsend++;
+  /* keep some stats */
+  ANNOTATE("#A rank=%u.%u(%u),stats=%d %d %d %d,color=%s\n",
+	   DAG_RANK(instance->current_dag->rank, instance),
+           (10 * (instance->current_dag->rank % instance->min_hoprankinc)) / instance->min_hoprankinc,
+           instance->current_dag->version,
+           instance->dio_trickle.stats.intervals,
+           instance->dio_trickle.stats.transmitted,
+           instance->dio_trickle.stats.consistent,
+           instance->dio_trickle.i_current,
+	   instance->current_dag->rank == ROOT_RANK(instance) ? "BLUE" : "ORANGE");
 #endif /* RPL_CONF_STATS */
-      dio_output(instance, NULL);
-    } else {
-      PRINTF("RPL: Supressing DIO transmission (%d >= %d)\n",
-             instance->dio_counter, instance->dio_redundancy);
-    }
-    instance->dio_send = 0;
-    PRINTF("RPL: Scheduling DIO timer %lu ticks in future (sent)\n",
-           instance->dio_next_delay);
-    ctimer_set(&instance->dio_timer, instance->dio_next_delay, handle_dio_timer, instance);
-  } else {
-    /* check if we need to double interval */
-    if(instance->dio_intcurrent < instance->dio_intmin + instance->dio_intdoubl) {
-      instance->dio_intcurrent++;
-      PRINTF("RPL: DIO Timer interval doubled %d\n", instance->dio_intcurrent);
-    }
-    new_dio_interval(instance);
-  }
+
+  dio_output(instance, NULL);
+  return 1;
 }
 /************************************************************************/
 void
@@ -173,24 +120,41 @@ rpl_reset_periodic_timer(void)
   ctimer_set(&periodic_timer, CLOCK_SECOND, handle_periodic_timer, NULL);
 }
 /************************************************************************/
+void
+rpl_init_dio_timer(rpl_instance_t *instance)
+{
+  trickle_timer_init(&instance->dio_trickle, instance->dio_intmin,
+                     instance->dio_intdoubl, instance->dio_redundancy,
+                     handle_dio_transmit, instance);
+}
+/************************************************************************/
 /* Resets the DIO timer in the instance to its minimal interval. */
 void
 rpl_reset_dio_timer(rpl_instance_t *instance)
 {
 #if !RPL_LEAF_ONLY
-  /* Do not reset if we are already on the minimum interval,
-     unless forced to do so. */
-  if(instance->dio_intcurrent > instance->dio_intmin) {
-    instance->dio_counter = 0;
-    instance->dio_intcurrent = instance->dio_intmin;
-    new_dio_interval(instance);
-  }
+  /* The trickle timer is only restarted if it is not already on its
+     minimum interval. */
+  trickle_timer_reset(&instance->dio_trickle);
 #if RPL_CONF_STATS
   rpl_stats.resets++;
 #endif /* RPL_CONF_STATS */
 #endif /* RPL_LEAF_ONLY */
 }
 /************************************************************************/
+void
+rpl_set_dio_trickle(rpl_instance_t *instance, uint8_t intmin,
+                    uint8_t intdoubl, uint8_t redundancy)
+{
+  /* The root advertises the new parameters in its DIOs. Other nodes
+     take the parameters of the DAG again when they join a DAG. */
+  instance->dio_intmin = intmin;
+  instance->dio_intdoubl = intdoubl;
+  instance->dio_redundancy = redundancy;
+  trickle_timer_config(&instance->dio_trickle, intmin, intdoubl, redundancy);
+  rpl_reset_dio_timer(instance);
+}
+/************************************************************************/
 static void
 handle_dao_timer(void *ptr)
 {
@@ -207,8 +171,12 @@ handle_dao_timer(void *ptr)
   /* Send the DAO to the DAO parent set -- the preferred parent in our case. */
   if(instance->current_dag->preferred_parent != NULL) {
     PRINTF("RPL: handle_dao_timer - sending DAO\n");
-    /* Set the route lifetime to the default value. */
-    dao_output(instance->current_dag->preferred_parent, instance->default_lifetime);
+    if(rpl_dao_output_queued(instance)) {
+      /* More targets than fit in one DAO. */
+      ctimer_set(&instance->dao_timer, RPL_DAO_AGGREGATION_DELAY,
+                 handle_dao_timer, instance);
+      return;
+    }
   } else {
     PRINTF("RPL: No suitable DAO parent\n");
   }
@@ -220,6 +188,9 @@ rpl_schedule_dao(rpl_instance_t *instance)
 {
   clock_time_t expiration_time;
 
+  /* Set the route lifetime to the default value. */
+  rpl_dao_queue_target(instance, NULL, 0, instance->default_lifetime);
+
   expiration_time = etimer_expiration_time(&instance->dao_timer.etimer);
 
   if(!etimer_expired(&instance->dao_timer.etimer)) {
@@ -234,3 +205,17 @@ rpl_schedule_dao(rpl_instance_t *instance)
   }
 }
 /************************************************************************/
+void
+rpl_schedule_dao_forward(rpl_instance_t *instance)
+{
+  /* Targets of descendants are forwarded sooner than our own, but
+     still late enough to aggregate the DAOs of several children. */
+  if(!etimer_expired(&instance->dao_timer.etimer) &&
+     etimer_expiration_time(&instance->dao_timer.etimer) - clock_time() <=
+     RPL_DAO_AGGREGATION_DELAY) {
+    return;
+  }
+  ctimer_set(&instance->dao_timer, RPL_DAO_AGGREGATION_DELAY,
+             handle_dao_timer, instance);
+}
+/************************************************************************/
@@ -44,6 +44,7 @@
 #include "net/tcpip.h"
 #include "net/uip-ds6.h"
 #include "net/rpl/rpl-private.h"
+#include "net/rpl/rpl-ns.h"
 #include "net/neighbor-info.h"
 
 #define DEBUG DEBUG_NONE
@@ -101,6 +102,7 @@ rpl_remove_routes_by_nexthop(uip_ipaddr_t *nexthop, rpl_dag_t *dag)
       locroute->isused = 0;
     }
   }
+  uip_ds6_table_changed();
   ANNOTATE("#L %u 0\n",nexthop->u8[sizeof(uip_ipaddr_t) - 1]);
 }
 /************************************************************************/
@@ -123,6 +125,7 @@ rpl_add_route(rpl_dag_t *dag, uip_ipaddr_t *prefix, int prefix_len,
     PRINT6ADDR(next_hop);
     PRINTF("\n");
     uip_ipaddr_copy(&rep->nexthop, next_hop);
+    uip_ds6_table_changed();
   }
   rep->state.dag = dag;
   rep->state.lifetime = RPL_LIFETIME(dag->instance, dag->instance->default_lifetime);
@@ -156,7 +159,7 @@ rpl_link_neighbor_callback(const rimeaddr_t *addr, int known, int etx)
       parent = rpl_find_parent_any_dag(instance, &ipaddr);
       if(parent != NULL) {
         /* Trigger DAG rank recalculation. */
-        parent->updated = 1;
+        rpl_parent_updated(parent);
         parent->link_metric = etx;
 
         if(instance->of->parent_state_callback != NULL) {
@@ -197,7 +200,7 @@ rpl_ipv6_neighbor_callback(uip_ds6_nbr_t *nbr)
         if(p != NULL) {
           p->rank = INFINITE_RANK;
           /* Trigger DAG rank recalculation. */
-          p->updated = 1;
+          rpl_parent_updated(p);
         }
       }
     }
@@ -218,6 +221,10 @@ rpl_init(void)
   uip_create_linklocal_rplnodes_mcast(&rplmaddr);
   uip_ds6_maddr_add(&rplmaddr);
 
+#if RPL_WITH_NON_STORING
+  rpl_ns_init();
+#endif /* RPL_WITH_NON_STORING */
+
 #if RPL_CONF_STATS
   memset(&rpl_stats, 0, sizeof(rpl_stats));
 #endif
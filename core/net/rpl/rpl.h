@@ -41,6 +41,7 @@
 #include "rpl-conf.h"
 
 #include "lib/list.h"
+#include "lib/trickle-timer.h"
 #include "net/uip.h"
 #include "net/uip-ds6.h"
 #include "sys/ctimer.h"
@@ -90,16 +91,25 @@ struct rpl_metric_object_energy {
   uint8_t energy_est;
 };
 
-/* Logical representation of a DAG Metric Container. */
+/* Bit for an object type in the objects field of a metric container. */
+#define RPL_DAG_MC_BIT(type)            (1 << (type))
+
+/* Logical representation of a DAG Metric Container. The type, flags,
+   aggr, prec and length fields describe the first object, which is
+   the routing metric. The container may carry further objects that
+   share the same flags; the objects field has one RPL_DAG_MC_BIT()
+   set for each object present, including the first. */
 struct rpl_metric_container {
   uint8_t type;
   uint8_t flags;
   uint8_t aggr;
   uint8_t prec;
   uint8_t length;
-  union metric_object {
+  uint16_t objects;
+  struct metric_object {
     struct rpl_metric_object_energy energy;
     uint16_t etx;
+    uint8_t hopcount;
   } obj;
 };
 typedef struct rpl_metric_container rpl_metric_container_t;
@@ -109,6 +119,7 @@ struct rpl_dag;
 /*---------------------------------------------------------------------------*/
 struct rpl_parent {
   struct rpl_parent *next;
+  struct rpl_parent *hash_next;
   struct rpl_dag *dag;
   rpl_metric_container_t mc;
   uip_ipaddr_t addr;
@@ -192,6 +203,25 @@ struct rpl_of {
   rpl_ocp_t ocp;
 };
 typedef struct rpl_of rpl_of_t;
+
+/*
+ * Parameters of metric based objective functions. They are set to the
+ * RPL_OF_* defaults when an instance is allocated and may be changed
+ * per instance afterwards with rpl_set_of_params().
+ *
+ * hysteresis: the path cost, in the fixed point format of the ETX object,
+ * by which another parent must beat the preferred parent to replace it.
+ *
+ * etx_weight, energy_weight, hopcount_weight: the weights of the metric
+ * objects in the composite path cost. An object with a zero weight is
+ * neither used nor advertised.
+ */
+struct rpl_of_params {
+  uint16_t hysteresis;
+  uint8_t etx_weight;
+  uint8_t energy_weight;
+  uint8_t hopcount_weight;
+};
 /*---------------------------------------------------------------------------*/
 /* Instance */
 struct rpl_instance {
@@ -200,6 +230,8 @@ struct rpl_instance {
   rpl_of_t *of;
   rpl_dag_t *current_dag;
   rpl_dag_t dag_table[RPL_MAX_DAG_PER_INSTANCE];
+  /* The parents of all DAGs above, indexed by address */
+  rpl_parent_t *parent_hash[RPL_PARENT_HASH_SIZE];
   /* The current default router - used for routing "upwards" */
   uip_ds6_defrt_t *def_route;
   uint8_t instance_id;
@@ -210,20 +242,13 @@ struct rpl_instance {
   uint8_t dio_intmin;
   uint8_t dio_redundancy;
   uint8_t default_lifetime;
-  uint8_t dio_intcurrent;
-  uint8_t dio_send; /* for keeping track of which mode the timer is in */
-  uint8_t dio_counter;
   rpl_rank_t max_rankinc;
   rpl_rank_t min_hoprankinc;
   uint16_t lifetime_unit; /* lifetime in seconds = l_u * d_l */
-#if RPL_CONF_STATS
-  uint16_t dio_totint;
-  uint16_t dio_totsend;
-  uint16_t dio_totrecv;
-#endif /* RPL_CONF_STATS */
-  uint32_t dio_next_delay; /* delay for completion of dio interval */
-  struct ctimer dio_timer;
+  struct trickle_timer dio_trickle;
   struct ctimer dao_timer;
+  /* Objective function parameters of this instance */
+  struct rpl_of_params of_params;
 };
 
 /*---------------------------------------------------------------------------*/
@@ -232,6 +257,8 @@ void rpl_init(void);
 void uip_rpl_input(void);
 rpl_dag_t *rpl_set_root(uint8_t instance_id, uip_ipaddr_t * dag_id);
 int rpl_set_prefix(rpl_dag_t *dag, uip_ipaddr_t *prefix, unsigned len);
+int rpl_set_context(rpl_dag_t *dag, uint8_t cid, uip_ipaddr_t *prefix,
+                    unsigned len, uint16_t lifetime);
 int rpl_repair_root(uint8_t instance_id);
 int rpl_set_default_route(rpl_instance_t *instance, uip_ipaddr_t *from);
 rpl_dag_t *rpl_get_any_dag(void);
@@ -241,5 +268,12 @@ int rpl_update_header_final(uip_ipaddr_t *addr);
 int rpl_verify_header(int);
 void rpl_remove_header(void);
 uint8_t rpl_invert_header(void);
+int rpl_insert_srh_header(void);
+int rpl_process_srh_header(void);
+int rpl_srh_get_next_hop(uip_ipaddr_t *ipaddr);
+void rpl_set_dio_trickle(rpl_instance_t *instance, uint8_t intmin,
+                         uint8_t intdoubl, uint8_t redundancy);
+void rpl_set_of_params(rpl_instance_t *instance,
+                       const struct rpl_of_params *params);
 /*---------------------------------------------------------------------------*/
 #endif /* RPL_H */
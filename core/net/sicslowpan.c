@@ -68,6 +68,10 @@
 #include "net/sicslowpan.h"
 #include "net/neighbor-info.h"
 #include "net/netstack.h"
+#include "net/mac/macstats.h"
+#if UIP_CONF_IPV6_RPL
+#include "net/rpl/rpl.h"
+#endif /* UIP_CONF_IPV6_RPL */
 
 #define DEBUG 0
 #if DEBUG
@@ -107,6 +111,14 @@ void uip_log(char *msg);
 #define SICSLOWPAN_MAX_MAC_TRANSMISSIONS 4
 #endif
 
+/* UDP port of the IDS traffic, which is queued ahead of other data by
+   MAC layers that support traffic classes. 0 if there is none. */
+#ifdef SICSLOWPAN_CONF_IDS_PORT
+#define SICSLOWPAN_IDS_PORT SICSLOWPAN_CONF_IDS_PORT
+#else
+#define SICSLOWPAN_IDS_PORT 0
+#endif
+
 #ifndef SICSLOWPAN_COMPRESSION
 #ifdef SICSLOWPAN_CONF_COMPRESSION
 #define SICSLOWPAN_COMPRESSION SICSLOWPAN_CONF_COMPRESSION
@@ -213,53 +225,107 @@ static uint8_t rime_payload_len;
 static uint8_t uncomp_hdr_len;
 
 /**
- * the result of the last transmitted fragment
+ * The result of the fragments of the datagram that output() sends
+ * without pacing. Only failures are recorded, as a lost fragment
+ * spoils the rest of its datagram.
  */
-static int last_tx_status;
+static int frag_tx_status;
 /** @} */
 
+#if SICSLOWPAN_CONF_FRAG
+#define FRAG_FORWARDING (SICSLOWPAN_FRAG_FORWARDING && UIP_CONF_ROUTER)
+#define FRAG_PACING     (SICSLOWPAN_FRAG_PACING > 0)
+#else /* SICSLOWPAN_CONF_FRAG */
+#define FRAG_FORWARDING 0
+#define FRAG_PACING     0
+#endif /* SICSLOWPAN_CONF_FRAG */
+
 #if SICSLOWPAN_CONF_FRAG
 /** \name Fragmentation related variables
  *  @{
  */
 
-static uint16_t sicslowpan_len;
+/** Datagram tag to be put in the fragments I send. */
+static uint16_t my_tag;
 
 /**
- * The buffer used for the 6lowpan reassembly.
- * This buffer contains only the IPv6 packet (no MAC header, 6lowpan, etc).
- * It has a fix size as we do not use dynamic memory allocation.
+ * A reassembly context.
+ * Fragments are matched to a context by their sender, tag and
+ * datagram size. The received bitmap has one bit for each 8 byte unit
+ * of the IP packet, so that fragments may arrive in any order and
+ * duplicates are not counted twice.
  */
-static uip_buf_t sicslowpan_aligned_buf;
-#define sicslowpan_buf (sicslowpan_aligned_buf.u8)
+struct sicslowpan_reass {
+  rimeaddr_t sender;
+  /** Reassembly timer, the context is dropped when it expires. */
+  struct timer timer;
+  uint16_t tag;
+  /** The size of the IP packet, 0 if the context is unused. */
+  uint16_t size;
+  uint8_t received[(UIP_BUFSIZE - UIP_LLH_LEN + 63) / 64];
+  /** The buffer where the IPv6 packet is reassembled. */
+  uip_buf_t buf;
+};
 
-/** The total length of the IPv6 packet in the sicslowpan_buf. */
+static struct sicslowpan_reass reass_table[SICSLOWPAN_REASS_CONTEXTS];
 
+#if FRAG_FORWARDING
 /**
- * length of the ip packet already sent / received.
- * It includes IP and transport headers.
+ * A fragment forwarding entry.
+ * The first fragment of a datagram that is routed through us is sent
+ * on at once, and the following fragments are switched to the same
+ * next hop through this entry, with our own datagram tag.
  */
-static uint16_t processed_ip_in_len;
-
-/** Datagram tag to be put in the fragments I send. */
-static uint16_t my_tag;
+struct sicslowpan_vrb {
+  rimeaddr_t sender;
+  rimeaddr_t nexthop;
+  /** Forwarding timer, the entry is dropped when it expires. */
+  struct timer timer;
+  uint16_t tag;
+  uint16_t out_tag;
+  /** The size of the IP packet, 0 if the entry is unused. */
+  uint16_t size;
+  /** Number of bytes of the IP packet forwarded so far. */
+  uint16_t forwarded;
+  uint8_t traffic_class;
+};
 
-/** When reassembling, the tag in the fragments being merged. */
-static uint16_t reass_tag;
+static struct sicslowpan_vrb vrb_table[SICSLOWPAN_FRAG_FORWARDING_ENTRIES];
+#endif /* FRAG_FORWARDING */
 
-/** When reassembling, the source address of the fragments being merged */
-rimeaddr_t frag_sender;
+#if FRAG_PACING
+/**
+ * The datagram whose fragments are being sent by the pacing timer.
+ */
+static struct {
+  struct ctimer timer;
+  rimeaddr_t dest;
+  uint16_t tag;
+  /** The size of the IP packet, 0 if no datagram is being sent. */
+  uint16_t len;
+  /** Number of bytes of the IP packet sent so far. */
+  uint16_t processed;
+  uint8_t traffic_class;
+  /** The first failure reported for a fragment, or MAC_TX_OK. */
+  int tx_status;
+  uip_buf_t buf;
+} paced;
+#endif /* FRAG_PACING */
 
-/** Reassembly %process %timer. */
-static struct timer reass_timer;
+/**
+ * The buffer used for the 6lowpan processing.
+ * This is the buffer of the reassembly context of the fragment that
+ * is being processed, or uip_buf for packets that are not fragmented.
+ */
+static uint8_t *sicslowpan_buf;
 
 /** @} */
 #else /* SICSLOWPAN_CONF_FRAG */
 /** The buffer used for the 6lowpan processing is uip_buf.
     We do not use any additional buffer.*/
 #define sicslowpan_buf uip_buf
-#define sicslowpan_len uip_len
 #endif /* SICSLOWPAN_CONF_FRAG */
+#define sicslowpan_len uip_len
 
 /*-------------------------------------------------------------------------*/
 /* Rime Sniffer support for one single listener to enable powertrace of IP */
@@ -324,9 +390,44 @@ addr_contexts[SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS];
 /** pointer to an address context. */
 static struct sicslowpan_addr_context *context;
 
+#if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+/** Version of the context information, see sicslowpan_context_set(). */
+static uint16_t context_version;
+
+/** Ages the dynamic contexts once a minute. */
+static struct ctimer context_timer;
+#endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
+
 /** pointer to the byte where to write next inline field. */
 static uint8_t *hc06_ptr;
 
+#if SICSLOWPAN_COMPRESSION_CACHE > 0
+/**
+ * A compression cache entry.
+ * It holds the IPHC address encoding of a flow: the second IPHC byte,
+ * the context identifier byte and the inline address fields, which
+ * only depend on the addresses, the link layer destination and the
+ * address contexts.
+ */
+struct compress_cache_entry {
+  uip_ipaddr_t srcipaddr;
+  uip_ipaddr_t destipaddr;
+  rimeaddr_t lldest;
+  uint8_t used;
+  uint8_t iphc1;
+  uint8_t cid;
+  /** Length of the inline address fields. */
+  uint8_t len;
+  uint8_t addr[32];
+};
+
+static struct compress_cache_entry compress_cache[SICSLOWPAN_COMPRESSION_CACHE];
+/** The entry that is replaced next. */
+static uint8_t compress_cache_next;
+/** The entry that was used last. */
+static struct compress_cache_entry *compress_cache_last;
+#endif /* SICSLOWPAN_COMPRESSION_CACHE > 0 */
+
 /* Uncompression of linklocal */
 /*   0 -> 16 bytes from packet  */
 /*   1 -> 2 bytes from prefix - bunch of zeroes and 8 from packet */
@@ -369,6 +470,7 @@ addr_context_lookup_by_prefix(uip_ipaddr_t *ipaddr)
   int i;
   for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
     if((addr_contexts[i].used == 1) &&
+       (addr_contexts[i].flags & SICSLOWPAN_CONTEXT_COMPRESS) &&
        uip_ipaddr_prefixcmp(&addr_contexts[i].prefix, ipaddr, 64)) {
       return &addr_contexts[i];
     }
@@ -412,6 +514,256 @@ compress_addr_64(uint8_t bitpos, uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr)
   }
 }
 
+#if SICSLOWPAN_COMPRESSION_CACHE > 0
+/*--------------------------------------------------------------------*/
+/** \brief check if a cache entry holds the addresses of uip_buf */
+static int
+compress_cache_match(struct compress_cache_entry *e, const rimeaddr_t *lldest)
+{
+  return e->used &&
+    uip_ipaddr_cmp(&e->destipaddr, &UIP_IP_BUF->destipaddr) &&
+    uip_ipaddr_cmp(&e->srcipaddr, &UIP_IP_BUF->srcipaddr) &&
+    rimeaddr_cmp(&e->lldest, lldest);
+}
+/*--------------------------------------------------------------------*/
+/** \brief find the cached address encoding of the packet in uip_buf
+ *  \param lldest the link layer destination of the packet
+ */
+static struct compress_cache_entry *
+compress_cache_lookup(const rimeaddr_t *lldest)
+{
+  int i;
+
+  /* Packets of the same flow tend to come in a row. */
+  if(compress_cache_last != NULL &&
+     compress_cache_match(compress_cache_last, lldest)) {
+    return compress_cache_last;
+  }
+  for(i = 0; i < SICSLOWPAN_COMPRESSION_CACHE; i++) {
+    if(compress_cache_match(&compress_cache[i], lldest)) {
+      compress_cache_last = &compress_cache[i];
+      return compress_cache_last;
+    }
+  }
+  return NULL;
+}
+/*--------------------------------------------------------------------*/
+/** \brief remember the address encoding of the packet in uip_buf
+ *  \param lldest the link layer destination of the packet
+ *  \param iphc1 the second IPHC byte
+ *  \param cid the context identifier byte, 0 if no context is used
+ *  \param addr the inline address fields
+ *  \param len the length of the inline address fields
+ */
+static void
+compress_cache_add(const rimeaddr_t *lldest, uint8_t iphc1, uint8_t cid,
+                   const uint8_t *addr, uint8_t len)
+{
+  struct compress_cache_entry *e;
+
+  if(len > sizeof(e->addr)) {
+    return;
+  }
+  e = &compress_cache[compress_cache_next];
+  compress_cache_next = (compress_cache_next + 1) % SICSLOWPAN_COMPRESSION_CACHE;
+
+  uip_ipaddr_copy(&e->srcipaddr, &UIP_IP_BUF->srcipaddr);
+  uip_ipaddr_copy(&e->destipaddr, &UIP_IP_BUF->destipaddr);
+  rimeaddr_copy(&e->lldest, lldest);
+  e->iphc1 = iphc1;
+  e->cid = cid;
+  e->len = len;
+  memcpy(e->addr, addr, len);
+  e->used = 1;
+  compress_cache_last = e;
+}
+/*--------------------------------------------------------------------*/
+/** \brief forget all cached address encodings
+ *
+ *  Must be called when the address contexts change.
+ */
+static void
+compress_cache_flush(void)
+{
+  memset(compress_cache, 0, sizeof(compress_cache));
+  compress_cache_next = 0;
+  compress_cache_last = NULL;
+}
+#endif /* SICSLOWPAN_COMPRESSION_CACHE > 0 */
+
+#if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+/*--------------------------------------------------------------------*/
+/** \brief age the dynamic contexts by a minute
+ *
+ *  An expired context is first kept for decompression only, so that
+ *  packets compressed by neighbors that have not yet noticed the
+ *  change can still be read, and is then removed.
+ */
+static void
+context_periodic(void *ptr)
+{
+  struct sicslowpan_addr_context *c;
+  uint8_t active;
+
+  active = 0;
+  for(c = addr_contexts;
+      c < addr_contexts + SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; c++) {
+    if(c->used == 0 || !(c->flags & SICSLOWPAN_CONTEXT_DYNAMIC)) {
+      continue;
+    }
+    if(--c->lifetime == 0) {
+      if(c->flags & SICSLOWPAN_CONTEXT_COMPRESS) {
+        PRINTF("sicslowpan: context %u expired\n", c->number);
+        c->flags &= ~SICSLOWPAN_CONTEXT_COMPRESS;
+        c->lifetime = SICSLOWPAN_CONTEXT_GRACE;
+#if SICSLOWPAN_COMPRESSION_CACHE > 0
+        compress_cache_flush();
+#endif /* SICSLOWPAN_COMPRESSION_CACHE > 0 */
+      } else {
+        PRINTF("sicslowpan: context %u removed\n", c->number);
+        c->used = 0;
+      }
+    }
+    active |= c->used;
+  }
+  if(active) {
+    ctimer_reset(&context_timer);
+  }
+}
+/*--------------------------------------------------------------------*/
+int
+sicslowpan_context_update(uint8_t cid, const uint8_t *prefix,
+                          uint8_t length, uint8_t flags, uint16_t lifetime)
+{
+  struct sicslowpan_addr_context *c;
+  int i;
+
+  c = addr_context_lookup_by_number(cid);
+  if(lifetime == 0) {
+    if(c != NULL) {
+      PRINTF("sicslowpan: context %u removed\n", cid);
+      c->used = 0;
+#if SICSLOWPAN_COMPRESSION_CACHE > 0
+      compress_cache_flush();
+#endif /* SICSLOWPAN_COMPRESSION_CACHE > 0 */
+    }
+    return 1;
+  }
+
+  if(c == NULL) {
+    for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
+      if(addr_contexts[i].used == 0) {
+        c = &addr_contexts[i];
+        break;
+      }
+    }
+    if(c == NULL) {
+      PRINTF("sicslowpan: no room for context %u\n", cid);
+      return 0;
+    }
+  }
+
+  flags = (flags & SICSLOWPAN_CONTEXT_COMPRESS) | SICSLOWPAN_CONTEXT_DYNAMIC;
+  if(length > 64) {
+    length = 64;
+  }
+  if(c->used == 0 || c->flags != flags || c->length != length ||
+     memcmp(c->prefix, prefix, (length + 7) / 8) != 0) {
+    PRINTF("sicslowpan: context %u set, length %u flags 0x%02x\n",
+            cid, length, flags);
+    /* Bits beyond the prefix length are zero, so that compression
+       only matches the prefix itself. */
+    memset(c->prefix, 0, sizeof(c->prefix));
+    memcpy(c->prefix, prefix, (length + 7) / 8);
+    if(length & 7) {
+      c->prefix[length / 8] &= 0xff << (8 - (length & 7));
+    }
+    c->used = 1;
+    c->number = cid;
+    c->length = length;
+    c->flags = flags;
+    c->lifetime = lifetime;
+#if SICSLOWPAN_COMPRESSION_CACHE > 0
+    compress_cache_flush();
+#endif /* SICSLOWPAN_COMPRESSION_CACHE > 0 */
+  } else if(lifetime > c->lifetime) {
+    /* Neighbors pass on what is left of the lifetime, which must not
+       shorten a lifetime that has already been refreshed. */
+    c->lifetime = lifetime;
+  }
+
+  if(ctimer_expired(&context_timer)) {
+    ctimer_set(&context_timer, 60 * CLOCK_SECOND, context_periodic, NULL);
+  }
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+int
+sicslowpan_context_set(uint8_t cid, const uint8_t *prefix,
+                       uint8_t length, uint8_t flags, uint16_t lifetime)
+{
+  if(sicslowpan_context_update(cid, prefix, length, flags, lifetime)) {
+    context_version++;
+    return 1;
+  }
+  return 0;
+}
+/*--------------------------------------------------------------------*/
+void
+sicslowpan_context_prune(uint16_t advertised)
+{
+  struct sicslowpan_addr_context *c;
+
+  for(c = addr_contexts;
+      c < addr_contexts + SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; c++) {
+    if(c->used && (c->flags & SICSLOWPAN_CONTEXT_DYNAMIC) &&
+       (c->flags & SICSLOWPAN_CONTEXT_COMPRESS) &&
+       !(advertised & (1 << c->number))) {
+      /* Decompression only for the grace period, as on expiry */
+      PRINTF("sicslowpan: context %u no longer advertised\n", c->number);
+      c->flags &= ~SICSLOWPAN_CONTEXT_COMPRESS;
+      c->lifetime = SICSLOWPAN_CONTEXT_GRACE;
+#if SICSLOWPAN_COMPRESSION_CACHE > 0
+      compress_cache_flush();
+#endif /* SICSLOWPAN_COMPRESSION_CACHE > 0 */
+    }
+  }
+}
+/*--------------------------------------------------------------------*/
+const struct sicslowpan_addr_context *
+sicslowpan_context_get(uint8_t index)
+{
+  if(index < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS &&
+     addr_contexts[index].used &&
+     (addr_contexts[index].flags & SICSLOWPAN_CONTEXT_DYNAMIC)) {
+    return &addr_contexts[index];
+  }
+  return NULL;
+}
+/*--------------------------------------------------------------------*/
+uint16_t
+sicslowpan_context_version(void)
+{
+  return context_version;
+}
+/*--------------------------------------------------------------------*/
+int
+sicslowpan_context_accept_version(uint16_t version)
+{
+  if(version == context_version) {
+    return 0;
+  }
+  /* Serial number arithmetic, so that the version may wrap. */
+  if((int16_t)(version - context_version) < 0) {
+    return -1;
+  }
+  PRINTF("sicslowpan: context version %u -> %u\n",
+          context_version, version);
+  context_version = version;
+  return 1;
+}
+#endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
+
 /*-------------------------------------------------------------------- */
 /* Uncompress addresses based on a prefix and a postfix with zeroes in
  * between. If the postfix is zero in length it will use the link address
@@ -493,6 +845,10 @@ static void
 compress_hdr_hc06(rimeaddr_t *rime_destaddr)
 {
   uint8_t tmp, iphc0, iphc1;
+#if SICSLOWPAN_COMPRESSION_CACHE > 0
+  struct compress_cache_entry *cached;
+  uint8_t *addr_ptr;
+#endif /* SICSLOWPAN_COMPRESSION_CACHE > 0 */
 #if DEBUG
   { uint16_t ndx;
     PRINTF("before compression (%d): ", UIP_IP_BUF->len[1]);
@@ -523,6 +879,15 @@ compress_hdr_hc06(rimeaddr_t *rime_destaddr)
    */
 
 
+#if SICSLOWPAN_COMPRESSION_CACHE > 0
+  cached = compress_cache_lookup(rime_destaddr);
+  if(cached != NULL) {
+    if(cached->iphc1 & SICSLOWPAN_IPHC_CID) {
+      iphc1 |= SICSLOWPAN_IPHC_CID;
+      hc06_ptr++;
+    }
+  } else
+#endif /* SICSLOWPAN_COMPRESSION_CACHE > 0 */
   /* check if dest context exists (for allocating third byte) */
   /* TODO: fix this so that it remembers the looked up values for
      avoiding two lookups - or set the lookup values immediately */
@@ -618,6 +983,21 @@ compress_hdr_hc06(rimeaddr_t *rime_destaddr)
       break;
   }
 
+#if SICSLOWPAN_COMPRESSION_CACHE > 0
+  if(cached != NULL) {
+    /* The addresses are encoded as for the previous packet of the flow. */
+    iphc1 = cached->iphc1;
+    if(iphc1 & SICSLOWPAN_IPHC_CID) {
+      /* Without a context byte 2 already holds the first inline field. */
+      RIME_IPHC_BUF[2] = cached->cid;
+    }
+    memcpy(hc06_ptr, cached->addr, cached->len);
+    hc06_ptr += cached->len;
+    goto addresses_done;
+  }
+  addr_ptr = hc06_ptr;
+#endif /* SICSLOWPAN_COMPRESSION_CACHE > 0 */
+
   /* source address - cannot be multicast */
   if(uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
     PRINTF("IPHC: compressing unspecified - setting SAC\n");
@@ -700,6 +1080,12 @@ compress_hdr_hc06(rimeaddr_t *rime_destaddr)
     }
   }
 
+#if SICSLOWPAN_COMPRESSION_CACHE > 0
+  compress_cache_add(rime_destaddr, iphc1,
+                     (iphc1 & SICSLOWPAN_IPHC_CID) ? RIME_IPHC_BUF[2] : 0,
+                     addr_ptr, hc06_ptr - addr_ptr);
+ addresses_done:
+#endif /* SICSLOWPAN_COMPRESSION_CACHE > 0 */
   uncomp_hdr_len = UIP_IPH_LEN;
 
 #if UIP_CONF_UDP || UIP_CONF_ROUTER
@@ -1303,6 +1689,8 @@ compress_hdr_ipv6(rimeaddr_t *rime_destaddr)
 /*--------------------------------------------------------------------*/
 /**
  * Callback function for the MAC packet sent callback
+ * \param ptr where the status of the datagram of a fragment is kept,
+ * or NULL
  */
 static void
 packet_sent(void *ptr, int status, int transmissions)
@@ -1313,16 +1701,56 @@ packet_sent(void *ptr, int status, int transmissions)
   if(callback != NULL) {
     callback->output_callback(status);
   }
-  last_tx_status = status;
+  if(ptr != NULL &&
+     (status == MAC_TX_COLLISION ||
+      status == MAC_TX_ERR ||
+      status == MAC_TX_ERR_FATAL)) {
+    *(int *)ptr = status;
+  }
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Find the traffic class of an IP packet
+ * \param ip the IP header of the packet
+ *
+ * ICMPv6, which carries RPL and neighbor discovery, is control
+ * traffic. A hop-by-hop options header in front of the upper layer
+ * header, as added by RPL, is skipped.
+ */
+static uint8_t
+traffic_class(struct uip_ip_hdr *ip)
+{
+  uint8_t *next;
+  uint8_t proto;
+
+  proto = ip->proto;
+  next = (uint8_t *)ip + UIP_IPH_LEN;
+  if(proto == UIP_PROTO_HBHO) {
+    proto = next[0];
+    next += (next[1] + 1) << 3;
+  }
+
+  if(proto == UIP_PROTO_ICMP6) {
+    return PACKETBUF_ATTR_TRAFFIC_CLASS_CONTROL;
+  }
+#if SICSLOWPAN_IDS_PORT
+  if(proto == UIP_PROTO_UDP &&
+     (((struct uip_udp_hdr *)next)->srcport == UIP_HTONS(SICSLOWPAN_IDS_PORT) ||
+      ((struct uip_udp_hdr *)next)->destport == UIP_HTONS(SICSLOWPAN_IDS_PORT))) {
+    return PACKETBUF_ATTR_TRAFFIC_CLASS_IDS;
+  }
+#endif /* SICSLOWPAN_IDS_PORT */
+  return PACKETBUF_ATTR_TRAFFIC_CLASS_BULK;
 }
 /*--------------------------------------------------------------------*/
 /**
  * \brief This function is called by the 6lowpan code to send out a
  * packet.
  * \param dest the link layer destination address of the packet
+ * \param tx_status where failures are recorded, or NULL
  */
 static void
-send_packet(rimeaddr_t *dest)
+send_packet(rimeaddr_t *dest, int *tx_status)
 {
   /* Set the link layer destination address for the packet as a
    * packetbuf attribute. The MAC layer can access the destination
@@ -1337,12 +1765,85 @@ send_packet(rimeaddr_t *dest)
 
   /* Provide a callback function to receive the result of
      a packet transmission. */
-  NETSTACK_MAC.send(&packet_sent, NULL);
+  NETSTACK_MAC.send(&packet_sent, tx_status);
 
   /* If we are sending multiple packets in a row, we need to let the
      watchdog know that we are still alive. */
   watchdog_periodic();
 }
+#if FRAG_PACING || FRAG_FORWARDING
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Send a subsequent fragment of an IP packet
+ * \param dest the link layer destination address of the fragment
+ * \param size the size of the IP packet
+ * \param tag the datagram tag
+ * \param offset the offset of the fragment in the IP packet
+ * \param data the part of the IP packet to send
+ * \param len the length of the part to send
+ * \param class the traffic class of the IP packet
+ * \param tx_status where failures are recorded, or NULL
+ */
+static void
+send_fragn(rimeaddr_t *dest, uint16_t size, uint16_t tag,
+           uint16_t offset, const uint8_t *data, uint8_t len, uint8_t class,
+           int *tx_status)
+{
+  packetbuf_clear();
+  packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
+                     SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
+  packetbuf_set_attr(PACKETBUF_ATTR_TRAFFIC_CLASS, class);
+  rime_ptr = packetbuf_dataptr();
+
+  SET16(RIME_FRAG_PTR, RIME_FRAG_DISPATCH_SIZE,
+        ((SICSLOWPAN_DISPATCH_FRAGN << 8) | size));
+  SET16(RIME_FRAG_PTR, RIME_FRAG_TAG, tag);
+  RIME_FRAG_PTR[RIME_FRAG_OFFSET] = offset >> 3;
+  memcpy(rime_ptr + SICSLOWPAN_FRAGN_HDR_LEN, data, len);
+  packetbuf_set_datalen(SICSLOWPAN_FRAGN_HDR_LEN + len);
+  send_packet(dest, tx_status);
+}
+#endif /* FRAG_PACING || FRAG_FORWARDING */
+#if FRAG_PACING
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Send the next fragment of the paced datagram
+ */
+static void
+paced_send(void *ptr)
+{
+  uint16_t len;
+
+  if(paced.len == 0) {
+    return;
+  }
+
+  /* Check tx result of the previous fragments. */
+  if(paced.tx_status != MAC_TX_OK) {
+    PRINTFO("error in fragment tx, dropping subsequent fragments.\n");
+    paced.len = 0;
+    return;
+  }
+
+  len = (MAC_MAX_PAYLOAD - SICSLOWPAN_FRAGN_HDR_LEN) & 0xf8;
+  if(paced.len - paced.processed < len) {
+    /* last fragment */
+    len = paced.len - paced.processed;
+  }
+  PRINTFO("sicslowpan output: paced fragment (offset %d, len %d, tag %d)\n",
+          paced.processed >> 3, len, paced.tag);
+  send_fragn(&paced.dest, paced.len, paced.tag, paced.processed,
+             &paced.buf.u8[UIP_LLH_LEN + paced.processed], len,
+             paced.traffic_class, &paced.tx_status);
+  paced.processed += len;
+
+  if(paced.processed < paced.len) {
+    ctimer_reset(&paced.timer);
+  } else {
+    paced.len = 0;
+  }
+}
+#endif /* FRAG_PACING */
 /*--------------------------------------------------------------------*/
 /** \brief Take an IP packet and format it to be sent on an 802.15.4
  *  network using 6lowpan.
@@ -1372,6 +1873,7 @@ output(uip_lladdr_t *localdest)
 
   packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
                      SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
+  packetbuf_set_attr(PACKETBUF_ATTR_TRAFFIC_CLASS, traffic_class(UIP_IP_BUF));
 
   if(callback) {
     /* call the attribution when the callback comes, but set attributes
@@ -1426,6 +1928,7 @@ output(uip_lladdr_t *localdest)
   if(uip_len - uncomp_hdr_len > MAC_MAX_PAYLOAD - rime_hdr_len) {
 #if SICSLOWPAN_CONF_FRAG
     struct queuebuf *q;
+    int *tx_status;
     /*
      * The outbound IPv6 packet is too large to fit into a single 15.4
      * packet, so we fragment it into multiple packets and send them.
@@ -1466,15 +1969,24 @@ output(uip_lladdr_t *localdest)
       PRINTFO("could not allocate queuebuf for first fragment, dropping packet\n");
       return 0;
     }
-    send_packet(&dest);
+    /* The result of the first fragment counts for the datagram that
+       the pacing timer goes on with, if there is none yet. */
+#if FRAG_PACING
+    tx_status = paced.len == 0 ? &paced.tx_status : &frag_tx_status;
+#else /* FRAG_PACING */
+    tx_status = &frag_tx_status;
+#endif /* FRAG_PACING */
+    *tx_status = MAC_TX_OK;
+    send_packet(&dest, tx_status);
     queuebuf_to_packetbuf(q);
+    /* The following fragments are written through rime_ptr, so the
+       packetbuf must not keep using the storage of the queuebuf. */
+    packetbuf_unshare();
     queuebuf_free(q);
     q = NULL;
 
     /* Check tx result. */
-    if((last_tx_status == MAC_TX_COLLISION) ||
-       (last_tx_status == MAC_TX_ERR) ||
-       (last_tx_status == MAC_TX_ERR_FATAL)) {
+    if(*tx_status != MAC_TX_OK) {
       PRINTFO("error in fragment tx, dropping subsequent fragments.\n");
       return 0;
     }
@@ -1482,6 +1994,26 @@ output(uip_lladdr_t *localdest)
     /* set processed_ip_out_len to what we already sent from the IP payload*/
     processed_ip_out_len = rime_payload_len + uncomp_hdr_len;
     
+#if FRAG_PACING
+    if(paced.len == 0) {
+      /*
+       * Keep a copy of the IP packet and let the pacing timer send the
+       * following fragments.
+       */
+      memcpy(paced.buf.u8, uip_buf, UIP_LLH_LEN + uip_len);
+      rimeaddr_copy(&paced.dest, &dest);
+      paced.tag = GET16(RIME_FRAG_PTR, RIME_FRAG_TAG);
+      paced.len = uip_len;
+      paced.processed = processed_ip_out_len;
+      paced.traffic_class = packetbuf_attr(PACKETBUF_ATTR_TRAFFIC_CLASS);
+      ctimer_set(&paced.timer, SICSLOWPAN_FRAG_PACING, paced_send, NULL);
+      return 1;
+    }
+    /*
+     * Another datagram is being paced. This one is sent without pacing
+     * rather than flushing the other one or waiting for it.
+     */
+#endif /* FRAG_PACING */
     /*
      * Create following fragments
      * Datagram tag is already in the buffer, we need to set the
@@ -1512,16 +2044,15 @@ output(uip_lladdr_t *localdest)
         PRINTFO("could not allocate queuebuf, dropping fragment\n");
         return 0;
       }
-      send_packet(&dest);
+      send_packet(&dest, tx_status);
       queuebuf_to_packetbuf(q);
+      packetbuf_unshare();
       queuebuf_free(q);
       q = NULL;
       processed_ip_out_len += rime_payload_len;
 
       /* Check tx result. */
-      if((last_tx_status == MAC_TX_COLLISION) ||
-         (last_tx_status == MAC_TX_ERR) ||
-         (last_tx_status == MAC_TX_ERR_FATAL)) {
+      if(*tx_status != MAC_TX_OK) {
         PRINTFO("error in fragment tx, dropping subsequent fragments.\n");
         return 0;
       }
@@ -1538,11 +2069,335 @@ output(uip_lladdr_t *localdest)
     memcpy(rime_ptr + rime_hdr_len, (uint8_t *)UIP_IP_BUF + uncomp_hdr_len,
            uip_len - uncomp_hdr_len);
     packetbuf_set_datalen(uip_len - uncomp_hdr_len + rime_hdr_len);
-    send_packet(&dest);
+    send_packet(&dest, NULL);
   }
   return 1;
 }
 
+#if SICSLOWPAN_CONF_FRAG
+/*--------------------------------------------------------------------*/
+/** \brief Find the reassembly context of a fragment
+ *  \param size The size of the IP packet, from the fragment header
+ *  \param tag The datagram tag, from the fragment header
+ *  \param sender The link layer sender of the fragment
+ *  \return The context that the fragment belongs to, or NULL if
+ *  there is none and no free context is left
+ *
+ *  A new context is started if the fragment is the first one of a
+ *  datagram that we see. Contexts whose timer has expired are freed
+ *  first.
+ */
+static struct sicslowpan_reass *
+reass_lookup(uint16_t size, uint16_t tag, const rimeaddr_t *sender)
+{
+  struct sicslowpan_reass *r;
+  struct sicslowpan_reass *free_reass;
+  int i;
+
+  free_reass = NULL;
+  for(i = 0; i < SICSLOWPAN_REASS_CONTEXTS; i++) {
+    r = &reass_table[i];
+    if(r->size > 0 && timer_expired(&r->timer)) {
+      PRINTFI("sicslowpan input: reassembly timed out (tag %d)\n", r->tag);
+      r->size = 0;
+    }
+    if(r->size == 0) {
+      if(free_reass == NULL) {
+        free_reass = r;
+      }
+    } else if(r->size == size && r->tag == tag &&
+              rimeaddr_cmp(&r->sender, sender)) {
+      return r;
+    }
+  }
+
+  if(free_reass == NULL || size > UIP_BUFSIZE - UIP_LLH_LEN) {
+    return NULL;
+  }
+
+  r = free_reass;
+  r->size = size;
+  r->tag = tag;
+  rimeaddr_copy(&r->sender, sender);
+  memset(r->received, 0, sizeof(r->received));
+  timer_set(&r->timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND);
+  PRINTFI("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n",
+          size, tag);
+  return r;
+}
+/*--------------------------------------------------------------------*/
+/** \brief Record that a part of a datagram has been received
+ *  \param r The reassembly context
+ *  \param start The offset of the part in the IP packet
+ *  \param end The offset just after the part
+ *  \return 1 if the whole IP packet has been received, 0 otherwise
+ */
+static int
+reass_add(struct sicslowpan_reass *r, uint16_t start, uint16_t end)
+{
+  uint16_t unit;
+
+  for(unit = start >> 3; unit < (end + 7) >> 3; unit++) {
+    r->received[unit >> 3] |= 1 << (unit & 7);
+  }
+
+  for(unit = 0; unit < (r->size + 7) >> 3; unit++) {
+    if((r->received[unit >> 3] & (1 << (unit & 7))) == 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+#if FRAG_FORWARDING
+/*--------------------------------------------------------------------*/
+/** \brief Find the forwarding entry of a fragment
+ *  \param size The size of the IP packet, from the fragment header
+ *  \param tag The datagram tag, from the fragment header
+ *  \param sender The link layer sender of the fragment
+ *  \return The forwarding entry, or NULL if the fragment is not
+ *  being forwarded
+ */
+static struct sicslowpan_vrb *
+vrb_lookup(uint16_t size, uint16_t tag, const rimeaddr_t *sender)
+{
+  struct sicslowpan_vrb *v;
+
+  for(v = vrb_table; v < vrb_table + SICSLOWPAN_FRAG_FORWARDING_ENTRIES; v++) {
+    if(v->size > 0 && timer_expired(&v->timer)) {
+      v->size = 0;
+    }
+    if(v->size == size && v->tag == tag && rimeaddr_cmp(&v->sender, sender)) {
+      return v;
+    }
+  }
+  return NULL;
+}
+/*--------------------------------------------------------------------*/
+/** \brief Find the link layer next hop of the IP packet in uip_buf
+ *  \param lladdr Filled in with the link layer address of the next hop
+ *  \return 1 if the packet can be forwarded fragment by fragment,
+ *  0 if it must be reassembled first
+ *
+ *  Only unicast packets that are routed through us and whose next hop
+ *  is a known neighbor qualify. Packets with extension headers that
+ *  uIP would rewrite, other than the RPL hop-by-hop option, are
+ *  reassembled.
+ */
+static int
+vrb_nexthop(rimeaddr_t *lladdr)
+{
+  uip_ipaddr_t *nexthop;
+  uip_ds6_route_t *route;
+  uip_ds6_nbr_t *nbr;
+#if UIP_CONF_IPV6_RPL
+  uint8_t *ext;
+#endif /* UIP_CONF_IPV6_RPL */
+
+  if(uip_is_addr_mcast(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_link_local(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_link_local(&UIP_IP_BUF->srcipaddr) ||
+     uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr) ||
+     uip_ds6_is_my_addr(&UIP_IP_BUF->destipaddr) ||
+     UIP_IP_BUF->ttl <= 1) {
+    return 0;
+  }
+
+  switch(UIP_IP_BUF->proto) {
+  case UIP_PROTO_HBHO:
+#if UIP_CONF_IPV6_RPL
+    /* A lone RPL option is verified as in uip_process, and updated
+       before the fragment is sent on. */
+    ext = (uint8_t *)UIP_IP_BUF + UIP_IPH_LEN;
+    if(ext[1] != 0 || ext[2] != UIP_EXT_HDR_OPT_RPL) {
+      return 0;
+    }
+    uip_ext_len = 0;
+    if(rpl_verify_header(2)) {
+      return 0;
+    }
+    break;
+#else /* UIP_CONF_IPV6_RPL */
+    return 0;
+#endif /* UIP_CONF_IPV6_RPL */
+  case UIP_PROTO_ROUTING:
+  case UIP_PROTO_FRAG:
+  case UIP_PROTO_DESTO:
+    return 0;
+  default:
+    break;
+  }
+
+  if(uip_ds6_is_addr_onlink(&UIP_IP_BUF->destipaddr)) {
+    nexthop = &UIP_IP_BUF->destipaddr;
+  } else if((route = uip_ds6_route_lookup(&UIP_IP_BUF->destipaddr)) != NULL) {
+    nexthop = &route->nexthop;
+  } else if((nexthop = uip_ds6_defrt_choose()) == NULL) {
+    return 0;
+  }
+
+  nbr = uip_ds6_nbr_lookup(nexthop);
+  if(nbr == NULL || nbr->state == NBR_INCOMPLETE) {
+    return 0;
+  }
+  rimeaddr_copy(lladdr, (const rimeaddr_t *)&nbr->lladdr);
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+/** \brief Forward the first fragment of a datagram
+ *  \param r The reassembly context of the fragment
+ *  \return 1 if the fragment was forwarded, 0 if the datagram must be
+ *  reassembled
+ *
+ *  The uncompressed header of the fragment is in the reassembly
+ *  context, and its payload in packetbuf. The part of the IP packet
+ *  that the fragment holds is placed in uip_buf, the hop limit is
+ *  decremented and the header is compressed again for the next hop.
+ *  If the new header is larger, the bytes that no longer fit in the
+ *  first fragment are sent in a subsequent fragment.
+ */
+static int
+vrb_forward_first(struct sicslowpan_reass *r)
+{
+  struct sicslowpan_vrb *v;
+  struct sicslowpan_vrb *free_vrb;
+  rimeaddr_t nexthop;
+  uint16_t len;
+  uint16_t first;
+  unsigned i;
+
+  /* Fragments that arrived before the first one are only in the
+     reassembly buffer. */
+  for(i = 0; i < sizeof(r->received); i++) {
+    if(r->received[i] != 0) {
+      return 0;
+    }
+  }
+
+  if(packetbuf_datalen() < rime_hdr_len) {
+    return 0;
+  }
+  len = uncomp_hdr_len + packetbuf_datalen() - rime_hdr_len;
+  if(len >= r->size || (len & 7) != 0 ||
+     len < UIP_IPH_LEN + UIP_UDPH_LEN) {
+    return 0;
+  }
+
+  free_vrb = NULL;
+  for(v = vrb_table; v < vrb_table + SICSLOWPAN_FRAG_FORWARDING_ENTRIES; v++) {
+    if(v->size > 0 && timer_expired(&v->timer)) {
+      v->size = 0;
+    }
+    if(v->size == 0) {
+      free_vrb = v;
+      break;
+    }
+  }
+  if(free_vrb == NULL) {
+    return 0;
+  }
+
+  memcpy(UIP_IP_BUF, SICSLOWPAN_IP_BUF, uncomp_hdr_len);
+  memcpy((uint8_t *)UIP_IP_BUF + uncomp_hdr_len, rime_ptr + rime_hdr_len,
+         len - uncomp_hdr_len);
+  if(vrb_nexthop(&nexthop) == 0) {
+    uip_ext_len = 0;
+    return 0;
+  }
+
+#if UIP_CONF_IPV6_RPL
+  if(UIP_IP_BUF->proto == UIP_PROTO_HBHO) {
+    rpl_update_header_empty();
+    uip_ext_len = 0;
+  }
+#endif /* UIP_CONF_IPV6_RPL */
+  UIP_IP_BUF->ttl = UIP_IP_BUF->ttl - 1;
+
+  v = free_vrb;
+  v->size = r->size;
+  v->tag = r->tag;
+  rimeaddr_copy(&v->sender, &r->sender);
+  rimeaddr_copy(&v->nexthop, &nexthop);
+  v->out_tag = my_tag++;
+  v->forwarded = len;
+  v->traffic_class = traffic_class(UIP_IP_BUF);
+  timer_set(&v->timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND);
+  r->size = 0;
+
+  PRINTFI("sicslowpan input: forwarding fragments (len %d, tag %d -> %d)\n",
+          v->size, v->tag, v->out_tag);
+
+  /* Compress the header again, for the next hop. */
+  packetbuf_clear();
+  packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
+                     SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
+  packetbuf_set_attr(PACKETBUF_ATTR_TRAFFIC_CLASS, v->traffic_class);
+  rime_ptr = packetbuf_dataptr();
+  rime_hdr_len = 0;
+  uncomp_hdr_len = 0;
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC1
+  compress_hdr_hc1(&nexthop);
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC1 */
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_IPV6
+  compress_hdr_ipv6(&nexthop);
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_IPV6 */
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
+  compress_hdr_hc06(&nexthop);
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
+
+  memmove(rime_ptr + SICSLOWPAN_FRAG1_HDR_LEN, rime_ptr, rime_hdr_len);
+  SET16(RIME_FRAG_PTR, RIME_FRAG_DISPATCH_SIZE,
+        ((SICSLOWPAN_DISPATCH_FRAG1 << 8) | v->size));
+  SET16(RIME_FRAG_PTR, RIME_FRAG_TAG, v->out_tag);
+  rime_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
+
+  /* The first fragment must end on an 8 byte boundary. */
+  first = (uncomp_hdr_len + MAC_MAX_PAYLOAD - rime_hdr_len) & 0xfff8;
+  if(first > len) {
+    first = len;
+  }
+  memcpy(rime_ptr + rime_hdr_len, (uint8_t *)UIP_IP_BUF + uncomp_hdr_len,
+         first - uncomp_hdr_len);
+  packetbuf_set_datalen(rime_hdr_len + first - uncomp_hdr_len);
+  send_packet(&nexthop, NULL);
+
+  if(first < len) {
+    send_fragn(&nexthop, v->size, v->out_tag, first,
+               (uint8_t *)UIP_IP_BUF + first, len - first, v->traffic_class,
+               NULL);
+  }
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+/** \brief Forward a subsequent fragment through its forwarding entry
+ *  \param v The forwarding entry
+ *
+ *  The fragment is sent on as it is, with our datagram tag.
+ */
+static void
+vrb_forward(struct sicslowpan_vrb *v)
+{
+  rimeaddr_t nexthop;
+
+  rimeaddr_copy(&nexthop, &v->nexthop);
+  v->forwarded += packetbuf_datalen() - SICSLOWPAN_FRAGN_HDR_LEN;
+  if(v->forwarded >= v->size) {
+    v->size = 0;
+  }
+
+  /* Reuse the received fragment, without its link layer header and
+     attributes. */
+  packetbuf_compact();
+  packetbuf_clear_hdr();
+  packetbuf_attr_clear();
+  packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
+                     SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
+  packetbuf_set_attr(PACKETBUF_ATTR_TRAFFIC_CLASS, v->traffic_class);
+  rime_ptr = packetbuf_dataptr();
+  SET16(RIME_FRAG_PTR, RIME_FRAG_TAG, v->out_tag);
+  send_packet(&nexthop, NULL);
+}
+#endif /* FRAG_FORWARDING */
+#endif /* SICSLOWPAN_CONF_FRAG */
 /*--------------------------------------------------------------------*/
 /** \brief Process a received 6lowpan packet.
  *  \param r The MAC layer
@@ -1553,8 +2408,9 @@ output(uip_lladdr_t *localdest)
  *  copied in siclowpan_buf. If the IP packet is complete it is copied
  *  to uip_buf and the IP layer is called.
  *
- * \note We do not check for overlapping sicslowpan fragments
- * (it is a SHALL in the RFC 4944 and should never happen)
+ *  Fragments are reassembled in the context that matches their
+ *  sender, tag and size, so that several datagrams can be reassembled
+ *  at the same time and their fragments may arrive in any order.
  */
 static void
 input(void)
@@ -1566,7 +2422,9 @@ input(void)
 #if SICSLOWPAN_CONF_FRAG
   /* tag of the fragment */
   uint16_t frag_tag = 0;
-  uint8_t first_fragment = 0, last_fragment = 0;
+  /* reassembly context of the fragment */
+  struct sicslowpan_reass *reass = NULL;
+  uint16_t frag_start = 0;
 #endif /*SICSLOWPAN_CONF_FRAG*/
 
   /* init */
@@ -1577,11 +2435,8 @@ input(void)
   rime_ptr = packetbuf_dataptr();
 
 #if SICSLOWPAN_CONF_FRAG
-  /* if reassembly timed out, cancel it */
-  if(timer_expired(&reass_timer)) {
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-  }
+  sicslowpan_buf = uip_buf;
+
   /*
    * Since we don't support the mesh and broadcast header, the first header
    * we look for is the fragmentation header
@@ -1597,8 +2452,6 @@ input(void)
       PRINTFI("size %d, tag %d, offset %d)\n",
              frag_size, frag_tag, frag_offset);
       rime_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
-      /*      printf("frag1 %d %d\n", reass_tag, frag_tag);*/
-      first_fragment = 1;
       break;
     case SICSLOWPAN_DISPATCH_FRAGN:
       /*
@@ -1612,48 +2465,32 @@ input(void)
       PRINTFI("size %d, tag %d, offset %d)\n",
              frag_size, frag_tag, frag_offset);
       rime_hdr_len += SICSLOWPAN_FRAGN_HDR_LEN;
-
-      /* If this is the last fragment, we may shave off any extrenous
-         bytes at the end. We must be liberal in what we accept. */
-      PRINTFI("last_fragment?: processed_ip_in_len %d rime_payload_len %d frag_size %d\n",
-              processed_ip_in_len, packetbuf_datalen() - rime_hdr_len, frag_size);
-
-      if(processed_ip_in_len + packetbuf_datalen() - rime_hdr_len >= frag_size) {
-        last_fragment = 1;
-      }
       break;
     default:
       break;
   }
 
-  if(processed_ip_in_len > 0) {
-    /* reassembly is ongoing */
-    /*    printf("frag %d %d\n", reass_tag, frag_tag);*/
-    if((frag_size > 0 &&
-        (frag_size != sicslowpan_len ||
-         reass_tag  != frag_tag ||
-         !rimeaddr_cmp(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))))  ||
-       frag_size == 0) {
-      /*
-       * the packet is a fragment that does not belong to the packet
-       * being reassembled or the packet is not a fragment.
-       */
-      PRINTFI("sicslowpan input: Dropping 6lowpan packet that is not a fragment of the packet currently being reassembled\n");
+#if FRAG_FORWARDING
+  if(rime_hdr_len == SICSLOWPAN_FRAGN_HDR_LEN &&
+     packetbuf_datalen() >= SICSLOWPAN_FRAGN_HDR_LEN) {
+    struct sicslowpan_vrb *v;
+
+    v = vrb_lookup(frag_size, frag_tag, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+    if(v != NULL) {
+      vrb_forward(v);
       return;
     }
-  } else {
-    /*
-     * reassembly is off
-     * start it if we received a fragment
-     */
-    if((frag_size > 0) && (frag_size <= UIP_BUFSIZE)) {
-      sicslowpan_len = frag_size;
-      reass_tag = frag_tag;
-      timer_set(&reass_timer, SICSLOWPAN_REASS_MAXAGE*CLOCK_SECOND);
-      PRINTFI("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n",
-             sicslowpan_len, reass_tag);
-      rimeaddr_copy(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+  }
+#endif /* FRAG_FORWARDING */
+
+  if(frag_size > 0) {
+    reass = reass_lookup(frag_size, frag_tag,
+                         packetbuf_addr(PACKETBUF_ADDR_SENDER));
+    if(reass == NULL) {
+      PRINTFI("sicslowpan input: Dropping fragment, no reassembly context\n");
+      return;
     }
+    sicslowpan_buf = reass->buf.u8;
   }
 
   if(rime_hdr_len == SICSLOWPAN_FRAGN_HDR_LEN) {
@@ -1693,6 +2530,12 @@ input(void)
              RIME_HC1_PTR[RIME_HC1_DISPATCH]);
       return;
   }
+
+#if FRAG_FORWARDING
+  if(reass != NULL && vrb_forward_first(reass)) {
+    return;
+  }
+#endif /* FRAG_FORWARDING */
    
     
 #if SICSLOWPAN_CONF_FRAG
@@ -1710,72 +2553,72 @@ input(void)
     return;
   }
   rime_payload_len = packetbuf_datalen() - rime_hdr_len;
-  memcpy((uint8_t *)SICSLOWPAN_IP_BUF + uncomp_hdr_len + (uint16_t)(frag_offset << 3), rime_ptr + rime_hdr_len, rime_payload_len);
-  
-  /* update processed_ip_in_len if fragment, sicslowpan_len otherwise */
 
 #if SICSLOWPAN_CONF_FRAG
-  if(frag_size > 0) {
-    /* Add the size of the header only for the first fragment. */
-    if(first_fragment != 0) {
-      processed_ip_in_len += uncomp_hdr_len;
+  if(reass != NULL) {
+    frag_start = (uint16_t)(frag_offset << 3);
+    if(frag_start + uncomp_hdr_len > frag_size) {
+      PRINTFI("sicslowpan input: Dropping fragment beyond the datagram size\n");
+      return;
     }
     /* For the last fragment, we are OK if there is extrenous bytes at
        the end of the packet. */
-    if(last_fragment != 0) {
-      processed_ip_in_len = frag_size;
-    } else {
-      processed_ip_in_len += rime_payload_len;
+    if(frag_start + uncomp_hdr_len + rime_payload_len > frag_size) {
+      rime_payload_len = frag_size - frag_start - uncomp_hdr_len;
     }
-    PRINTF("processed_ip_in_len %d, rime_payload_len %d\n", processed_ip_in_len, rime_payload_len);
+  }
+#endif /* SICSLOWPAN_CONF_FRAG */
 
-  } else {
+  memcpy((uint8_t *)SICSLOWPAN_IP_BUF + uncomp_hdr_len + (uint16_t)(frag_offset << 3), rime_ptr + rime_hdr_len, rime_payload_len);
+  
+#if SICSLOWPAN_CONF_FRAG
+  if(reass != NULL) {
+    if(reass_add(reass, frag_start,
+                 frag_start + uncomp_hdr_len + rime_payload_len) == 0) {
+      /* Wait for the rest of the fragments. */
+      return;
+    }
+    /*
+     * We have a full IP packet in the reassembly buffer, copy it to
+     * uip_buf and deliver it to the IP stack
+     */
+    MACSTATS_REASSEMBLY(&reass->sender, clock_time() - reass->timer.start);
+    memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)SICSLOWPAN_IP_BUF, reass->size);
+    sicslowpan_len = reass->size;
+    reass->size = 0;
+    sicslowpan_buf = uip_buf;
+  } else
 #endif /* SICSLOWPAN_CONF_FRAG */
+  {
     sicslowpan_len = rime_payload_len + uncomp_hdr_len;
-#if SICSLOWPAN_CONF_FRAG
   }
 
-  /*
-   * If we have a full IP packet in sicslowpan_buf, deliver it to
-   * the IP stack
-   */
-  PRINTF("sicslowpan_init processed_ip_in_len %d, sicslowpan_len %d\n",
-         processed_ip_in_len, sicslowpan_len);
-  if(processed_ip_in_len == 0 || (processed_ip_in_len == sicslowpan_len)) {
-    PRINTFI("sicslowpan input: IP packet ready (length %d)\n",
-           sicslowpan_len);
-    memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)SICSLOWPAN_IP_BUF, sicslowpan_len);
-    uip_len = sicslowpan_len;
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-#endif /* SICSLOWPAN_CONF_FRAG */
+  PRINTFI("sicslowpan input: IP packet ready (length %d)\n",
+         sicslowpan_len);
 
 #if DEBUG
-    {
-      uint16_t ndx;
-      PRINTF("after decompression %u:", SICSLOWPAN_IP_BUF->len[1]);
-      for (ndx = 0; ndx < SICSLOWPAN_IP_BUF->len[1] + 40; ndx++) {
-        uint8_t data = ((uint8_t *) (SICSLOWPAN_IP_BUF))[ndx];
-        PRINTF("%02x", data);
-      }
-      PRINTF("\n");
+  {
+    uint16_t ndx;
+    PRINTF("after decompression %u:", SICSLOWPAN_IP_BUF->len[1]);
+    for (ndx = 0; ndx < SICSLOWPAN_IP_BUF->len[1] + 40; ndx++) {
+      uint8_t data = ((uint8_t *) (SICSLOWPAN_IP_BUF))[ndx];
+      PRINTF("%02x", data);
     }
+    PRINTF("\n");
+  }
 #endif
 
 #if SICSLOWPAN_CONF_NEIGHBOR_INFO
-    neighbor_info_packet_received();
+  neighbor_info_packet_received();
 #endif /* SICSLOWPAN_CONF_NEIGHBOR_INFO */
 
-    /* if callback is set then set attributes and call */
-    if(callback) {
-      set_packet_attrs();
-      callback->input_callback();
-    }
-
-    tcpip_input();
-#if SICSLOWPAN_CONF_FRAG
+  /* if callback is set then set attributes and call */
+  if(callback) {
+    set_packet_attrs();
+    callback->input_callback();
   }
-#endif /* SICSLOWPAN_CONF_FRAG */
+
+  tcpip_input();
 }
 /** @} */
 
@@ -1834,6 +2677,22 @@ sicslowpan_init(void)
   }
 #endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 1 */
 
+#if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+  {
+    int i;
+    for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
+      if(addr_contexts[i].used) {
+        addr_contexts[i].length = 64;
+        addr_contexts[i].flags = SICSLOWPAN_CONTEXT_COMPRESS;
+      }
+    }
+  }
+#endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
+
+#if SICSLOWPAN_COMPRESSION_CACHE > 0
+  compress_cache_flush();
+#endif /* SICSLOWPAN_COMPRESSION_CACHE > 0 */
+
 #endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
 }
 /*--------------------------------------------------------------------*/
@@ -222,8 +222,21 @@ struct sicslowpan_addr_context {
   uint8_t used; /* possibly use as prefix-length */
   uint8_t number;
   uint8_t prefix[8];
+  uint8_t length;    /* prefix length in bits, as advertised */
+  uint8_t flags;
+  uint16_t lifetime; /* minutes left, for contexts that are not static */
 };
 
+/**
+ * \name Address context flags
+ * @{
+ */
+/** The context may be used for compression, not only decompression */
+#define SICSLOWPAN_CONTEXT_COMPRESS 0x10
+/** The context was learned or set at runtime and expires */
+#define SICSLOWPAN_CONTEXT_DYNAMIC  0x80
+/** @} */
+
 /**
  * \name Address compressibility test functions
  * @{
@@ -318,6 +331,71 @@ struct sicslowpan_nh_compressor {
 
 };
 
+/**
+ * \name Runtime address context management
+ *
+ * Besides the contexts configured at compile time, contexts can be
+ * set at runtime, typically by the border router, and learned from
+ * neighbors. All contexts of a network share one version number
+ * that the border router increments on every change, so that stale
+ * context information is not accepted again.
+ * @{
+ */
+
+/**
+ * \brief      Add, change or remove an address context
+ * \param cid  The context identifier
+ * \param prefix The first 64 bits of the context prefix
+ * \param length The prefix length in bits
+ * \param flags SICSLOWPAN_CONTEXT_COMPRESS if the context may be used
+ *             for compression
+ * \param lifetime The valid lifetime in minutes, or 0 to remove
+ * \retval 1   The context was updated
+ * \retval 0   The context table is full
+ */
+int sicslowpan_context_update(uint8_t cid, const uint8_t *prefix,
+                              uint8_t length, uint8_t flags,
+                              uint16_t lifetime);
+
+/**
+ * \brief      Update an address context as the authority for the network
+ *
+ *             Same as sicslowpan_context_update() but also increments
+ *             the context version, so that neighbors take the change.
+ */
+int sicslowpan_context_set(uint8_t cid, const uint8_t *prefix,
+                           uint8_t length, uint8_t flags, uint16_t lifetime);
+
+/**
+ * \brief      Retire the contexts that a new version no longer lists
+ * \param advertised Bit n is set if context n is in the new list
+ *
+ *             Called once all contexts of a newly accepted version
+ *             have been updated. The dynamic contexts that are not
+ *             in the list are only used for decompression from then
+ *             on, and are removed after SICSLOWPAN_CONF_CONTEXT_GRACE
+ *             minutes, as when their lifetime runs out.
+ */
+void sicslowpan_context_prune(uint16_t advertised);
+
+/**
+ * \brief      Get the dynamic context at a position in the context table
+ * \return     The context, or NULL if the position holds no dynamic context
+ */
+const struct sicslowpan_addr_context *sicslowpan_context_get(uint8_t index);
+
+/** \brief Get the current context version */
+uint16_t sicslowpan_context_version(void);
+
+/**
+ * \brief      Check and adopt the context version of received contexts
+ * \retval -1  The version is older than ours, ignore the contexts
+ * \retval 0   The version is the one we have
+ * \retval 1   The version is newer and has been adopted
+ */
+int sicslowpan_context_accept_version(uint16_t version);
+
+/** @} */
 
 extern const struct network_driver sicslowpan_driver;
 
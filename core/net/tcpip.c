@@ -41,6 +41,8 @@
 #include "contiki-net.h"
 #include "net/uip-split.h"
 #include "net/uip-packetqueue.h"
+#include "net/uip-pktbuf.h"
+#include "lib/list.h"
 
 #if UIP_CONF_IPV6
 #include "net/uip-nd6.h"
@@ -103,9 +105,43 @@ static struct internal_state {
 enum {
   TCP_POLL,
   UDP_POLL,
-  PACKET_INPUT
+  PACKET_INPUT,
+  PACKET_INPUT_QUEUE
 };
 
+#if UIP_CONF_IPV6
+/* Number of destinations in the next hop cache (0 disables the cache) */
+#ifdef UIP_CONF_NEXTHOP_CACHE_SIZE
+#define NEXTHOP_CACHE_SIZE UIP_CONF_NEXTHOP_CACHE_SIZE
+#else /* UIP_CONF_NEXTHOP_CACHE_SIZE */
+#define NEXTHOP_CACHE_SIZE 0
+#endif /* UIP_CONF_NEXTHOP_CACHE_SIZE */
+
+#if NEXTHOP_CACHE_SIZE > 0
+/* A resolved next hop for a destination. The entry is valid as long as
+   gen matches uip_ds6_table_gen, i.e. no route, prefix, default router
+   or neighbor has been added or removed since it was filled in. */
+struct nexthop_cache_entry {
+  uip_ipaddr_t destipaddr;
+  uip_ipaddr_t nexthop;
+  uip_ds6_nbr_t *nbr;
+  uint16_t gen;
+};
+static struct nexthop_cache_entry nexthop_cache[NEXTHOP_CACHE_SIZE];
+/* The most recently used entry. A burst of packets towards the same
+   destination is resolved through this entry with one address
+   comparison per packet. */
+static struct nexthop_cache_entry *nexthop_cache_last;
+static uint8_t nexthop_cache_next;
+#endif /* NEXTHOP_CACHE_SIZE > 0 */
+#endif /* UIP_CONF_IPV6 */
+
+#if UIP_CONF_IPV6 && UIP_PKTBUF
+/* Packet buffers waiting to be processed by tcpip_process. */
+LIST(input_queue);
+static uint8_t input_queue_posted;
+#endif /* UIP_CONF_IPV6 && UIP_PKTBUF */
+
 /* Called on IP packet output. */
 #if UIP_CONF_IPV6
 
@@ -223,6 +259,36 @@ packet_input(void)
 #endif /* UIP_CONF_IP_FORWARD */
 }
 /*---------------------------------------------------------------------------*/
+#if UIP_CONF_IPV6 && UIP_PKTBUF
+static void
+packet_input_queue(void)
+{
+  struct uip_pktbuf *p;
+  uint8_t count;
+
+  input_queue_posted = 0;
+  for(count = 0; count < UIP_PKTBUF_BATCH; count++) {
+    p = list_pop(input_queue);
+    if(p == NULL) {
+      return;
+    }
+    uip_pktbuf_to_uip(p);
+    uip_pktbuf_unref(p);
+    packet_input();
+    uip_len = 0;
+    uip_ext_len = 0;
+  }
+
+  /* Leave the rest of the queue for later so that other processes
+     get to run in between batches. */
+  if(list_head(input_queue) != NULL &&
+     process_post(&tcpip_process, PACKET_INPUT_QUEUE, NULL) ==
+     PROCESS_ERR_OK) {
+    input_queue_posted = 1;
+  }
+}
+#endif /* UIP_CONF_IPV6 && UIP_PKTBUF */
+/*---------------------------------------------------------------------------*/
 #if UIP_TCP
 #if UIP_ACTIVE_OPEN
 struct uip_conn *
@@ -520,6 +586,12 @@ eventhandler(process_event_t ev, process_data_t data)
     case PACKET_INPUT:
       packet_input();
       break;
+
+#if UIP_CONF_IPV6 && UIP_PKTBUF
+    case PACKET_INPUT_QUEUE:
+      packet_input_queue();
+      break;
+#endif /* UIP_CONF_IPV6 && UIP_PKTBUF */
   };
 }
 /*---------------------------------------------------------------------------*/
@@ -533,12 +605,111 @@ tcpip_input(void)
 #endif /*UIP_CONF_IPV6*/
 }
 /*---------------------------------------------------------------------------*/
+#if UIP_CONF_IPV6 && UIP_PKTBUF
+void
+tcpip_input_pktbuf(struct uip_pktbuf *p)
+{
+  if(p == NULL) {
+    return;
+  }
+  list_add(input_queue, p);
+  if(!input_queue_posted) {
+    if(process_post(&tcpip_process, PACKET_INPUT_QUEUE, NULL) ==
+       PROCESS_ERR_OK) {
+      input_queue_posted = 1;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+tcpip_input_queue_empty(void)
+{
+  return list_head(input_queue) == NULL;
+}
+#endif /* UIP_CONF_IPV6 && UIP_PKTBUF */
+/*---------------------------------------------------------------------------*/
+#if UIP_CONF_IPV6 && NEXTHOP_CACHE_SIZE > 0
+static uip_ipaddr_t *
+nexthop_cache_lookup(uip_ipaddr_t *destipaddr, uip_ds6_nbr_t **nbr)
+{
+  struct nexthop_cache_entry *e;
+
+  e = nexthop_cache_last;
+  if(e == NULL || e->gen != uip_ds6_table_gen ||
+     !uip_ipaddr_cmp(&e->destipaddr, destipaddr)) {
+    for(e = nexthop_cache; e < &nexthop_cache[NEXTHOP_CACHE_SIZE]; e++) {
+      if(e->nbr != NULL && e->gen == uip_ds6_table_gen &&
+         uip_ipaddr_cmp(&e->destipaddr, destipaddr)) {
+        break;
+      }
+    }
+    if(e == &nexthop_cache[NEXTHOP_CACHE_SIZE]) {
+      return NULL;
+    }
+  }
+
+  /* Resolution is in progress again, take the slow path. */
+  if(e->nbr->state == NBR_INCOMPLETE) {
+    return NULL;
+  }
+  nexthop_cache_last = e;
+  /* Keep the neighbor cache replacement order intact */
+  e->nbr->last_lookup = clock_time();
+  *nbr = e->nbr;
+  return &e->nexthop;
+}
+/*---------------------------------------------------------------------------*/
+static void
+nexthop_cache_add(uip_ipaddr_t *destipaddr, uip_ipaddr_t *nexthop,
+                  uip_ds6_nbr_t *nbr)
+{
+  struct nexthop_cache_entry *e;
+
+  /* Reuse a stale entry for the same destination if there is one,
+     otherwise replace entries round-robin. */
+  for(e = nexthop_cache; e < &nexthop_cache[NEXTHOP_CACHE_SIZE]; e++) {
+    if(e->nbr != NULL && uip_ipaddr_cmp(&e->destipaddr, destipaddr)) {
+      break;
+    }
+  }
+  if(e == &nexthop_cache[NEXTHOP_CACHE_SIZE]) {
+    e = &nexthop_cache[nexthop_cache_next];
+    nexthop_cache_next = (nexthop_cache_next + 1) % NEXTHOP_CACHE_SIZE;
+  }
+  uip_ipaddr_copy(&e->destipaddr, destipaddr);
+  uip_ipaddr_copy(&e->nexthop, nexthop);
+  e->nbr = nbr;
+  e->gen = uip_ds6_table_gen;
+  nexthop_cache_last = e;
+}
+#endif /* UIP_CONF_IPV6 && NEXTHOP_CACHE_SIZE > 0 */
+/*---------------------------------------------------------------------------*/
+#if UIP_CONF_IPV6 && UIP_CONF_IPV6_QUEUE_PKT
+static void
+queue_packet(uip_ds6_nbr_t *nbr)
+{
+  struct uip_packetqueue_packet *p;
+
+  p = uip_packetqueue_alloc(&nbr->packethandle, UIP_DS6_NBR_PACKET_LIFETIME);
+  if(p != NULL) {
+    memcpy(p->queue_buf, UIP_IP_BUF, uip_len);
+    p->queue_buf_len = uip_len;
+  }
+}
+#endif /* UIP_CONF_IPV6 && UIP_CONF_IPV6_QUEUE_PKT */
+/*---------------------------------------------------------------------------*/
 #if UIP_CONF_IPV6
 void
 tcpip_ipv6_output(void)
 {
   uip_ds6_nbr_t *nbr = NULL;
   uip_ipaddr_t *nexthop;
+#if NEXTHOP_CACHE_SIZE > 0
+  uint8_t cached;
+#endif /* NEXTHOP_CACHE_SIZE > 0 */
+#if UIP_CONF_IPV6_RPL
+  uip_ipaddr_t srh_nexthop;
+#endif /* UIP_CONF_IPV6_RPL */
 
   if(uip_len == 0) {
     return;
@@ -557,9 +728,38 @@ tcpip_ipv6_output(void)
   }
 
   if(!uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
+#if UIP_CONF_IPV6_RPL
+    if(!rpl_insert_srh_header()) {
+      uip_len = 0;
+      return;
+    }
+#endif /* UIP_CONF_IPV6_RPL */
+
     /* Next hop determination */
     nbr = NULL;
-    if(uip_ds6_is_addr_onlink(&UIP_IP_BUF->destipaddr)){
+    nexthop = NULL;
+#if NEXTHOP_CACHE_SIZE > 0
+    cached = 0;
+#endif /* NEXTHOP_CACHE_SIZE > 0 */
+#if UIP_CONF_IPV6_RPL
+    if(rpl_srh_get_next_hop(&srh_nexthop)) {
+      nexthop = &srh_nexthop;
+#if NEXTHOP_CACHE_SIZE > 0
+      /* Source routed next hops depend on the routing header, not only
+         on the destination, so they are kept out of the cache. */
+      cached = 1;
+#endif /* NEXTHOP_CACHE_SIZE > 0 */
+    }
+#endif /* UIP_CONF_IPV6_RPL */
+#if NEXTHOP_CACHE_SIZE > 0
+    if(nexthop == NULL) {
+      nexthop = nexthop_cache_lookup(&UIP_IP_BUF->destipaddr, &nbr);
+      cached = nexthop != NULL;
+    }
+#endif /* NEXTHOP_CACHE_SIZE > 0 */
+    if(nexthop != NULL) {
+      /* Given by the routing header or the next hop cache */
+    } else if(uip_ds6_is_addr_onlink(&UIP_IP_BUF->destipaddr)){
       nexthop = &UIP_IP_BUF->destipaddr;
     } else {
       uip_ds6_route_t* locrt;
@@ -594,17 +794,14 @@ tcpip_ipv6_output(void)
       return;
     }
 #endif /* UIP_CONF_IPV6_RPL */
-    if((nbr = uip_ds6_nbr_lookup(nexthop)) == NULL) {
+    if(nbr == NULL && (nbr = uip_ds6_nbr_lookup(nexthop)) == NULL) {
       if((nbr = uip_ds6_nbr_add(nexthop, NULL, 0, NBR_INCOMPLETE)) == NULL) {
         uip_len = 0;
         return;
       } else {
 #if UIP_CONF_IPV6_QUEUE_PKT
         /* Copy outgoing pkt in the queuing buffer for later transmit. */
-        if(uip_packetqueue_alloc(&nbr->packethandle, UIP_DS6_NBR_PACKET_LIFETIME) != NULL) {
-          memcpy(uip_packetqueue_buf(&nbr->packethandle), UIP_IP_BUF, uip_len);
-          uip_packetqueue_set_buflen(&nbr->packethandle, uip_len);
-        }
+        queue_packet(nbr);
 #endif
       /* RFC4861, 7.2.2:
        * "If the source address of the packet prompting the solicitation is the
@@ -620,6 +817,7 @@ tcpip_ipv6_output(void)
 
         stimer_set(&nbr->sendns, uip_ds6_if.retrans_timer / 1000);
         nbr->nscount = 1;
+        UIP_DS6_WHEEL_UPDATE(nbr);
       }
     } else {
       if(nbr->state == NBR_INCOMPLETE) {
@@ -627,10 +825,7 @@ tcpip_ipv6_output(void)
 #if UIP_CONF_IPV6_QUEUE_PKT
         /* Copy outgoing pkt in the queuing buffer for later transmit and set
            the destination nbr to nbr. */
-        if(uip_packetqueue_alloc(&nbr->packethandle, UIP_DS6_NBR_PACKET_LIFETIME) != NULL) {
-          memcpy(uip_packetqueue_buf(&nbr->packethandle), UIP_IP_BUF, uip_len);
-          uip_packetqueue_set_buflen(&nbr->packethandle, uip_len);
-        }
+        queue_packet(nbr);
 #endif /*UIP_CONF_IPV6_QUEUE_PKT*/
         uip_len = 0;
         return;
@@ -641,9 +836,16 @@ tcpip_ipv6_output(void)
         nbr->state = NBR_DELAY;
         stimer_set(&nbr->reachable, UIP_ND6_DELAY_FIRST_PROBE_TIME);
         nbr->nscount = 0;
+        UIP_DS6_WHEEL_UPDATE(nbr);
         PRINTF("tcpip_ipv6_output: nbr cache entry stale moving to delay\n");
       }
 
+#if NEXTHOP_CACHE_SIZE > 0
+      if(!cached) {
+        nexthop_cache_add(&UIP_IP_BUF->destipaddr, nexthop, nbr);
+      }
+#endif /* NEXTHOP_CACHE_SIZE > 0 */
+
       tcpip_output(&nbr->lladdr);
 
 #if UIP_CONF_IPV6_QUEUE_PKT
@@ -653,10 +855,10 @@ tcpip_ipv6_output(void)
        * NA after sendiong a NS, you receive a NS with SLLAO: the entry moves
        * to STALE, and you must both send a NA and the queued packet.
        */
-      if(uip_packetqueue_buflen(&nbr->packethandle) != 0) {
+      while(uip_packetqueue_buflen(&nbr->packethandle) != 0) {
         uip_len = uip_packetqueue_buflen(&nbr->packethandle);
         memcpy(UIP_IP_BUF, uip_packetqueue_buf(&nbr->packethandle), uip_len);
-        uip_packetqueue_free(&nbr->packethandle);
+        uip_packetqueue_dequeue(&nbr->packethandle);
         tcpip_output(&nbr->lladdr);
       }
 #endif /*UIP_CONF_IPV6_QUEUE_PKT*/
@@ -755,6 +957,11 @@ PROCESS_THREAD(tcpip_process, ev, data)
 #endif /* UIP_CONF_ICMP6 */
   etimer_set(&periodic, CLOCK_SECOND / 2);
 
+#if UIP_CONF_IPV6 && UIP_PKTBUF
+  uip_pktbuf_init();
+  list_init(input_queue);
+#endif /* UIP_CONF_IPV6 && UIP_PKTBUF */
+
   uip_init();
 #ifdef UIP_FALLBACK_INTERFACE
   UIP_FALLBACK_INTERFACE.init();
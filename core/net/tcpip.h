@@ -70,6 +70,7 @@
 #include "contiki.h"
 
 struct uip_conn;
+struct uip_pktbuf;
 
 struct tcpip_uipstate {
   struct process *p;
@@ -336,6 +337,32 @@ CCIF extern process_event_t tcpip_event;
  */
 CCIF void tcpip_input(void);
 
+#if UIP_CONF_IPV6
+/**
+ * \brief      Queue an incoming packet buffer for the TCP/IP stack
+ * \param p    The packet buffer. The caller's reference is consumed.
+ *
+ *             The packet is put on the tcpip input queue and
+ *             tcpip_process later handles up to UIP_PKTBUF_BATCH
+ *             queued packets per event. This lets a driver read
+ *             several packets in a row without waiting for each one
+ *             to pass through uip_buf. Only available when
+ *             UIP_CONF_PKTBUF is set.
+ */
+void tcpip_input_pktbuf(struct uip_pktbuf *p);
+
+/**
+ * \brief      Check whether queued packet buffers wait for tcpip_process
+ * \return     Non-zero if the input queue is empty
+ *
+ *             A packet handed to tcpip_input() is processed at once,
+ *             so a driver that mixes it with tcpip_input_pktbuf()
+ *             must only do so while nothing is queued, or the
+ *             packets are reordered.
+ */
+int tcpip_input_queue_empty(void);
+#endif /* UIP_CONF_IPV6 */
+
 /**
  * \brief Output packet to layer 2
  * The eventual parameter is the MAC address of the destination.
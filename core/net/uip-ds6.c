@@ -43,6 +43,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include "lib/list.h"
 #include "lib/random.h"
 #include "net/uip-nd6.h"
 #include "net/uip-ds6.h"
@@ -78,6 +79,7 @@ uip_ds6_nbr_t uip_ds6_nbr_cache[UIP_DS6_NBR_NB];                  /** \brief Nei
 uip_ds6_defrt_t uip_ds6_defrt_list[UIP_DS6_DEFRT_NB];             /** \brief Default rt list */
 uip_ds6_prefix_t uip_ds6_prefix_list[UIP_DS6_PREFIX_NB];          /** \brief Prefix list */
 uip_ds6_route_t uip_ds6_routing_table[UIP_DS6_ROUTE_NB];          /** \brief Routing table */
+uint16_t uip_ds6_table_gen;                                       /** \brief Table generation */
 
 /* Used by Cooja to enable extraction of addresses from memory.*/
 uint8_t uip_ds6_addr_size;
@@ -98,6 +100,10 @@ static uip_ds6_nbr_t *locnbr;
 static uip_ds6_defrt_t *locdefrt;
 static uip_ds6_route_t *locroute;
 
+#if UIP_DS6_TIMER_WHEEL
+static void wheel_init(void);
+#endif /* UIP_DS6_TIMER_WHEEL */
+
 void print_routing_table() {
     printf("Routing table:\n");
     uip_ds6_route_t * tmp_route;
@@ -128,6 +134,10 @@ uip_ds6_init(void)
   memset(uip_ds6_prefix_list, 0, sizeof(uip_ds6_prefix_list));
   memset(&uip_ds6_if, 0, sizeof(uip_ds6_if));
   memset(uip_ds6_routing_table, 0, sizeof(uip_ds6_routing_table));
+  uip_ds6_table_changed();
+#if UIP_DS6_TIMER_WHEEL
+  wheel_init();
+#endif /* UIP_DS6_TIMER_WHEEL */
   uip_ds6_addr_size = sizeof(struct uip_ds6_addr);
   uip_ds6_netif_addr_list_offset = offsetof(struct uip_ds6_netif, addr_list);
 
@@ -168,34 +178,386 @@ uip_ds6_init(void)
 }
 
 
+/*---------------------------------------------------------------------------*/
+static void
+addr_periodic(uip_ds6_addr_t *addr)
+{
+  if((!addr->isinfinite) && (stimer_expired(&addr->vlifetime))) {
+    uip_ds6_addr_rm(addr);
+#if UIP_ND6_DEF_MAXDADNS > 0
+  } else if((addr->state == ADDR_TENTATIVE)
+            && (addr->dadnscount <= uip_ds6_if.maxdadns)
+            && (timer_expired(&addr->dadtimer))
+            && (uip_len == 0)) {
+    uip_ds6_dad(addr);
+#endif /* UIP_ND6_DEF_MAXDADNS > 0 */
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+defrt_periodic(uip_ds6_defrt_t *defrt)
+{
+  if((!defrt->isinfinite) && (stimer_expired(&(defrt->lifetime)))) {
+    uip_ds6_defrt_rm(defrt);
+  }
+}
+/*---------------------------------------------------------------------------*/
+#if !UIP_CONF_ROUTER
+static void
+prefix_periodic(uip_ds6_prefix_t *prefix)
+{
+  if(!prefix->isinfinite && stimer_expired(&(prefix->vlifetime))) {
+    uip_ds6_prefix_rm(prefix);
+  }
+}
+#endif /* !UIP_CONF_ROUTER */
+/*---------------------------------------------------------------------------*/
+static void
+nbr_periodic(uip_ds6_nbr_t *nbr)
+{
+  switch(nbr->state) {
+  case NBR_INCOMPLETE:
+    if(nbr->nscount >= UIP_ND6_MAX_MULTICAST_SOLICIT) {
+      uip_ds6_nbr_rm(nbr);
+    } else if(stimer_expired(&nbr->sendns) && (uip_len == 0)) {
+      nbr->nscount++;
+      PRINTF("NBR_INCOMPLETE: NS %u\n", nbr->nscount);
+      uip_nd6_ns_output(NULL, NULL, &nbr->ipaddr);
+      stimer_set(&nbr->sendns, uip_ds6_if.retrans_timer / 1000);
+    }
+    break;
+  case NBR_REACHABLE:
+    if(stimer_expired(&nbr->reachable)) {
+      PRINTF("REACHABLE: moving to STALE (");
+      PRINT6ADDR(&nbr->ipaddr);
+      PRINTF(")\n");
+      nbr->state = NBR_STALE;
+    }
+    break;
+  case NBR_DELAY:
+    if(stimer_expired(&nbr->reachable)) {
+      nbr->state = NBR_PROBE;
+      nbr->nscount = 0;
+      PRINTF("DELAY: moving to PROBE\n");
+      stimer_set(&nbr->sendns, 0);
+    }
+    break;
+  case NBR_PROBE:
+    if(nbr->nscount >= UIP_ND6_MAX_UNICAST_SOLICIT) {
+      PRINTF("PROBE END\n");
+      if((locdefrt = uip_ds6_defrt_lookup(&nbr->ipaddr)) != NULL) {
+        if (!locdefrt->isinfinite) {
+          uip_ds6_defrt_rm(locdefrt);
+        }
+      }
+      uip_ds6_nbr_rm(nbr);
+    } else if(stimer_expired(&nbr->sendns) && (uip_len == 0)) {
+      nbr->nscount++;
+      PRINTF("PROBE: NS %u\n", nbr->nscount);
+      uip_nd6_ns_output(NULL, &nbr->ipaddr, &nbr->ipaddr);
+      stimer_set(&nbr->sendns, uip_ds6_if.retrans_timer / 1000);
+    }
+    break;
+  default:
+    break;
+  }
+}
+#if UIP_DS6_TIMER_WHEEL
+/*---------------------------------------------------------------------------*/
+/*
+ * Hierarchical timer wheel. Level 0 has one slot per UIP_DS6_PERIOD,
+ * every further level covers WHEEL_SLOTS slots of the level below and
+ * is cascaded down when the level below wraps around. An entry is only
+ * on the wheel while one of its timers is running, and when its slot
+ * comes up the same per entry processing as the table sweep is done,
+ * after which the entry is rescheduled from its (possibly changed)
+ * timers. Entries expiring beyond the span of the wheel are parked at
+ * its far end and simply rescheduled when they come up.
+ */
+#define WHEEL_BITS   5
+#define WHEEL_SLOTS  (1 << WHEEL_BITS)
+#define WHEEL_MASK   (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 3
+#define WHEEL_SPAN   ((uint32_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+#define WHEEL_TICKS_PER_SECOND (CLOCK_SECOND / UIP_DS6_PERIOD)
+
+#define WHEEL_ADDR   0
+#define WHEEL_DEFRT  1
+#define WHEEL_PREFIX 2
+#define WHEEL_NBR    3
+
+#define WHEEL_ENTRY(w, type) ((type *)((char *)(w) - offsetof(type, wheel)))
+
+static void *wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static uint32_t wheel_now;
+static clock_time_t wheel_last;
+
+/*---------------------------------------------------------------------------*/
+static void
+wheel_insert(uip_ds6_wheel_t *w, uint32_t expires)
+{
+  uint32_t delta;
+  uint8_t level;
+  uint8_t shift;
+
+  delta = expires - wheel_now;
+  if((int32_t)delta < 0) {
+    delta = 0;
+    expires = wheel_now;
+  } else if(delta >= WHEEL_SPAN) {
+    delta = WHEEL_SPAN - 1;
+    expires = wheel_now + delta;
+  }
+  w->expires = expires;
+
+  level = 0;
+  shift = 0;
+  while(delta >= ((uint32_t)WHEEL_SLOTS << shift)) {
+    level++;
+    shift += WHEEL_BITS;
+  }
+  w->slot = &wheel[level][(expires >> shift) & WHEEL_MASK];
+  list_add(w->slot, w);
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+stimer_due(struct stimer *t)
+{
+  unsigned long remaining;
+
+  if(stimer_expired(t)) {
+    return wheel_now;
+  }
+  remaining = stimer_remaining(t);
+  if(remaining >= WHEEL_SPAN / WHEEL_TICKS_PER_SECOND) {
+    return wheel_now + WHEEL_SPAN;
+  }
+  return wheel_now + remaining * WHEEL_TICKS_PER_SECOND;
+}
+/*---------------------------------------------------------------------------*/
+#if UIP_ND6_DEF_MAXDADNS > 0
+static uint32_t
+timer_due(struct timer *t)
+{
+  if(timer_expired(t)) {
+    return wheel_now;
+  }
+  return wheel_now +
+    (timer_remaining(t) + UIP_DS6_PERIOD - 1) / UIP_DS6_PERIOD;
+}
+#endif /* UIP_ND6_DEF_MAXDADNS > 0 */
+/*---------------------------------------------------------------------------*/
+/*
+ * Compute when an entry next needs attention. Returns 0 if none of its
+ * timers are running.
+ */
+static uint8_t
+wheel_next_expiry(uip_ds6_wheel_t *w, uint32_t *expires)
+{
+  uip_ds6_addr_t *addr;
+  uip_ds6_defrt_t *defrt;
+  uip_ds6_nbr_t *nbr;
+#if !UIP_CONF_ROUTER
+  uip_ds6_prefix_t *prefix;
+#endif /* !UIP_CONF_ROUTER */
+  uint8_t running;
+#if UIP_ND6_DEF_MAXDADNS > 0
+  uint32_t dad;
+#endif /* UIP_ND6_DEF_MAXDADNS > 0 */
+
+  running = 0;
+  switch(w->type) {
+  case WHEEL_ADDR:
+    addr = WHEEL_ENTRY(w, uip_ds6_addr_t);
+    if(!addr->isused) {
+      break;
+    }
+    if(!addr->isinfinite) {
+      *expires = stimer_due(&addr->vlifetime);
+      running = 1;
+    }
+#if UIP_ND6_DEF_MAXDADNS > 0
+    if(addr->state == ADDR_TENTATIVE &&
+       addr->dadnscount <= uip_ds6_if.maxdadns) {
+      dad = timer_due(&addr->dadtimer);
+      if(!running || (int32_t)(dad - *expires) < 0) {
+        *expires = dad;
+      }
+      running = 1;
+    }
+#endif /* UIP_ND6_DEF_MAXDADNS > 0 */
+    break;
+  case WHEEL_DEFRT:
+    defrt = WHEEL_ENTRY(w, uip_ds6_defrt_t);
+    if(defrt->isused && !defrt->isinfinite) {
+      *expires = stimer_due(&defrt->lifetime);
+      running = 1;
+    }
+    break;
+#if !UIP_CONF_ROUTER
+  case WHEEL_PREFIX:
+    prefix = WHEEL_ENTRY(w, uip_ds6_prefix_t);
+    if(prefix->isused && !prefix->isinfinite) {
+      *expires = stimer_due(&prefix->vlifetime);
+      running = 1;
+    }
+    break;
+#endif /* !UIP_CONF_ROUTER */
+  case WHEEL_NBR:
+    nbr = WHEEL_ENTRY(w, uip_ds6_nbr_t);
+    if(!nbr->isused) {
+      break;
+    }
+    running = 1;
+    switch(nbr->state) {
+    case NBR_INCOMPLETE:
+      *expires = nbr->nscount >= UIP_ND6_MAX_MULTICAST_SOLICIT ?
+        wheel_now : stimer_due(&nbr->sendns);
+      break;
+    case NBR_REACHABLE:
+    case NBR_DELAY:
+      *expires = stimer_due(&nbr->reachable);
+      break;
+    case NBR_PROBE:
+      *expires = nbr->nscount >= UIP_ND6_MAX_UNICAST_SOLICIT ?
+        wheel_now : stimer_due(&nbr->sendns);
+      break;
+    default:
+      running = 0;
+      break;
+    }
+    break;
+  }
+  return running;
+}
 /*---------------------------------------------------------------------------*/
 void
-uip_ds6_periodic(void)
+uip_ds6_wheel_update(uip_ds6_wheel_t *w)
 {
+  uint32_t expires;
 
+  if(w->slot != NULL) {
+    list_remove(w->slot, w);
+    w->slot = NULL;
+  }
+  if(wheel_next_expiry(w, &expires)) {
+    /* Never schedule on the slot that is currently being processed */
+    if((int32_t)(expires - wheel_now) <= 0) {
+      expires = wheel_now + 1;
+    }
+    wheel_insert(w, expires);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+wheel_expire(uip_ds6_wheel_t *w)
+{
+  switch(w->type) {
+  case WHEEL_ADDR:
+    addr_periodic(WHEEL_ENTRY(w, uip_ds6_addr_t));
+    break;
+  case WHEEL_DEFRT:
+    defrt_periodic(WHEEL_ENTRY(w, uip_ds6_defrt_t));
+    break;
+#if !UIP_CONF_ROUTER
+  case WHEEL_PREFIX:
+    prefix_periodic(WHEEL_ENTRY(w, uip_ds6_prefix_t));
+    break;
+#endif /* !UIP_CONF_ROUTER */
+  case WHEEL_NBR:
+    nbr_periodic(WHEEL_ENTRY(w, uip_ds6_nbr_t));
+    break;
+  }
+  /* Removed entries have already been taken off the wheel */
+  uip_ds6_wheel_update(w);
+}
+/*---------------------------------------------------------------------------*/
+static void
+wheel_cascade(void)
+{
+  uip_ds6_wheel_t *w;
+  uint8_t level;
+  uint8_t shift;
+  uint8_t index;
+
+  for(level = 1, shift = WHEEL_BITS; level < WHEEL_LEVELS;
+      level++, shift += WHEEL_BITS) {
+    index = (wheel_now >> shift) & WHEEL_MASK;
+    while((w = list_pop(&wheel[level][index])) != NULL) {
+      w->slot = NULL;
+      wheel_insert(w, w->expires);
+    }
+    if(index != 0) {
+      break;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+wheel_run(void)
+{
+  uip_ds6_wheel_t *w;
+  uint8_t index;
+
+  while((clock_time_t)(clock_time() - wheel_last) >= UIP_DS6_PERIOD) {
+    wheel_last += UIP_DS6_PERIOD;
+    wheel_now++;
+    index = wheel_now & WHEEL_MASK;
+    if(index == 0) {
+      wheel_cascade();
+    }
+    while((w = list_pop(&wheel[0][index])) != NULL) {
+      w->slot = NULL;
+      wheel_expire(w);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+wheel_init(void)
+{
+  uint8_t i;
+
+  memset(wheel, 0, sizeof(wheel));
+  wheel_now = 0;
+  wheel_last = clock_time();
+
+  for(i = 0; i < UIP_DS6_ADDR_NB; i++) {
+    uip_ds6_if.addr_list[i].wheel.type = WHEEL_ADDR;
+  }
+  for(i = 0; i < UIP_DS6_DEFRT_NB; i++) {
+    uip_ds6_defrt_list[i].wheel.type = WHEEL_DEFRT;
+  }
+#if !UIP_CONF_ROUTER
+  for(i = 0; i < UIP_DS6_PREFIX_NB; i++) {
+    uip_ds6_prefix_list[i].wheel.type = WHEEL_PREFIX;
+  }
+#endif /* !UIP_CONF_ROUTER */
+  for(i = 0; i < UIP_DS6_NBR_NB; i++) {
+    uip_ds6_nbr_cache[i].wheel.type = WHEEL_NBR;
+  }
+}
+#endif /* UIP_DS6_TIMER_WHEEL */
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_periodic(void)
+{
+#if UIP_DS6_TIMER_WHEEL
+  wheel_run();
+#else /* UIP_DS6_TIMER_WHEEL */
   /* Periodic processing on unicast addresses */
   for(locaddr = uip_ds6_if.addr_list;
       locaddr < uip_ds6_if.addr_list + UIP_DS6_ADDR_NB; locaddr++) {
     if(locaddr->isused) {
-      if((!locaddr->isinfinite) && (stimer_expired(&locaddr->vlifetime))) {
-        uip_ds6_addr_rm(locaddr);
-#if UIP_ND6_DEF_MAXDADNS > 0
-      } else if((locaddr->state == ADDR_TENTATIVE)
-                && (locaddr->dadnscount <= uip_ds6_if.maxdadns)
-                && (timer_expired(&locaddr->dadtimer))
-                && (uip_len == 0)) {
-        uip_ds6_dad(locaddr);
-#endif /* UIP_ND6_DEF_MAXDADNS > 0 */
-      }
+      addr_periodic(locaddr);
     }
   }
 
   /* Periodic processing on default routers */
   for(locdefrt = uip_ds6_defrt_list;
       locdefrt < uip_ds6_defrt_list + UIP_DS6_DEFRT_NB; locdefrt++) {
-    if((locdefrt->isused) && (!locdefrt->isinfinite) &&
-       (stimer_expired(&(locdefrt->lifetime)))) {
-      uip_ds6_defrt_rm(locdefrt);
+    if(locdefrt->isused) {
+      defrt_periodic(locdefrt);
     }
   }
 
@@ -204,9 +566,8 @@ uip_ds6_periodic(void)
   for(locprefix = uip_ds6_prefix_list;
       locprefix < uip_ds6_prefix_list + UIP_DS6_PREFIX_NB;
       locprefix++) {
-    if(locprefix->isused && !locprefix->isinfinite
-       && stimer_expired(&(locprefix->vlifetime))) {
-      uip_ds6_prefix_rm(locprefix);
+    if(locprefix->isused) {
+      prefix_periodic(locprefix);
     }
   }
 #endif /* !UIP_CONF_ROUTER */
@@ -216,54 +577,10 @@ uip_ds6_periodic(void)
       locnbr < uip_ds6_nbr_cache + UIP_DS6_NBR_NB;
       locnbr++) {
     if(locnbr->isused) {
-      switch(locnbr->state) {
-      case NBR_INCOMPLETE:
-        if(locnbr->nscount >= UIP_ND6_MAX_MULTICAST_SOLICIT) {
-          uip_ds6_nbr_rm(locnbr);
-        } else if(stimer_expired(&locnbr->sendns) && (uip_len == 0)) {
-          locnbr->nscount++;
-          PRINTF("NBR_INCOMPLETE: NS %u\n", locnbr->nscount);
-          uip_nd6_ns_output(NULL, NULL, &locnbr->ipaddr);
-          stimer_set(&locnbr->sendns, uip_ds6_if.retrans_timer / 1000);
-        }
-        break;
-      case NBR_REACHABLE:
-        if(stimer_expired(&locnbr->reachable)) {
-          PRINTF("REACHABLE: moving to STALE (");
-          PRINT6ADDR(&locnbr->ipaddr);
-          PRINTF(")\n");
-          locnbr->state = NBR_STALE;
-        }
-        break;
-      case NBR_DELAY:
-        if(stimer_expired(&locnbr->reachable)) {
-          locnbr->state = NBR_PROBE;
-          locnbr->nscount = 0;
-          PRINTF("DELAY: moving to PROBE\n");
-          stimer_set(&locnbr->sendns, 0);
-        }
-        break;
-      case NBR_PROBE:
-        if(locnbr->nscount >= UIP_ND6_MAX_UNICAST_SOLICIT) {
-          PRINTF("PROBE END\n");
-          if((locdefrt = uip_ds6_defrt_lookup(&locnbr->ipaddr)) != NULL) {
-            if (!locdefrt->isinfinite) {
-              uip_ds6_defrt_rm(locdefrt);
-            }
-          }
-          uip_ds6_nbr_rm(locnbr);
-        } else if(stimer_expired(&locnbr->sendns) && (uip_len == 0)) {
-          locnbr->nscount++;
-          PRINTF("PROBE: NS %u\n", locnbr->nscount);
-          uip_nd6_ns_output(NULL, &locnbr->ipaddr, &locnbr->ipaddr);
-          stimer_set(&locnbr->sendns, uip_ds6_if.retrans_timer / 1000);
-        }
-        break;
-      default:
-        break;
-      }
+      nbr_periodic(locnbr);
     }
   }
+#endif /* UIP_DS6_TIMER_WHEEL */
 
 #if UIP_CONF_ROUTER & UIP_ND6_SEND_RA
   /* Periodic RA sending */
@@ -336,6 +653,8 @@ uip_ds6_nbr_add(uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr,
     PRINTF("link addr ");
     PRINTLLADDR((&(locnbr->lladdr)));
     PRINTF("state %u\n", state);
+    uip_ds6_table_changed();
+    UIP_DS6_WHEEL_UPDATE(locnbr);
     NEIGHBOR_STATE_CHANGED(locnbr);
 
     locnbr->last_lookup = clock_time();
@@ -377,6 +696,8 @@ uip_ds6_nbr_rm(uip_ds6_nbr_t *nbr)
 #if UIP_CONF_IPV6_QUEUE_PKT
     uip_packetqueue_free(&nbr->packethandle);
 #endif /* UIP_CONF_IPV6_QUEUE_PKT */
+    UIP_DS6_WHEEL_UPDATE(nbr);
+    uip_ds6_table_changed();
     NEIGHBOR_STATE_CHANGED(nbr);
   }
   return;
@@ -436,6 +757,8 @@ uip_ds6_defrt_add(uip_ipaddr_t *ipaddr, unsigned long interval)
     PRINTF("\n");
 
     ANNOTATE("#L %u 1\n", ipaddr->u8[sizeof(uip_ipaddr_t) - 1]);
+    UIP_DS6_WHEEL_UPDATE(locdefrt);
+    uip_ds6_table_changed();
 
     return locdefrt;
   }
@@ -449,6 +772,8 @@ uip_ds6_defrt_rm(uip_ds6_defrt_t *defrt)
   if(defrt != NULL) {
     defrt->isused = 0;
     ANNOTATE("#L %u 0\n", defrt->ipaddr.u8[sizeof(uip_ipaddr_t) - 1]);
+    UIP_DS6_WHEEL_UPDATE(defrt);
+    uip_ds6_table_changed();
   }
   return;
 }
@@ -517,6 +842,7 @@ uip_ds6_prefix_add(uip_ipaddr_t *ipaddr, uint8_t ipaddrlen,
     PRINT6ADDR(&locprefix->ipaddr);
     PRINTF("length %u, flags %x, Valid lifetime %lx, Preffered lifetime %lx\n",
        ipaddrlen, flags, vtime, ptime);
+    uip_ds6_table_changed();
     return locprefix;
   } else {
     PRINTF("No more space in Prefix list\n");
@@ -546,6 +872,8 @@ uip_ds6_prefix_add(uip_ipaddr_t *ipaddr, uint8_t ipaddrlen,
     PRINTF("Adding prefix ");
     PRINT6ADDR(&locprefix->ipaddr);
     PRINTF("length %u, vlifetime%lu\n", ipaddrlen, interval);
+    UIP_DS6_WHEEL_UPDATE(locprefix);
+    uip_ds6_table_changed();
   }
   return NULL;
 }
@@ -557,6 +885,10 @@ uip_ds6_prefix_rm(uip_ds6_prefix_t *prefix)
 {
   if(prefix != NULL) {
     prefix->isused = 0;
+#if !UIP_CONF_ROUTER
+    UIP_DS6_WHEEL_UPDATE(prefix);
+#endif /* !UIP_CONF_ROUTER */
+    uip_ds6_table_changed();
   }
   return;
 }
@@ -613,6 +945,7 @@ uip_ds6_addr_add(uip_ipaddr_t *ipaddr, unsigned long vlifetime, uint8_t type)
 #else /* UIP_ND6_DEF_MAXDADNS > 0 */
     locaddr->state = ADDR_PREFERRED;
 #endif /* UIP_ND6_DEF_MAXDADNS > 0 */
+    UIP_DS6_WHEEL_UPDATE(locaddr);
     uip_create_solicited_node(ipaddr, &loc_fipaddr);
     uip_ds6_maddr_add(&loc_fipaddr);
     return locaddr;
@@ -630,6 +963,7 @@ uip_ds6_addr_rm(uip_ds6_addr_t *addr)
       uip_ds6_maddr_rm(locmaddr);
     }
     addr->isused = 0;
+    UIP_DS6_WHEEL_UPDATE(addr);
   }
   return;
 }
@@ -821,6 +1155,7 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length, uip_ipaddr_t *nexthop,
     PRINT6ADDR(nexthop);
     PRINTF("\n");
     ANNOTATE("#L %u 1;blue\n", nexthop->u8[sizeof(uip_ipaddr_t) - 1]);
+    uip_ds6_table_changed();
   }
 
   return locroute;
@@ -831,6 +1166,7 @@ void
 uip_ds6_route_rm(uip_ds6_route_t *route)
 {
   route->isused = 0;
+  uip_ds6_table_changed();
 #if (DEBUG & DEBUG_ANNOTATE) == DEBUG_ANNOTATE
   /* we need to check if this was the last route towards "nexthop" */
   /* if so - remove that link (annotation) */
@@ -856,6 +1192,7 @@ uip_ds6_route_rm_by_nexthop(uip_ipaddr_t *nexthop)
       locroute->isused = 0;
     }
   }
+  uip_ds6_table_changed();
   ANNOTATE("#L %u 0\n",nexthop->u8[sizeof(uip_ipaddr_t) - 1]);
 }
 
@@ -159,6 +159,32 @@
 #define FREESPACE 1
 #define NOSPACE 2
 
+/*--------------------------------------------------*/
+/** \brief Age DS6 entries on a timer wheel. Only the entries whose
+ * lifetime or reachability timer is due are visited on each period,
+ * instead of sweeping all tables. */
+#ifdef UIP_CONF_DS6_TIMER_WHEEL
+#define UIP_DS6_TIMER_WHEEL UIP_CONF_DS6_TIMER_WHEEL
+#else
+#define UIP_DS6_TIMER_WHEEL 0
+#endif
+
+#if UIP_DS6_TIMER_WHEEL
+/** \brief Timer wheel hook, embedded in every timed DS6 entry */
+typedef struct uip_ds6_wheel {
+  struct uip_ds6_wheel *next;
+  void **slot;                  /* wheel slot the entry is on, or NULL */
+  uint32_t expires;             /* in UIP_DS6_PERIOD ticks */
+  uint8_t type;
+} uip_ds6_wheel_t;
+
+/** \brief Reschedule an entry after its timers or state changed */
+void uip_ds6_wheel_update(uip_ds6_wheel_t *w);
+#define UIP_DS6_WHEEL_UPDATE(e) uip_ds6_wheel_update(&(e)->wheel)
+#else /* UIP_DS6_TIMER_WHEEL */
+#define UIP_DS6_WHEEL_UPDATE(e)
+#endif /* UIP_DS6_TIMER_WHEEL */
+
 
 /*--------------------------------------------------*/
 #if UIP_CONF_IPV6_QUEUE_PKT
@@ -179,6 +205,9 @@ typedef struct uip_ds6_nbr {
   struct uip_packetqueue_handle packethandle;
 #define UIP_DS6_NBR_PACKET_LIFETIME CLOCK_SECOND * 4
 #endif                          /*UIP_CONF_QUEUE_PKT */
+#if UIP_DS6_TIMER_WHEEL
+  uip_ds6_wheel_t wheel;
+#endif /* UIP_DS6_TIMER_WHEEL */
 } uip_ds6_nbr_t;
 
 /** \brief An entry in the default router list */
@@ -187,6 +216,9 @@ typedef struct uip_ds6_defrt {
   uip_ipaddr_t ipaddr;
   struct stimer lifetime;
   uint8_t isinfinite;
+#if UIP_DS6_TIMER_WHEEL
+  uip_ds6_wheel_t wheel;
+#endif /* UIP_DS6_TIMER_WHEEL */
 } uip_ds6_defrt_t;
 
 /** \brief A prefix list entry */
@@ -207,6 +239,9 @@ typedef struct uip_ds6_prefix {
   uint8_t length;
   struct stimer vlifetime;
   uint8_t isinfinite;
+#if UIP_DS6_TIMER_WHEEL
+  uip_ds6_wheel_t wheel;
+#endif /* UIP_DS6_TIMER_WHEEL */
 } uip_ds6_prefix_t;
 #endif /*UIP_CONF_ROUTER */
 
@@ -222,6 +257,9 @@ typedef struct uip_ds6_addr {
   struct timer dadtimer;
   uint8_t dadnscount;
 #endif /* UIP_ND6_DEF_MAXDADNS > 0 */
+#if UIP_DS6_TIMER_WHEEL
+  uip_ds6_wheel_t wheel;
+#endif /* UIP_DS6_TIMER_WHEEL */
 } uip_ds6_addr_t;
 
 /** \brief Anycast address  */
@@ -294,6 +332,13 @@ typedef struct uip_ds6_element {
 extern uip_ds6_netif_t uip_ds6_if;
 extern struct etimer uip_ds6_timer_periodic;
 
+/** \brief Generation counter of the tables that next hop determination
+ * depends on (neighbor cache, default router list, prefix list and
+ * routing table). It is incremented on every change to these tables so
+ * that lookup results can be cached and invalidated cheaply. */
+extern uint16_t uip_ds6_table_gen;
+#define uip_ds6_table_changed() (uip_ds6_table_gen++)
+
 #if UIP_CONF_ROUTER
 extern uip_ds6_prefix_t uip_ds6_prefix_list[UIP_DS6_PREFIX_NB];
 #else /* UIP_CONF_ROUTER */
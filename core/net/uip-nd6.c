@@ -73,6 +73,9 @@
 #include "net/uip-nd6.h"
 #include "net/uip-ds6.h"
 #include "lib/random.h"
+#if UIP_ND6_6CO
+#include "net/sicslowpan.h"
+#endif /* UIP_ND6_6CO */
 
 /*------------------------------------------------------------------*/
 #define DEBUG 0
@@ -112,6 +115,8 @@ void uip_log(char *msg);
 #define UIP_ND6_OPT_HDR_BUF  ((uip_nd6_opt_hdr *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
 #define UIP_ND6_OPT_PREFIX_BUF ((uip_nd6_opt_prefix_info *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
 #define UIP_ND6_OPT_MTU_BUF ((uip_nd6_opt_mtu *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
+#define UIP_ND6_OPT_ABRO_BUF ((uip_nd6_opt_abro *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
+#define UIP_ND6_OPT_6CO_BUF ((uip_nd6_opt_6co *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
 /** @} */
 
 static uint8_t nd6_opt_offset;                     /** Offset from the end of the icmpv6 header to the option in uip_buf*/
@@ -480,6 +485,7 @@ uip_nd6_na_input(void)
 
         /* reachable time is stored in ms */
         stimer_set(&(nbr->reachable), uip_ds6_if.reachable_time / 1000);
+        UIP_DS6_WHEEL_UPDATE(nbr);
 
       } else {
         nbr->state = NBR_STALE;
@@ -502,6 +508,7 @@ uip_nd6_na_input(void)
             nbr->state = NBR_REACHABLE;
             /* reachable time is stored in ms */
             stimer_set(&(nbr->reachable), uip_ds6_if.reachable_time / 1000);
+            UIP_DS6_WHEEL_UPDATE(nbr);
           } else {
             if(nd6_opt_llao != 0 && is_llchange) {
               nbr->state = NBR_STALE;
@@ -529,7 +536,7 @@ uip_nd6_na_input(void)
   if(uip_packetqueue_buflen(&nbr->packethandle) != 0) {
     uip_len = uip_packetqueue_buflen(&nbr->packethandle);
     memcpy(UIP_IP_BUF, uip_packetqueue_buf(&nbr->packethandle), uip_len);
-    uip_packetqueue_free(&nbr->packethandle);
+    uip_packetqueue_dequeue(&nbr->packethandle);
     return;
   }
   
@@ -694,6 +701,46 @@ uip_nd6_ra_output(uip_ipaddr_t * dest)
 
   uip_len += UIP_ND6_OPT_MTU_LEN;
   nd6_opt_offset += UIP_ND6_OPT_MTU_LEN;
+
+#if UIP_ND6_6CO
+  /* 6LoWPAN contexts, preceded by the version that they belong to */
+  {
+    const struct sicslowpan_addr_context *context;
+    uip_ds6_addr_t *addr;
+    uint8_t i;
+
+    UIP_ND6_OPT_ABRO_BUF->type = UIP_ND6_OPT_ABRO;
+    UIP_ND6_OPT_ABRO_BUF->len = UIP_ND6_OPT_ABRO_LEN >> 3;
+    UIP_ND6_OPT_ABRO_BUF->version_low = uip_htons(sicslowpan_context_version());
+    UIP_ND6_OPT_ABRO_BUF->version_high = 0;
+    UIP_ND6_OPT_ABRO_BUF->lifetime = 0; /* default lifetime */
+    addr = uip_ds6_get_global(ADDR_PREFERRED);
+    if(addr != NULL) {
+      uip_ipaddr_copy(&UIP_ND6_OPT_ABRO_BUF->address, &addr->ipaddr);
+    } else {
+      uip_ipaddr_copy(&UIP_ND6_OPT_ABRO_BUF->address, &UIP_IP_BUF->srcipaddr);
+    }
+    uip_len += UIP_ND6_OPT_ABRO_LEN;
+    nd6_opt_offset += UIP_ND6_OPT_ABRO_LEN;
+
+    for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
+      context = sicslowpan_context_get(i);
+      if(context != NULL) {
+        UIP_ND6_OPT_6CO_BUF->type = UIP_ND6_OPT_6CO;
+        UIP_ND6_OPT_6CO_BUF->len = UIP_ND6_OPT_6CO_LEN >> 3;
+        UIP_ND6_OPT_6CO_BUF->context_len = context->length;
+        UIP_ND6_OPT_6CO_BUF->flags_cid =
+          (context->flags & SICSLOWPAN_CONTEXT_COMPRESS) | context->number;
+        UIP_ND6_OPT_6CO_BUF->reserved = 0;
+        UIP_ND6_OPT_6CO_BUF->lifetime = uip_htons(context->lifetime);
+        memcpy(UIP_ND6_OPT_6CO_BUF->prefix, context->prefix, 8);
+        uip_len += UIP_ND6_OPT_6CO_LEN;
+        nd6_opt_offset += UIP_ND6_OPT_6CO_LEN;
+      }
+    }
+  }
+#endif /* UIP_ND6_6CO */
+
   UIP_IP_BUF->len[0] = ((uip_len - UIP_IPH_LEN) >> 8);
   UIP_IP_BUF->len[1] = ((uip_len - UIP_IPH_LEN) & 0xff);
 
@@ -757,6 +804,12 @@ uip_nd6_rs_output(void)
 void
 uip_nd6_ra_input(void)
 {
+#if UIP_ND6_6CO
+  /* Contexts that come without a version are taken as they are */
+  int accept_contexts = 0;
+  uint16_t advertised_contexts = 0;
+#endif /* UIP_ND6_6CO */
+
   PRINTF("Received RA from");
   PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
   PRINTF("to");
@@ -861,6 +914,7 @@ uip_nd6_ra_input(void)
               stimer_set(&prefix->vlifetime,
                          uip_ntohl(nd6_opt_prefix_info->validlt));
               prefix->isinfinite = 0;
+              UIP_DS6_WHEEL_UPDATE(prefix);
               break;
             }
           }
@@ -896,6 +950,7 @@ uip_nd6_ra_input(void)
             } else {
               addr->isinfinite = 1;
             }
+            UIP_DS6_WHEEL_UPDATE(addr);
           } else {
             if(uip_ntohl(nd6_opt_prefix_info->validlt) ==
                UIP_ND6_INFINITE_LIFETIME) {
@@ -909,6 +964,25 @@ uip_nd6_ra_input(void)
         /* End of autonomous flag related processing */
       }
       break;
+#if UIP_ND6_6CO
+    case UIP_ND6_OPT_ABRO:
+      PRINTF("Processing ABRO option in RA\n");
+      accept_contexts = sicslowpan_context_accept_version(
+        uip_ntohs(((uip_nd6_opt_abro *)UIP_ND6_OPT_HDR_BUF)->version_low));
+      break;
+    case UIP_ND6_OPT_6CO:
+      PRINTF("Processing 6CO option in RA\n");
+      if(accept_contexts >= 0 && UIP_ND6_OPT_HDR_BUF->len >= 2) {
+        uip_nd6_opt_6co *opt_6co = (uip_nd6_opt_6co *)UIP_ND6_OPT_HDR_BUF;
+        sicslowpan_context_update(opt_6co->flags_cid & 0x0f, opt_6co->prefix,
+                                  opt_6co->context_len,
+                                  opt_6co->flags_cid &
+                                  SICSLOWPAN_CONTEXT_COMPRESS,
+                                  uip_ntohs(opt_6co->lifetime));
+        advertised_contexts |= 1 << (opt_6co->flags_cid & 0x0f);
+      }
+      break;
+#endif /* UIP_ND6_6CO */
     default:
       PRINTF("ND option not supported in RA");
       break;
@@ -916,6 +990,13 @@ uip_nd6_ra_input(void)
     nd6_opt_offset += (UIP_ND6_OPT_HDR_BUF->len << 3);
   }
 
+#if UIP_ND6_6CO
+  if(accept_contexts > 0) {
+    /* A new version replaces the whole list of contexts */
+    sicslowpan_context_prune(advertised_contexts);
+  }
+#endif /* UIP_ND6_6CO */
+
   defrt = uip_ds6_defrt_lookup(&UIP_IP_BUF->srcipaddr);
   if(UIP_ND6_RA_BUF->router_lifetime != 0) {
     if(nbr != NULL) {
@@ -928,6 +1009,7 @@ uip_nd6_ra_input(void)
     } else {
       stimer_set(&(defrt->lifetime),
                  (unsigned long)(uip_ntohs(UIP_ND6_RA_BUF->router_lifetime)));
+      UIP_DS6_WHEEL_UPDATE(defrt);
     }
   } else {
     if(defrt != NULL) {
@@ -947,7 +1029,7 @@ uip_nd6_ra_input(void)
   if(nbr != NULL && uip_packetqueue_buflen(&nbr->packethandle) != 0) {
     uip_len = uip_packetqueue_buflen(&nbr->packethandle);
     memcpy(UIP_IP_BUF, uip_packetqueue_buf(&nbr->packethandle), uip_len);
-    uip_packetqueue_free(&nbr->packethandle);
+    uip_packetqueue_dequeue(&nbr->packethandle);
     return;
   }
 
@@ -95,6 +95,16 @@
 #define UIP_ND6_MAX_RA_DELAY_TIME_MS        500 /*milli seconds*/
 /** @} */
 
+/** \name RFC 6775 6LoWPAN context distribution */
+/** @{ */
+/* Carry the 6LoWPAN address contexts in RAs (ABRO and 6CO options) */
+#ifndef UIP_CONF_ND6_6CO
+#define UIP_ND6_6CO                         0
+#else
+#define UIP_ND6_6CO UIP_CONF_ND6_6CO
+#endif
+/** @} */
+
 
 /** \name RFC 4861 Node constant */
 #define UIP_ND6_MAX_MULTICAST_SOLICIT  3
@@ -122,6 +132,8 @@
 #define UIP_ND6_OPT_PREFIX_INFO         3
 #define UIP_ND6_OPT_REDIRECTED_HDR      4
 #define UIP_ND6_OPT_MTU                 5
+#define UIP_ND6_OPT_ABRO                33
+#define UIP_ND6_OPT_6CO                 34
 /** @} */
 
 /** \name ND6 option types */
@@ -144,6 +156,8 @@
 #define UIP_ND6_OPT_HDR_LEN            2
 #define UIP_ND6_OPT_PREFIX_INFO_LEN    32
 #define UIP_ND6_OPT_MTU_LEN            8
+#define UIP_ND6_OPT_ABRO_LEN           24
+#define UIP_ND6_OPT_6CO_LEN            16 /* with a 64-bit prefix */
 
 
 /* Length of TLLAO and SLLAO options, it is L2 dependant */
@@ -266,6 +280,27 @@ typedef struct uip_nd6_opt_mtu {
   uint32_t mtu;
 } uip_nd6_opt_mtu;
 
+/** \brief ND option authoritative border router (RFC 6775) */
+typedef struct uip_nd6_opt_abro {
+  uint8_t type;
+  uint8_t len;
+  uint16_t version_low;
+  uint16_t version_high;
+  uint16_t lifetime;
+  uip_ipaddr_t address;
+} uip_nd6_opt_abro;
+
+/** \brief ND option 6LoWPAN context (RFC 6775) */
+typedef struct uip_nd6_opt_6co {
+  uint8_t type;
+  uint8_t len;
+  uint8_t context_len;
+  uint8_t flags_cid;
+  uint16_t reserved;
+  uint16_t lifetime;
+  uint8_t prefix[8];
+} uip_nd6_opt_6co;
+
 /** \struct Redirected header option */
 typedef struct uip_nd6_opt_redirected_hdr {
   uint8_t type;
@@ -2,12 +2,15 @@
 
 #include "net/uip.h"
 
+#include "lib/list.h"
 #include "lib/memb.h"
 
 #include "net/uip-packetqueue.h"
 
-#define MAX_NUM_QUEUED_PACKETS 2
-MEMB(packets_memb, struct uip_packetqueue_packet, MAX_NUM_QUEUED_PACKETS);
+/* All queued packets, oldest first. The queue of a handle is the
+   subsequence of packets that point back to that handle. */
+LIST(packets_list);
+MEMB(packets_memb, struct uip_packetqueue_packet, UIP_PACKETQUEUE_NUM);
 
 #define DEBUG 0
 #if DEBUG
@@ -17,50 +20,131 @@ MEMB(packets_memb, struct uip_packetqueue_packet, MAX_NUM_QUEUED_PACKETS);
 #define PRINTF(...)
 #endif
 
+/*---------------------------------------------------------------------------*/
+static struct uip_packetqueue_packet *
+first_packet(struct uip_packetqueue_handle *h)
+{
+  struct uip_packetqueue_packet *p;
+
+  for(p = list_head(packets_list); p != NULL; p = list_item_next(p)) {
+    if(p->handle == h) {
+      return p;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_packet(struct uip_packetqueue_packet *p)
+{
+  struct uip_packetqueue_handle *h = p->handle;
+
+  ctimer_stop(&p->lifetimer);
+  list_remove(packets_list, p);
+  memb_free(&packets_memb, p);
+  h->packet = first_packet(h);
+}
 /*---------------------------------------------------------------------------*/
 static void
 packet_timedout(void *ptr)
 {
-  struct uip_packetqueue_handle *h = ptr;
+  struct uip_packetqueue_packet *p = ptr;
 
-  PRINTF("uip_packetqueue_free timed out %p\n", h);
-  memb_free(&packets_memb, h->packet);
-  h->packet = NULL;
+  PRINTF("uip_packetqueue_free timed out %p\n", p->handle);
+  remove_packet(p);
+}
+/*---------------------------------------------------------------------------*/
+/* Find the handle with the longest queue */
+static struct uip_packetqueue_handle *
+longest_queue(void)
+{
+  struct uip_packetqueue_packet *p;
+  struct uip_packetqueue_handle *longest;
+  int len, longest_len;
+
+  longest = NULL;
+  longest_len = 0;
+  for(p = list_head(packets_list); p != NULL; p = list_item_next(p)) {
+    /* Count each queue once, at its first packet */
+    if(p == p->handle->packet) {
+      len = uip_packetqueue_len(p->handle);
+      if(len > longest_len) {
+        longest = p->handle;
+        longest_len = len;
+      }
+    }
+  }
+  return longest;
 }
 /*---------------------------------------------------------------------------*/
 void
 uip_packetqueue_new(struct uip_packetqueue_handle *handle)
 {
+  struct uip_packetqueue_packet *p;
+
   PRINTF("uip_packetqueue_new %p\n", handle);
+
+  /* Drop packets left behind by a previous user of this handle. */
   handle->packet = NULL;
+  while((p = first_packet(handle)) != NULL) {
+    remove_packet(p);
+  }
 }
 /*---------------------------------------------------------------------------*/
 struct uip_packetqueue_packet *
 uip_packetqueue_alloc(struct uip_packetqueue_handle *handle, clock_time_t lifetime)
 {
+  struct uip_packetqueue_packet *p;
+  struct uip_packetqueue_handle *victim;
+
   PRINTF("uip_packetqueue_alloc %p\n", handle);
-  if(handle->packet != NULL) {
-    PRINTF("alloced\n");
+  if(uip_packetqueue_len(handle) >= UIP_PACKETQUEUE_MAX_PER_HANDLE) {
+    /* RFC 4861, 7.2.2: the new arrival replaces the oldest entry. */
+    PRINTF("queue full, dropping oldest\n");
+    remove_packet(handle->packet);
+  }
+
+  p = memb_alloc(&packets_memb);
+  if(p == NULL) {
+    victim = longest_queue();
+    if(victim != NULL &&
+       (victim == handle ||
+        uip_packetqueue_len(victim) > uip_packetqueue_len(handle))) {
+      PRINTF("pool full, dropping oldest of %p\n", victim);
+      remove_packet(victim->packet);
+      p = memb_alloc(&packets_memb);
+    }
+  }
+  if(p == NULL) {
+    PRINTF("uip_packetqueue_alloc failed\n");
     return NULL;
   }
-  handle->packet = memb_alloc(&packets_memb);
+
+  p->handle = handle;
+  p->queue_buf_len = 0;
+  list_add(packets_list, p);
+  if(handle->packet == NULL) {
+    handle->packet = p;
+  }
+  ctimer_set(&p->lifetimer, lifetime, packet_timedout, p);
+  return p;
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_packetqueue_dequeue(struct uip_packetqueue_handle *handle)
+{
+  PRINTF("uip_packetqueue_dequeue %p\n", handle);
   if(handle->packet != NULL) {
-    ctimer_set(&handle->packet->lifetimer, lifetime,
-               packet_timedout, handle);
-  } else {
-    PRINTF("uip_packetqueue_alloc failed\n");
+    remove_packet(handle->packet);
   }
-  return handle->packet;
 }
 /*---------------------------------------------------------------------------*/
 void
 uip_packetqueue_free(struct uip_packetqueue_handle *handle)
 {
   PRINTF("uip_packetqueue_free %p\n", handle);
-  if(handle->packet != NULL) {
-    ctimer_stop(&handle->packet->lifetimer);
-    memb_free(&packets_memb, handle->packet);
-    handle->packet = NULL;
+  while(handle->packet != NULL) {
+    remove_packet(handle->packet);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -84,3 +168,18 @@ uip_packetqueue_set_buflen(struct uip_packetqueue_handle *h, uint16_t len)
   }
 }
 /*---------------------------------------------------------------------------*/
+int
+uip_packetqueue_len(struct uip_packetqueue_handle *h)
+{
+  struct uip_packetqueue_packet *p;
+  int len;
+
+  len = 0;
+  for(p = h->packet; p != NULL; p = list_item_next(p)) {
+    if(p->handle == h) {
+      len++;
+    }
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
@@ -3,33 +3,58 @@
 
 #include "sys/ctimer.h"
 
+/* Total number of packets that can be queued, shared by all handles */
+#ifdef UIP_CONF_PACKETQUEUE_NUM
+#define UIP_PACKETQUEUE_NUM UIP_CONF_PACKETQUEUE_NUM
+#else /* UIP_CONF_PACKETQUEUE_NUM */
+#define UIP_PACKETQUEUE_NUM 2
+#endif /* UIP_CONF_PACKETQUEUE_NUM */
+
+/* Maximum number of packets queued on a single handle */
+#ifdef UIP_CONF_PACKETQUEUE_MAX_PER_HANDLE
+#define UIP_PACKETQUEUE_MAX_PER_HANDLE UIP_CONF_PACKETQUEUE_MAX_PER_HANDLE
+#else /* UIP_CONF_PACKETQUEUE_MAX_PER_HANDLE */
+#define UIP_PACKETQUEUE_MAX_PER_HANDLE UIP_PACKETQUEUE_NUM
+#endif /* UIP_CONF_PACKETQUEUE_MAX_PER_HANDLE */
+
 struct uip_packetqueue_handle;
 
 struct uip_packetqueue_packet {
-  struct uip_ds6_queued_packet *next;
+  struct uip_packetqueue_packet *next;
   uint8_t queue_buf[UIP_BUFSIZE - UIP_LLH_LEN];
   uint16_t queue_buf_len;
   struct ctimer lifetimer;
   struct uip_packetqueue_handle *handle;
 };
 
+/* A FIFO of packets. packet points to the oldest packet of the queue,
+   which is the next one to be sent. */
 struct uip_packetqueue_handle {
   struct uip_packetqueue_packet *packet;
 };
 
 void uip_packetqueue_new(struct uip_packetqueue_handle *handle);
 
-
+/* Append a packet to the end of the queue. If the queue is full the
+   oldest packet of the queue is dropped. If all packets of the shared
+   pool are in use, the oldest packet of the longest queue is dropped
+   instead, provided that queue is longer than this one. The caller
+   fills in queue_buf and queue_buf_len of the returned packet. */
 struct uip_packetqueue_packet *
 uip_packetqueue_alloc(struct uip_packetqueue_handle *handle, clock_time_t lifetime);
 
+/* Drop the oldest packet of the queue */
+void uip_packetqueue_dequeue(struct uip_packetqueue_handle *handle);
 
+/* Drop all packets of the queue */
 void
 uip_packetqueue_free(struct uip_packetqueue_handle *handle);
 
+/* Access the oldest packet of the queue */
 uint8_t *uip_packetqueue_buf(struct uip_packetqueue_handle *h);
 uint16_t uip_packetqueue_buflen(struct uip_packetqueue_handle *h);
 void uip_packetqueue_set_buflen(struct uip_packetqueue_handle *h, uint16_t len);
 
+int uip_packetqueue_len(struct uip_packetqueue_handle *h);
 
 #endif /* UIP_PACKETQUEUE_H */
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         uIP packet buffer pool
+ */
+
+#include <string.h>
+
+#include "net/uip.h"
+#include "net/uip-pktbuf.h"
+#include "lib/memb.h"
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+MEMB(pktbuf_memb, struct uip_pktbuf, UIP_PKTBUF_NUM);
+
+static uint8_t allocated;
+
+/*---------------------------------------------------------------------------*/
+void
+uip_pktbuf_init(void)
+{
+  memb_init(&pktbuf_memb);
+  allocated = 0;
+}
+/*---------------------------------------------------------------------------*/
+struct uip_pktbuf *
+uip_pktbuf_alloc(void)
+{
+  struct uip_pktbuf *p;
+
+  p = memb_alloc(&pktbuf_memb);
+  if(p == NULL) {
+    PRINTF("uip_pktbuf_alloc: pool exhausted\n");
+    return NULL;
+  }
+  p->next = NULL;
+  p->len = 0;
+  p->refcount = 1;
+  allocated++;
+  return p;
+}
+/*---------------------------------------------------------------------------*/
+struct uip_pktbuf *
+uip_pktbuf_ref(struct uip_pktbuf *p)
+{
+  if(p != NULL) {
+    p->refcount++;
+  }
+  return p;
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_pktbuf_unref(struct uip_pktbuf *p)
+{
+  if(p == NULL || p->refcount == 0) {
+    return;
+  }
+  if(--p->refcount == 0) {
+    memb_free(&pktbuf_memb, p);
+    allocated--;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_pktbuf_to_uip(struct uip_pktbuf *p)
+{
+  memcpy(&uip_buf[UIP_LLH_LEN], p->buf, p->len);
+  uip_len = p->len;
+#if UIP_CONF_IPV6
+  uip_ext_len = 0;
+#endif /* UIP_CONF_IPV6 */
+}
+/*---------------------------------------------------------------------------*/
+int
+uip_pktbuf_numfree(void)
+{
+  return UIP_PKTBUF_NUM - allocated;
+}
+/*---------------------------------------------------------------------------*/
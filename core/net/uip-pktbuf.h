@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Header file for the uIP packet buffer pool
+ *
+ *         The packet buffer pool holds IP packets outside of the
+ *         global uip_buf. Each buffer is a reference counted
+ *         descriptor so that the same packet can sit on several
+ *         queues at once. The uIP stack itself still works on
+ *         uip_buf, which acts as the view of the packet that is
+ *         currently being processed.
+ */
+
+#ifndef __UIP_PKTBUF_H__
+#define __UIP_PKTBUF_H__
+
+#include "net/uip.h"
+
+#ifdef UIP_CONF_PKTBUF
+#define UIP_PKTBUF UIP_CONF_PKTBUF
+#else /* UIP_CONF_PKTBUF */
+#define UIP_PKTBUF 0
+#endif /* UIP_CONF_PKTBUF */
+
+/* Number of packet buffers in the pool */
+#ifdef UIP_CONF_PKTBUF_NUM
+#define UIP_PKTBUF_NUM UIP_CONF_PKTBUF_NUM
+#else /* UIP_CONF_PKTBUF_NUM */
+#define UIP_PKTBUF_NUM 4
+#endif /* UIP_CONF_PKTBUF_NUM */
+
+/* Maximum number of queued packets that tcpip_process handles per event */
+#ifdef UIP_CONF_PKTBUF_BATCH
+#define UIP_PKTBUF_BATCH UIP_CONF_PKTBUF_BATCH
+#else /* UIP_CONF_PKTBUF_BATCH */
+#define UIP_PKTBUF_BATCH UIP_PKTBUF_NUM
+#endif /* UIP_CONF_PKTBUF_BATCH */
+
+/**
+ * \brief      A packet buffer descriptor
+ *
+ *             The next pointer is owned by whoever currently queues
+ *             the buffer. A buffer can only be on one list at a time
+ *             but may be referenced from any number of other places.
+ */
+struct uip_pktbuf {
+  struct uip_pktbuf *next;
+  uint16_t len;
+  uint8_t refcount;
+  uint8_t buf[UIP_BUFSIZE - UIP_LLH_LEN];
+};
+
+/**
+ * \brief      Initialize the packet buffer pool
+ */
+void uip_pktbuf_init(void);
+
+/**
+ * \brief      Allocate an empty packet buffer
+ * \return     A buffer with a reference count of one, or NULL if the
+ *             pool is exhausted.
+ */
+struct uip_pktbuf *uip_pktbuf_alloc(void);
+
+/**
+ * \brief      Add a reference to a packet buffer
+ * \param p    The packet buffer
+ * \return     The same packet buffer, for convenience
+ */
+struct uip_pktbuf *uip_pktbuf_ref(struct uip_pktbuf *p);
+
+/**
+ * \brief      Drop a reference to a packet buffer
+ * \param p    The packet buffer
+ *
+ *             The buffer is returned to the pool when the last
+ *             reference has been dropped.
+ */
+void uip_pktbuf_unref(struct uip_pktbuf *p);
+
+/**
+ * \brief      Make uip_buf a view of a packet buffer
+ * \param p    The packet buffer
+ *
+ *             Copies the packet into uip_buf and sets uip_len, so
+ *             that the rest of uIP can process it. The reference
+ *             count of the buffer is not changed.
+ */
+void uip_pktbuf_to_uip(struct uip_pktbuf *p);
+
+/**
+ * \brief      Get the number of free buffers in the pool
+ */
+int uip_pktbuf_numfree(void);
+
+#endif /* __UIP_PKTBUF_H__ */
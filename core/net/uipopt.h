@@ -474,6 +474,52 @@
 #define SICSLOWPAN_REASS_MAXAGE 20
 #endif
 
+/**
+ * Number of datagrams that can be reassembled at the same time. Each
+ * reassembly context holds a full IP packet buffer, so only routers
+ * that receive fragments from several nodes should raise it.
+ */
+#ifdef SICSLOWPAN_CONF_REASS_CONTEXTS
+#define SICSLOWPAN_REASS_CONTEXTS (SICSLOWPAN_CONF_REASS_CONTEXTS)
+#else
+#define SICSLOWPAN_REASS_CONTEXTS 1
+#endif
+
+/**
+ * Forward fragments of datagrams that are routed through this node
+ * as they arrive, instead of reassembling and fragmenting the datagram
+ * again (default: no). The next hop is chosen from the header in the
+ * first fragment, and the following fragments are switched on their
+ * datagram tag.
+ */
+#ifdef SICSLOWPAN_CONF_FRAG_FORWARDING
+#define SICSLOWPAN_FRAG_FORWARDING (SICSLOWPAN_CONF_FRAG_FORWARDING)
+#else
+#define SICSLOWPAN_FRAG_FORWARDING 0
+#endif
+
+/**
+ * Number of datagrams whose fragments can be forwarded at the same
+ * time.
+ */
+#ifdef SICSLOWPAN_CONF_FRAG_FORWARDING_ENTRIES
+#define SICSLOWPAN_FRAG_FORWARDING_ENTRIES (SICSLOWPAN_CONF_FRAG_FORWARDING_ENTRIES)
+#else
+#define SICSLOWPAN_FRAG_FORWARDING_ENTRIES 4
+#endif
+
+/**
+ * Time, in clock ticks, between the fragments of a datagram that we
+ * send (default: 0, all fragments are handed to the MAC at once).
+ * One datagram is paced at a time; a datagram that is fragmented
+ * while another one is being paced is sent without pacing.
+ */
+#ifdef SICSLOWPAN_CONF_FRAG_PACING
+#define SICSLOWPAN_FRAG_PACING (SICSLOWPAN_CONF_FRAG_PACING)
+#else
+#define SICSLOWPAN_FRAG_PACING 0
+#endif
+
 /**
  * Do we compress the IP header or not (default: no)
  */
@@ -488,6 +534,29 @@
 #define SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS 1
 #endif
 
+/**
+ * Minutes that an expired address context is still used to decompress
+ * headers before it is removed (default: 5, the minimum context change
+ * delay of RFC 6775).
+ */
+#ifdef SICSLOWPAN_CONF_CONTEXT_GRACE
+#define SICSLOWPAN_CONTEXT_GRACE (SICSLOWPAN_CONF_CONTEXT_GRACE)
+#else
+#define SICSLOWPAN_CONTEXT_GRACE 5
+#endif
+
+/**
+ * Number of flows whose IPHC address encoding is cached (default: 0).
+ * Packets between the same source and destination, sent to the same
+ * link layer neighbor, then reuse the compressed addresses of the
+ * previous packet instead of compressing them again.
+ */
+#ifdef SICSLOWPAN_CONF_COMPRESSION_CACHE
+#define SICSLOWPAN_COMPRESSION_CACHE (SICSLOWPAN_CONF_COMPRESSION_CACHE)
+#else
+#define SICSLOWPAN_COMPRESSION_CACHE 0
+#endif
+
 /**
  * Do we support 6lowpan fragmentation
  */
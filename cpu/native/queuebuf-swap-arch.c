@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Queuebuf swap over a memory-mapped file for the native platform
+ */
+
+#include "contiki-conf.h"
+#include "net/queuebuf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* The swap file is created from this template and removed once it is
+   mapped, so that it goes away with the process. */
+#ifdef QUEUEBUF_CONF_SWAP_FILE
+#define QUEUEBUF_SWAP_FILE QUEUEBUF_CONF_SWAP_FILE
+#else
+#define QUEUEBUF_SWAP_FILE "/tmp/contiki-queuebuf-XXXXXX"
+#endif
+
+/*---------------------------------------------------------------------------*/
+void *
+queuebuf_swap_arch_map(unsigned long size)
+{
+  char name[] = QUEUEBUF_SWAP_FILE;
+  void *area;
+  int fd;
+
+  fd = mkstemp(name);
+  if(fd == -1) {
+    perror("queuebuf swap: mkstemp");
+    return NULL;
+  }
+  unlink(name);
+  if(ftruncate(fd, size) == -1) {
+    perror("queuebuf swap: ftruncate");
+    close(fd);
+    return NULL;
+  }
+  area = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(area == MAP_FAILED) {
+    perror("queuebuf swap: mmap");
+    return NULL;
+  }
+  return area;
+}
+/*---------------------------------------------------------------------------*/
@@ -68,6 +68,7 @@ PROCESS_THREAD(example_shell_process, ev, data)
   shell_file_init();
   shell_httpd_init();
   shell_irc_init();
+  shell_macstats_init();
   shell_netfile_init();
   /*shell_ping_init();*/ /* uIP ping */
   shell_power_init();
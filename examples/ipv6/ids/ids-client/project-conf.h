@@ -0,0 +1,9 @@
+#ifndef __IDS_CLIENT_PROJECT_CONF__
+#define __IDS_CLIENT_PROJECT_CONF__
+
+#include "ids-ports.h"
+
+/* Queue the mapper traffic ahead of other data */
+#define SICSLOWPAN_CONF_IDS_PORT MAPPER_SERVER_PORT
+
+#endif
@@ -3,4 +3,9 @@
 
 #define CSMA_CONF_MAX_NEIGHBOR_QUEUES 4
 
+#include "ids-ports.h"
+
+/* Queue the mapper traffic ahead of other data */
+#define SICSLOWPAN_CONF_IDS_PORT MAPPER_SERVER_PORT
+
 #endif
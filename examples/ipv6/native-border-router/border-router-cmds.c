@@ -42,6 +42,9 @@
 #include "dev/serial-line.h"
 #include "net/rpl/rpl.h"
 #include "net/uiplib.h"
+#include "net/mac/macstats.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define DEBUG DEBUG_NONE
@@ -53,6 +56,12 @@ uint8_t command_context;
 void packet_sent(uint8_t sessionid, uint8_t status, uint8_t tx);
 void nbr_print_stat(void);
 
+/*---------------------------------------------------------------------------*/
+static void
+print_line(const char *line)
+{
+  printf("%s\n", line);
+}
 /*---------------------------------------------------------------------------*/
 PROCESS(border_router_cmd_process, "Border router cmd process");
 /*---------------------------------------------------------------------------*/
@@ -70,6 +79,81 @@ border_router_cmd_handler(const uint8_t *data, int len)
       printf("Performing Global Repair...\n");
       rpl_repair_root(RPL_DEFAULT_INSTANCE);
       return 1;
+    } else if(data[1] == 'T' && command_context == CMD_CONTEXT_STDIO) {
+      /* Tune the DIO trickle timer: !T <Imin> <doublings> <k> */
+      rpl_instance_t *instance;
+      unsigned intmin, intdoubl, redundancy;
+      instance = rpl_get_instance(RPL_DEFAULT_INSTANCE);
+      if(instance == NULL ||
+         sscanf((const char *)&data[2], "%u %u %u",
+                &intmin, &intdoubl, &redundancy) != 3) {
+        printf("Usage: !T <Imin> <doublings> <k>, k 0 never suppresses DIOs\n");
+        printf("Only the root is retuned; the other nodes take the new\n");
+        printf("parameters from its DIOs when they join the DAG again\n");
+        return 1;
+      }
+      if(intmin > TRICKLE_TIMER_MAX_INTERVAL ||
+         intdoubl > TRICKLE_TIMER_MAX_INTERVAL - intmin ||
+         redundancy > 0xff) {
+        printf("Imin + doublings must be at most %u, k at most 255\n",
+               TRICKLE_TIMER_MAX_INTERVAL);
+        return 1;
+      }
+      printf("Setting the root's DIO trickle to Imin 2^%u ms, %u doublings, k %u%s\n",
+             intmin, intdoubl, redundancy,
+             redundancy == TRICKLE_TIMER_INFINITE_REDUNDANCY ?
+             " (no suppression)" : "");
+      printf("Other nodes keep their parameters until they join the DAG again\n");
+      rpl_set_dio_trickle(instance, intmin, intdoubl, redundancy);
+      return 1;
+    } else if(data[1] == 'O' && command_context == CMD_CONTEXT_STDIO) {
+      /* Tune the objective function: !O <hysteresis> <etx> <energy> <hops> */
+      rpl_instance_t *instance;
+      struct rpl_of_params params;
+      unsigned hysteresis, etx_weight, energy_weight, hopcount_weight;
+      instance = rpl_get_instance(RPL_DEFAULT_INSTANCE);
+      if(instance == NULL ||
+         sscanf((const char *)&data[2], "%u %u %u %u", &hysteresis,
+                &etx_weight, &energy_weight, &hopcount_weight) != 4) {
+        printf("Usage: !O <hysteresis> <etx weight> <energy weight> <hop weight>\n");
+        printf("A zero weight neither uses nor advertises the metric object\n");
+        return 1;
+      }
+      if(hysteresis > 0xffff || etx_weight > 0xff ||
+         energy_weight > 0xff || hopcount_weight > 0xff) {
+        printf("Hysteresis must be at most 65535, weights at most 255\n");
+        return 1;
+      }
+      params.hysteresis = hysteresis;
+      params.etx_weight = etx_weight;
+      params.energy_weight = energy_weight;
+      params.hopcount_weight = hopcount_weight;
+      printf("Setting the root's OF parameters to hysteresis %u, weights %u/%u/%u\n",
+             hysteresis, etx_weight, energy_weight, hopcount_weight);
+      rpl_set_of_params(instance, &params);
+      return 1;
+#if RPL_WITH_CONTEXTS
+    } else if(data[1] == 'X' && command_context == CMD_CONTEXT_STDIO) {
+      /* Set a 6LoWPAN context: !X <cid> <lifetime> <prefix>[/<len>] */
+      rpl_dag_t *dag;
+      uip_ipaddr_t prefix;
+      unsigned cid, lifetime, len;
+      char addr[40];
+      char *slash;
+      dag = rpl_get_any_dag();
+      if(dag != NULL &&
+         sscanf((const char *)&data[2], "%u %u %39s",
+                &cid, &lifetime, addr) == 3 &&
+         uiplib_ipaddrconv(addr, &prefix)) {
+        slash = strchr(addr, '/');
+        len = slash != NULL ? atoi(slash + 1) : 64;
+        if(rpl_set_context(dag, cid, &prefix, len, lifetime)) {
+          printf("Setting context %u to %s for %u minutes\n",
+                 cid, addr, lifetime);
+        }
+      }
+      return 1;
+#endif /* RPL_WITH_CONTEXTS */
     } else if(data[1] == 'M' && command_context == CMD_CONTEXT_RADIO) {
       /* We need to know that this is from the slip-radio here. */
       PRINTF("Setting MAC address\n");
@@ -113,6 +197,10 @@ border_router_cmd_handler(const uint8_t *data, int len)
     } else if(data[1] == 'S') {
       border_router_print_stat();
       return 1;
+    } else if(data[1] == 'L') {
+      /* Latency of the packets sent through the radio, per neighbor */
+      macstats_print(print_line);
+      return 1;
     }
   }
   return 0;
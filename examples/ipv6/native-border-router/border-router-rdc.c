@@ -40,6 +40,7 @@
 #include "net/packetbuf.h"
 #include "net/queuebuf.h"
 #include "net/netstack.h"
+#include "net/mac/macstats.h"
 #include "packetutils.h"
 #include "border-router.h"
 #include <string.h>
@@ -62,6 +63,10 @@ struct tx_callback {
   void *ptr;
   struct packetbuf_attr attrs[PACKETBUF_NUM_ATTRS];
   struct packetbuf_addr addrs[PACKETBUF_NUM_ADDRS];
+#if MACSTATS_ENABLED
+  /* When the packet was handed to the radio over SLIP */
+  clock_time_t sent_time;
+#endif /* MACSTATS_ENABLED */
 };
 
 static struct tx_callback callbacks[MAX_CALLBACKS];
@@ -73,6 +78,8 @@ void packet_sent(uint8_t sessionid, uint8_t status, uint8_t tx)
     callback = &callbacks[sessionid];
     packetbuf_clear();
     packetbuf_attr_copyfrom(callback->attrs, callback->addrs);
+    MACSTATS_PACKET(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
+                    callback->sent_time, callback->sent_time, status);
     mac_call_sent_callback(callback->cback, callback->ptr, status, tx);
   } else {
     PRINTF("*** ERROR: too high session id %d\n", sessionid);
@@ -88,6 +95,9 @@ setup_callback(mac_callback_t sent, void *ptr)
   callback->cback = sent;
   callback->ptr = ptr;
   packetbuf_attr_copyto(callback->attrs, callback->addrs);
+#if MACSTATS_ENABLED
+  callback->sent_time = clock_time();
+#endif /* MACSTATS_ENABLED */
 
   callback_pos++;
   if(callback_pos >= MAX_CALLBACKS) {
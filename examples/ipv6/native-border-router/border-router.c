@@ -258,8 +258,21 @@ border_router_set_mac(const uint8_t *data)
 void
 border_router_print_stat()
 {
+  rpl_instance_t *instance;
+  struct trickle_timer *t;
+
   printf("bytes received over SLIP: %ld\n", slip_received);
   printf("bytes sent over SLIP: %ld\n", slip_sent);
+
+  instance = rpl_get_instance(RPL_DEFAULT_INSTANCE);
+  if(instance != NULL) {
+    t = &instance->dio_trickle;
+    printf("DIO trickle: Imin 2^%u ms, Imax 2^%u ms, I 2^%u ms, k %u\n",
+           t->i_min, t->i_min + t->i_doublings, t->i_current, t->k);
+    printf("DIO trickle: intervals %u, sent %u, suppressed %u, consistent %u, resets %u, doublings %u\n",
+           t->stats.intervals, t->stats.transmitted, t->stats.suppressed,
+           t->stats.consistent, t->stats.resets, t->stats.doublings);
+  }
 }
 
 /*---------------------------------------------------------------------------*/
@@ -39,6 +39,39 @@
 #undef UIP_CONF_BUFFER_SIZE
 #define UIP_CONF_BUFFER_SIZE    1280
 
+/* Fragments from several nodes converge on the border router */
+#undef SICSLOWPAN_CONF_REASS_CONTEXTS
+#define SICSLOWPAN_CONF_REASS_CONTEXTS 4
+
+/* Queue packets read from the tun device in a packet buffer pool
+   instead of handing them to uIP one at a time */
+#undef UIP_CONF_PKTBUF
+#define UIP_CONF_PKTBUF           1
+#undef UIP_CONF_PKTBUF_NUM
+#define UIP_CONF_PKTBUF_NUM       8
+
+/* Cache the next hop of recent destinations for forwarding */
+#undef UIP_CONF_NEXTHOP_CACHE_SIZE
+#define UIP_CONF_NEXTHOP_CACHE_SIZE 8
+
+/* Cache the IPHC address encoding of recent flows */
+#undef SICSLOWPAN_CONF_COMPRESSION_CACHE
+#define SICSLOWPAN_CONF_COMPRESSION_CACHE 8
+
+/* Distribute the 6LoWPAN contexts set with the !X command in DIOs */
+#undef RPL_CONF_WITH_CONTEXTS
+#define RPL_CONF_WITH_CONTEXTS    1
+
+/* Room for bursts towards neighbors that are still being resolved */
+#undef UIP_CONF_PACKETQUEUE_NUM
+#define UIP_CONF_PACKETQUEUE_NUM  8
+#undef UIP_CONF_PACKETQUEUE_MAX_PER_HANDLE
+#define UIP_CONF_PACKETQUEUE_MAX_PER_HANDLE 4
+
+/* Age the neighbor cache on a timer wheel rather than a full sweep */
+#undef UIP_CONF_DS6_TIMER_WHEEL
+#define UIP_CONF_DS6_TIMER_WHEEL  1
+
 #undef UIP_CONF_RECEIVE_WINDOW
 #define UIP_CONF_RECEIVE_WINDOW  60
 
@@ -49,6 +82,8 @@
 
 #define SERIALIZE_ATTRIBUTES 1
 
+#define MACSTATS_CONF_ENABLED 1
+
 #define CMD_CONF_OUTPUT border_router_cmd_output
 
 #undef NETSTACK_CONF_RDC
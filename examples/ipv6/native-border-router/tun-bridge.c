@@ -35,6 +35,7 @@
 
 #include "net/uip.h"
 #include "net/uip-ds6.h"
+#include "net/uip-pktbuf.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -240,6 +241,49 @@ tun_input(unsigned char *data, int maxlen)
   return size;
 }
 
+/*---------------------------------------------------------------------------*/
+#if UIP_PKTBUF
+static int
+tun_readable(void)
+{
+  fd_set rset;
+  struct timeval tv;
+
+  FD_ZERO(&rset);
+  FD_SET(tunfd, &rset);
+  tv.tv_sec = 0;
+  tv.tv_usec = 0;
+  return select(tunfd + 1, &rset, NULL, NULL, &tv) > 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Read up to max packets that are pending on the tun device. The
+   first one goes through uip_buf directly when nothing is queued
+   ahead of it, the others are queued for tcpip_process. */
+static void
+tun_input_batch(int max)
+{
+  struct uip_pktbuf *p;
+  int count;
+
+  count = 0;
+  if(tcpip_input_queue_empty()) {
+    uip_len = tun_input(&uip_buf[UIP_LLH_LEN], UIP_BUFSIZE - UIP_LLH_LEN);
+    tcpip_input();
+    count++;
+  }
+  while(count < max && tun_readable()) {
+    p = uip_pktbuf_alloc();
+    if(p == NULL) {
+      /* Pool exhausted - the packets stay in the tun device until the
+         queue has drained, so that they are not reordered. */
+      return;
+    }
+    p->len = tun_input(p->buf, sizeof(p->buf));
+    tcpip_input_pktbuf(p);
+    count++;
+  }
+}
+#endif /* UIP_PKTBUF */
 /*---------------------------------------------------------------------------*/
 static void
 init(void)
@@ -288,13 +332,18 @@ handle_fd(fd_set *rset, fd_set *wset)
   }
 
   if(delaymsec==0) {
-    int size;
-
     if(FD_ISSET(tunfd, rset)) {
+#if UIP_PKTBUF
+      /* Paced packets are read one at a time */
+      tun_input_batch(slip_config_basedelay ? 1 : UIP_PKTBUF_BATCH);
+#else /* UIP_PKTBUF */
+      int size;
+
       size = tun_input(&uip_buf[UIP_LLH_LEN], sizeof(uip_buf));
       /* printf("TUN data incoming read:%d\n", size); */
       uip_len = size;
       tcpip_input();
+#endif /* UIP_PKTBUF */
 
       if(slip_config_basedelay) {
         struct timeval tv;
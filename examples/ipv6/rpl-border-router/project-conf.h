@@ -44,6 +44,11 @@
 #define UIP_CONF_BUFFER_SIZE    140
 #endif
 
+/* Fragments from several nodes converge on the border router */
+#ifndef SICSLOWPAN_CONF_REASS_CONTEXTS
+#define SICSLOWPAN_CONF_REASS_CONTEXTS 2
+#endif
+
 #ifndef UIP_CONF_RECEIVE_WINDOW
 #define UIP_CONF_RECEIVE_WINDOW  60
 #endif
@@ -52,10 +52,15 @@
 #define PERIOD 60
 #endif
 
+/* Bytes of padding added to each message, to make it fragmented */
+#ifndef PAYLOAD
+#define PAYLOAD 0
+#endif
+
 #define START_INTERVAL		(15 * CLOCK_SECOND)
 #define SEND_INTERVAL		(PERIOD * CLOCK_SECOND)
 #define SEND_TIME		(random_rand() % (SEND_INTERVAL))
-#define MAX_PAYLOAD_LEN		30
+#define MAX_PAYLOAD_LEN		(30 + PAYLOAD)
 
 static struct uip_udp_conn *client_conn;
 static uip_ipaddr_t server_ipaddr;
@@ -81,12 +86,17 @@ send_packet(void *ptr)
 {
   static int seq_id;
   char buf[MAX_PAYLOAD_LEN];
+  int len;
 
   seq_id++;
   PRINTF("DATA send to %d 'Hello %d'\n",
          server_ipaddr.u8[sizeof(server_ipaddr.u8) - 1], seq_id);
-  sprintf(buf, "Hello %d from the client", seq_id);
-  uip_udp_packet_sendto(client_conn, buf, strlen(buf),
+  len = sprintf(buf, "Hello %d from the client", seq_id);
+#if PAYLOAD
+  memset(&buf[len], '.', PAYLOAD);
+  len += PAYLOAD;
+#endif
+  uip_udp_packet_sendto(client_conn, buf, len,
                         &server_ipaddr, UIP_HTONS(UDP_SERVER_PORT));
 }
 /*---------------------------------------------------------------------------*/
@@ -85,6 +85,7 @@ PROCESS_THREAD(sky_shell_process, ev, data)
   shell_sky_init();
   shell_power_init();
   shell_powertrace_init();
+  shell_macstats_init();
   /*  shell_base64_init();*/
   shell_text_init();
   shell_time_init();
@@ -96,6 +96,10 @@
 
 #define PACKETBUF_CONF_ATTRS_INLINE 1
 
+/* Let the TSCH RDC hop over the simulated channels */
+void radio_set_channel(int channel);
+#define TSCHRDC_CONF_SET_CHANNEL(channel) radio_set_channel(channel)
+
 #define QUEUEBUF_CONF_NUM 16
 
 #define CC_CONF_REGISTER_ARGS          1
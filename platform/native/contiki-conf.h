@@ -89,6 +89,12 @@ typedef unsigned short uip_stats_t;
 #define NETSTACK_CONF_RDC     nullrdc_driver
 #endif /* NETSTACK_CONF_RDC */
 
+/* Rtimers fire from the SIGALRM handler, so the TSCH slots run from
+   the main loop instead */
+#ifndef TSCHRDC_CONF_SLOTS_FROM_PROCESS
+#define TSCHRDC_CONF_SLOTS_FROM_PROCESS 1
+#endif /* TSCHRDC_CONF_SLOTS_FROM_PROCESS */
+
 #ifndef NETSTACK_CONF_RADIO
 #define NETSTACK_CONF_RADIO   nullradio_driver
 #endif /* NETSTACK_CONF_RADIO */